@@ -0,0 +1,84 @@
+#ifndef PIDFD_HPP
+#define PIDFD_HPP
+
+#ifdef __linux__
+#include <cerrno>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+// pidfd helpers shared by the labs that wait for children through epoll. A pidfd becomes
+// readable once its process exits, and reaping through it (rather than by pid) cannot pick
+// up an unrelated process that reused the pid. C++11 so that every lab can include it.
+namespace pidfdlib
+{
+    struct PidfdExit
+    {
+        int pid = 0;
+        int exit_code = 0;
+        int signal = 0;
+        struct rusage usage = {};
+    };
+
+    // Returns a close-on-exec pidfd for `pid`, or -1 when the kernel lacks pidfd_open (< 5.3).
+    inline int open_pidfd(int pid)
+    {
+        return (int)syscall(SYS_pidfd_open, pid, 0);
+    }
+
+    enum ReapResult
+    {
+        REAP_RUNNING,
+        REAP_EXITED,
+        // waitid failed (errno is set), e.g. ECHILD when the process was reaped elsewhere.
+        // The pidfd stays readable, so callers must stop watching it.
+        REAP_FAILED
+    };
+
+    // Reaps the process behind `pidfd` without blocking.
+    inline ReapResult reap_pidfd(int pidfd, PidfdExit &exit)
+    {
+        siginfo_t info = {};
+        // glibc's waitid does not expose the rusage argument of the syscall.
+        long result;
+        do
+        {
+            result = syscall(SYS_waitid, P_PIDFD, pidfd, &info, WEXITED | WNOHANG, &exit.usage);
+        } while (result != 0 && errno == EINTR);
+        if (result != 0)
+        {
+            return REAP_FAILED;
+        }
+        if (info.si_pid == 0)
+        {
+            return REAP_RUNNING;
+        }
+        exit.pid = info.si_pid;
+        if (info.si_code == CLD_EXITED)
+        {
+            exit.exit_code = info.si_status;
+        }
+        else
+        {
+            exit.signal = info.si_status;
+        }
+        return REAP_EXITED;
+    }
+
+    // Signals the process behind `pidfd`. Unlike kill() this cannot reach an unrelated
+    // process that reused the pid, because the pidfd pins the original one. Returns 0 or
+    // an errno value (ESRCH once the process has exited).
+    inline int send_signal(int pidfd, int signal)
+    {
+        return syscall(SYS_pidfd_send_signal, pidfd, signal, NULL, 0) == 0 ? 0 : errno;
+    }
+}
+#endif
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef SPAWN_PLACEMENT_HPP
+#define SPAWN_PLACEMENT_HPP
+
+#ifndef _WIN32
+#include <cerrno>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <sched.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sys/stat.h>
+#endif
+
+// Placement of children started with posix_spawn: cgroup v2 limits, CPU affinity,
+// SCHED_IDLE and nice. posix_spawn has attributes for none of the first two and glibc
+// rejects the third, so each needs a step around the spawn call. C++11 so that every lab
+// can include it.
+namespace spawnlib
+{
+#ifdef __linux__
+    // Absolute cgroup v2 directory of `cgroup`, which is relative to /sys/fs/cgroup unless absolute.
+    inline std::string cgroup_directory(const char *cgroup)
+    {
+        return cgroup[0] == '/' ? std::string(cgroup) : std::string("/sys/fs/cgroup/") + cgroup;
+    }
+
+    // Returns 0 or the errno of the failed write.
+    inline int write_cgroup_file(const std::string &path, const std::string &value)
+    {
+        FILE *file = fopen(path.c_str(), "w");
+        if (file == NULL)
+        {
+            return errno;
+        }
+        // Limits the kernel rejects only surface when stdio flushes the value, in fclose.
+        errno = 0;
+        bool written = fputs(value.c_str(), file) >= 0;
+        bool closed = fclose(file) == 0;
+        if (written && closed)
+        {
+            return 0;
+        }
+        return errno != 0 ? errno : EIO;
+    }
+
+    // Creates `cgroup` and writes its cpu.max / memory.max when the limits are set (> 0).
+    // The cpu and memory controllers are enabled in the parent first, which fails
+    // harmlessly when they already are. Returns 0 or an errno value.
+    inline int prepare_cgroup(const char *cgroup, long long cpu_max_us, long long cpu_period_us, long long memory_max_bytes)
+    {
+        std::string directory = cgroup_directory(cgroup);
+        size_t slash = directory.find_last_of('/');
+        if (slash != std::string::npos && slash > 0)
+        {
+            write_cgroup_file(directory.substr(0, slash) + "/cgroup.subtree_control", "+cpu +memory");
+        }
+        if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+        {
+            return errno;
+        }
+        if (cpu_max_us > 0)
+        {
+            int error = write_cgroup_file(directory + "/cpu.max", std::to_string(cpu_max_us) + " " + std::to_string(cpu_period_us));
+            if (error != 0)
+            {
+                return error;
+            }
+        }
+        if (memory_max_bytes > 0)
+        {
+            return write_cgroup_file(directory + "/memory.max", std::to_string(memory_max_bytes));
+        }
+        return 0;
+    }
+
+    // posix_spawn cannot start a child inside another cgroup (that needs clone3 with
+    // CLONE_INTO_CGROUP), so children are moved right after the spawn. Returns 0 or an
+    // errno value; callers kill a child that cannot be moved rather than leave it running
+    // unconstrained.
+    inline int move_to_cgroup(const char *cgroup, int pid)
+    {
+        return write_cgroup_file(cgroup_directory(cgroup) + "/cgroup.procs", std::to_string(pid));
+    }
+
+    // A child starts with the affinity mask of the thread that spawned it, so this narrows
+    // the calling thread's mask to `cpus` for its lifetime. An empty list changes nothing.
+    class ScopedSpawnAffinity
+    {
+    public:
+        explicit ScopedSpawnAffinity(const std::vector<int> &cpus) : _pinned(false)
+        {
+            if (cpus.empty() || pthread_getaffinity_np(pthread_self(), sizeof(_previous), &_previous) != 0)
+            {
+                return;
+            }
+            cpu_set_t narrowed;
+            CPU_ZERO(&narrowed);
+            for (int cpu : cpus)
+            {
+                CPU_SET(cpu, &narrowed);
+            }
+            _pinned = pthread_setaffinity_np(pthread_self(), sizeof(narrowed), &narrowed) == 0;
+        }
+
+        ~ScopedSpawnAffinity()
+        {
+            if (_pinned)
+            {
+                pthread_setaffinity_np(pthread_self(), sizeof(_previous), &_previous);
+            }
+        }
+
+        ScopedSpawnAffinity(const ScopedSpawnAffinity &) = delete;
+        ScopedSpawnAffinity &operator=(const ScopedSpawnAffinity &) = delete;
+
+    private:
+        cpu_set_t _previous;
+        bool _pinned;
+    };
+#endif
+
+    // Asks for SCHED_IDLE through the spawn attributes and adds POSIX_SPAWN_SETSCHEDULER
+    // to `flags`. glibc only accepts SCHED_OTHER / FIFO / RR there, so false means the
+    // policy has to be switched with set_idle_policy once the child exists.
+    inline bool add_idle_policy(posix_spawnattr_t &attributes, short &flags)
+    {
+#ifdef SCHED_IDLE
+        struct sched_param parameters = {};
+        if (posix_spawnattr_setschedpolicy(&attributes, SCHED_IDLE) == 0)
+        {
+            posix_spawnattr_setschedparam(&attributes, &parameters);
+            flags |= POSIX_SPAWN_SETSCHEDULER;
+            return true;
+        }
+#else
+        (void)attributes;
+        (void)flags;
+#endif
+        return false;
+    }
+
+    inline void set_idle_policy(int pid)
+    {
+#ifdef SCHED_IDLE
+        struct sched_param parameters = {};
+        sched_setscheduler(pid, SCHED_IDLE, &parameters);
+#else
+        (void)pid;
+#endif
+    }
+
+    // Sets the child's nice value to the caller's plus `nice`.
+    inline void adjust_nice(int pid, int nice)
+    {
+        if (nice != 0)
+        {
+            setpriority(PRIO_PROCESS, pid, getpriority(PRIO_PROCESS, 0) + nice);
+        }
+    }
+}
+#endif
+
+#endif
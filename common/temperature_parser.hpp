@@ -0,0 +1,313 @@
+#ifndef TEMPERATURE_PARSER_HPP
+#define TEMPERATURE_PARSER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PARSELIB_SSE2 1
+#endif
+
+// Parser for the sensor line format "[-]ddd.dddd\n". Unlike strtod / atof it ignores the
+// locale, accepts nothing but plain fixed-point decimals and reports garbage instead of
+// silently returning 0. A line with at most 15 significant digits is parsed into an exact
+// integer mantissa and divided by an exact power of ten, so the result is the same
+// correctly rounded double strtod would produce (given double, not x87, arithmetic).
+// C++11 so that every lab can include it.
+namespace parselib
+{
+    // Longest accepted line after trimming, sign and decimal point included.
+    const size_t MAX_SAMPLE_LENGTH = 32;
+    const int MAX_DIGITS = 15;
+
+    struct BatchResult
+    {
+        // Bytes up to and including the last '\n'; the rest is an incomplete line the
+        // caller should keep for the next batch.
+        size_t consumed = 0;
+        size_t parsed = 0;
+        size_t rejected = 0;
+    };
+
+    namespace detail
+    {
+        static const double POWERS_OF_TEN[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+        };
+
+        static const uint64_t INTEGER_POWERS_OF_TEN[] = {
+            1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL
+        };
+
+        // Classification reads a whole 32-byte block, and 8-digit groups are converted with
+        // an 8-byte load, so callers keep this much readable memory past a line start.
+        const size_t BLOCK_SIZE = 32;
+        const size_t READ_AHEAD = BLOCK_SIZE + 8;
+
+        inline bool is_blank(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\r';
+        }
+
+        inline unsigned count_bits(uint32_t mask)
+        {
+#if defined(__GNUC__)
+            return (unsigned)__builtin_popcount(mask);
+#else
+            unsigned count = 0;
+            for (; mask != 0; mask &= mask - 1)
+            {
+                count++;
+            }
+            return count;
+#endif
+        }
+
+        // Index of the lowest set bit; `mask` must not be zero.
+        inline unsigned lowest_bit(uint32_t mask)
+        {
+#if defined(__GNUC__)
+            return (unsigned)__builtin_ctz(mask);
+#else
+            unsigned index = 0;
+            while ((mask & 1) == 0)
+            {
+                mask >>= 1;
+                index++;
+            }
+            return index;
+#endif
+        }
+
+        inline uint32_t low_bits(size_t count)
+        {
+            return count >= 32 ? 0xFFFFFFFFu : (1u << count) - 1;
+        }
+
+        // Bit i of each mask describes block[i].
+        struct BlockMasks
+        {
+            uint32_t newlines;
+            uint32_t digits;
+            uint32_t dots;
+        };
+
+        inline BlockMasks classify(const char *block)
+        {
+            BlockMasks masks;
+#if defined(__AVX2__)
+            __m256i bytes = _mm256_loadu_si256((const __m256i *)block);
+            // Signed compares: '0'..'9' is the only range above '/' and below ':'.
+            __m256i above = _mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('0' - 1));
+            __m256i below = _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), bytes);
+            masks.digits = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(above, below));
+            masks.dots = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('.')));
+            masks.newlines = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')));
+#elif defined(PARSELIB_SSE2)
+            masks.digits = 0;
+            masks.dots = 0;
+            masks.newlines = 0;
+            for (int half = 0; half < 2; ++half)
+            {
+                __m128i bytes = _mm_loadu_si128((const __m128i *)(block + half * 16));
+                __m128i above = _mm_cmpgt_epi8(bytes, _mm_set1_epi8('0' - 1));
+                __m128i below = _mm_cmplt_epi8(bytes, _mm_set1_epi8('9' + 1));
+                masks.digits |= (uint32_t)_mm_movemask_epi8(_mm_and_si128(above, below)) << (half * 16);
+                masks.dots |= (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('.'))) << (half * 16);
+                masks.newlines |= (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'))) << (half * 16);
+            }
+#else
+            masks.digits = 0;
+            masks.dots = 0;
+            masks.newlines = 0;
+            for (size_t i = 0; i < BLOCK_SIZE; ++i)
+            {
+                unsigned char c = (unsigned char)block[i];
+                masks.digits |= (uint32_t)((unsigned)(c - '0') < 10u) << i;
+                masks.dots |= (uint32_t)(c == '.') << i;
+                masks.newlines |= (uint32_t)(c == '\n') << i;
+            }
+#endif
+            return masks;
+        }
+
+        // Value of `count` (at most 8) validated digits. Reads 8 bytes from `text`.
+        inline uint64_t digits_value(const char *text, size_t count)
+        {
+            if (count == 0)
+            {
+                return 0;
+            }
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_M_X64) || defined(_M_IX86)
+            // SWAR: the first digit is the lowest byte, so shifting left drops the bytes past
+            // the digits and pads the front with zero digits; three multiplies then combine
+            // 8 digits into 4 pairs, 2 quads and the final value.
+            uint64_t chunk;
+            std::memcpy(&chunk, text, sizeof(chunk));
+            chunk = (chunk - 0x3030303030303030ULL) << (8 * (8 - count));
+            chunk = (chunk * 10) + (chunk >> 8);
+            chunk = (((chunk & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+                     (((chunk >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+            return chunk;
+#else
+            uint64_t value = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                value = value * 10 + (unsigned)(text[i] - '0');
+            }
+            return value;
+#endif
+        }
+
+        // Converts `length` validated characters (digits and at most one '.', no sign).
+        // Reads up to READ_AHEAD bytes from `text`.
+        inline double convert(const char *text, size_t length, uint32_t dots)
+        {
+            size_t dot = dots != 0 ? lowest_bit(dots) : length;
+            size_t fraction_digits = dot < length ? length - dot - 1 : 0;
+            uint64_t mantissa = 0;
+            if (dot <= 8 && fraction_digits <= 8)
+            {
+                mantissa = digits_value(text, dot) * INTEGER_POWERS_OF_TEN[fraction_digits] +
+                           digits_value(text + dot + 1, fraction_digits);
+            }
+            else
+            {
+                for (size_t i = 0; i < length; ++i)
+                {
+                    if (i != dot)
+                    {
+                        mantissa = mantissa * 10 + (unsigned)(text[i] - '0');
+                    }
+                }
+            }
+            return (double)mantissa / POWERS_OF_TEN[fraction_digits];
+        }
+
+        // Checks that the characters selected by `body` are digits with at most one '.'
+        // and that there are 1..MAX_DIGITS digits.
+        inline bool is_valid_body(const BlockMasks &masks, uint32_t body)
+        {
+            uint32_t dots = masks.dots & body;
+            unsigned digit_count = count_bits(masks.digits & body);
+            return body != 0 && ((masks.digits | masks.dots) & body) == body && (dots & (dots - 1)) == 0 &&
+                   digit_count != 0 && digit_count <= (unsigned)MAX_DIGITS;
+        }
+
+        // Position of the next '\n' in [begin, end), or end when there is none.
+        inline const char *find_newline(const char *begin, const char *end)
+        {
+            const void *found = std::memchr(begin, '\n', (size_t)(end - begin));
+            return found != nullptr ? (const char *)found : end;
+        }
+    }
+
+    // Parses one sample: optional blanks, an optional sign, digits with at most one '.',
+    // optional blanks. Exponents, "inf", "nan" and thousands separators are rejected.
+    inline bool parse_decimal(const char *begin, const char *end, double &value)
+    {
+        while (begin < end && detail::is_blank(*begin))
+        {
+            ++begin;
+        }
+        while (end > begin && detail::is_blank(end[-1]))
+        {
+            --end;
+        }
+
+        bool negative = false;
+        if (begin < end && (*begin == '-' || *begin == '+'))
+        {
+            negative = *begin == '-';
+            ++begin;
+        }
+
+        size_t length = (size_t)(end - begin);
+        if (length == 0 || length > MAX_SAMPLE_LENGTH)
+        {
+            return false;
+        }
+
+        // Work on a zero-padded copy so the block reads never leave the caller's buffer.
+        char block[detail::READ_AHEAD] = {};
+        std::memcpy(block, begin, length);
+        detail::BlockMasks masks = detail::classify(block);
+        if (!detail::is_valid_body(masks, detail::low_bits(length)))
+        {
+            return false;
+        }
+
+        double result = detail::convert(block, length, masks.dots & detail::low_bits(length));
+        value = negative ? -result : result;
+        return true;
+    }
+
+    // Parses every complete '\n'-terminated line of [data, data + size) in one pass and
+    // appends the values to `values`. Blank lines are skipped; lines parse_decimal rejects
+    // are counted in `rejected`.
+    inline BatchResult parse_lines(const char *data, size_t size, std::vector<double> &values)
+    {
+        BatchResult result;
+        const char *end = data + size;
+        const char *line = data;
+        while (line < end)
+        {
+            // Fast path for the usual "[-]dd.dddd[\r]\n" line: a single block load finds the
+            // line end and classifies every character of it at once.
+            if ((size_t)(end - line) >= detail::READ_AHEAD)
+            {
+                detail::BlockMasks masks = detail::classify(line);
+                if (masks.newlines != 0)
+                {
+                    size_t length = detail::lowest_bit(masks.newlines);
+                    size_t sign = line[0] == '-' || line[0] == '+' ? 1 : 0;
+                    size_t body_end = length > sign && line[length - 1] == '\r' ? length - 1 : length;
+                    uint32_t body = detail::low_bits(body_end) & ~detail::low_bits(sign);
+                    if (detail::is_valid_body(masks, body))
+                    {
+                        double value = detail::convert(line + sign, body_end - sign, (masks.dots & body) >> sign);
+                        values.push_back(line[0] == '-' ? -value : value);
+                        result.parsed++;
+                        line += length + 1;
+                        continue;
+                    }
+                }
+            }
+
+            const char *newline = detail::find_newline(line, end);
+            if (newline == end)
+            {
+                break;
+            }
+
+            double value;
+            if (parse_decimal(line, newline, value))
+            {
+                values.push_back(value);
+                result.parsed++;
+            }
+            else
+            {
+                const char *first = line;
+                while (first < newline && detail::is_blank(*first))
+                {
+                    ++first;
+                }
+                if (first != newline)
+                {
+                    result.rejected++;
+                }
+            }
+            line = newline + 1;
+        }
+        result.consumed = (size_t)(line - data);
+        return result;
+    }
+}
+
+#endif
@@ -0,0 +1,517 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "timestamp.hpp"
+
+// Periodic jobs for the labs: a hierarchical timer wheel (O(1) insert, cancel and expiry
+// regardless of how many timers are pending) and a Scheduler that runs jobs on one
+// background thread at wall-clock aligned times, e.g. every hour at :00 local time.
+// The thread sleeps until the next timer is due instead of polling. C++11 so that every
+// lab can include it.
+namespace timerlib
+{
+    // Identifies a pending timer; ids are never reused, so a stale id cancels nothing.
+    typedef uint64_t TimerId;
+    const TimerId NO_TIMER = 0;
+
+    // 5 levels of 64 slots: with the Scheduler's 10 ms ticks the wheel covers 124 days
+    // before timers go to the overflow list.
+    const unsigned WHEEL_LEVEL_BITS = 6;
+    const unsigned WHEEL_LEVELS = 5;
+    const unsigned WHEEL_SLOTS = 1u << WHEEL_LEVEL_BITS;
+
+    namespace detail
+    {
+        inline unsigned lowest_bit(uint64_t bits)
+        {
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward64(&index, bits);
+            return (unsigned)index;
+#else
+            return (unsigned)__builtin_ctzll(bits);
+#endif
+        }
+
+        inline uint64_t low_mask(unsigned bits)
+        {
+            return bits >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << bits) - 1;
+        }
+
+        // Node links and buckets of TimerWheel: the list end, a released node and the
+        // bucket past the last level for timers beyond the wheel's range.
+        const uint32_t NIL = 0xffffffffu;
+        const uint32_t FREE = 0xffffffffu;
+        const uint32_t OVERFLOW_BUCKET = WHEEL_LEVELS * WHEEL_SLOTS;
+    }
+
+    // Time is an abstract tick counter that only moves forward through advance. A timer
+    // lives on the level of the highest 6-bit group in which its expiry differs from the
+    // current tick and is moved one level down each time the wheel reaches its slot, so
+    // it is touched at most WHEEL_LEVELS times. Not thread-safe.
+    class TimerWheel
+    {
+    public:
+        explicit TimerWheel(uint64_t now = 0) : current(now), free_head(detail::NIL), count(0)
+        {
+            heads.assign(detail::OVERFLOW_BUCKET + 1, detail::NIL);
+            for (unsigned level = 0; level < WHEEL_LEVELS; ++level)
+            {
+                occupied[level] = 0;
+            }
+        }
+
+        // Calls `callback` from the advance that reaches `expires`; a tick in the past
+        // means the next tick.
+        TimerId schedule(uint64_t expires, std::function<void()> callback)
+        {
+            uint32_t index;
+            if (free_head != detail::NIL)
+            {
+                index = free_head;
+                free_head = nodes[index].next;
+            }
+            else
+            {
+                index = (uint32_t)nodes.size();
+                nodes.push_back(Node());
+                nodes[index].generation = 1;
+            }
+            Node &node = nodes[index];
+            node.expires = expires > current ? expires : current + 1;
+            node.callback = std::move(callback);
+            link(index);
+            ++count;
+            return ((uint64_t)node.generation << 32) | (index + 1);
+        }
+
+        bool cancel(TimerId id)
+        {
+            uint32_t index = (uint32_t)(id & 0xffffffffu) - 1;
+            if (id == NO_TIMER || index >= nodes.size() || nodes[index].generation != (uint32_t)(id >> 32) ||
+                nodes[index].bucket == detail::FREE)
+            {
+                return false;
+            }
+            unlink(index);
+            release(index);
+            return true;
+        }
+
+        uint64_t now() const { return current; }
+        size_t size() const { return count; }
+
+        // Earliest tick at which advance has something to do: a timer expiring or a slot
+        // to cascade (which may wake the caller up to WHEEL_LEVELS times early). The
+        // maximum uint64_t when the wheel is empty.
+        uint64_t next_event() const
+        {
+            for (unsigned level = 0; level < WHEEL_LEVELS; ++level)
+            {
+                unsigned shift = WHEEL_LEVEL_BITS * level;
+                unsigned slot = (unsigned)(current >> shift) & (WHEEL_SLOTS - 1);
+                // Pending slots on a level always lie after the current one.
+                uint64_t later = occupied[level] & ~detail::low_mask(slot + 1);
+                if (later != 0)
+                {
+                    uint64_t block = current & ~detail::low_mask(shift + WHEEL_LEVEL_BITS);
+                    return block | ((uint64_t)detail::lowest_bit(later) << shift);
+                }
+            }
+            if (heads[detail::OVERFLOW_BUCKET] != detail::NIL)
+            {
+                unsigned span = WHEEL_LEVEL_BITS * WHEEL_LEVELS;
+                return ((current >> span) + 1) << span;
+            }
+            return std::numeric_limits<uint64_t>::max();
+        }
+
+        // Moves time forward to `tick` and appends the callbacks of the timers that expired
+        // on the way to `expired`, earliest first. Only ticks with work are visited, so a
+        // long jump costs no more than a short one.
+        void advance(uint64_t tick, std::vector<std::function<void()>> &expired)
+        {
+            while (true)
+            {
+                uint64_t next = next_event();
+                if (next > tick)
+                {
+                    if (tick > current)
+                    {
+                        current = tick;
+                    }
+                    return;
+                }
+                current = next;
+                if ((next & detail::low_mask(WHEEL_LEVEL_BITS * WHEEL_LEVELS)) == 0)
+                {
+                    relink(detail::OVERFLOW_BUCKET);
+                }
+                for (unsigned level = WHEEL_LEVELS - 1; level > 0; --level)
+                {
+                    unsigned shift = WHEEL_LEVEL_BITS * level;
+                    if ((next & detail::low_mask(shift)) == 0)
+                    {
+                        relink(level * WHEEL_SLOTS + ((unsigned)(next >> shift) & (WHEEL_SLOTS - 1)));
+                    }
+                }
+
+                uint32_t bucket = (uint32_t)(next & (WHEEL_SLOTS - 1));
+                while (heads[bucket] != detail::NIL)
+                {
+                    uint32_t index = heads[bucket];
+                    unlink(index);
+                    expired.push_back(std::move(nodes[index].callback));
+                    release(index);
+                }
+            }
+        }
+
+    private:
+        struct Node
+        {
+            uint64_t expires;
+            uint32_t prev;
+            uint32_t next;
+            uint32_t generation;
+            uint32_t bucket;
+            std::function<void()> callback;
+        };
+
+        uint32_t bucket_for(uint64_t expires) const
+        {
+            uint64_t difference = expires ^ current;
+            for (unsigned level = 0; level < WHEEL_LEVELS; ++level)
+            {
+                unsigned shift = WHEEL_LEVEL_BITS * level;
+                if ((difference >> (shift + WHEEL_LEVEL_BITS)) == 0)
+                {
+                    return level * WHEEL_SLOTS + ((uint32_t)(expires >> shift) & (WHEEL_SLOTS - 1));
+                }
+            }
+            return detail::OVERFLOW_BUCKET;
+        }
+
+        void link(uint32_t index)
+        {
+            Node &node = nodes[index];
+            uint32_t bucket = bucket_for(node.expires);
+            node.bucket = bucket;
+            node.prev = detail::NIL;
+            node.next = heads[bucket];
+            if (node.next != detail::NIL)
+            {
+                nodes[node.next].prev = index;
+            }
+            heads[bucket] = index;
+            if (bucket != detail::OVERFLOW_BUCKET)
+            {
+                occupied[bucket / WHEEL_SLOTS] |= (uint64_t)1 << (bucket % WHEEL_SLOTS);
+            }
+        }
+
+        void unlink(uint32_t index)
+        {
+            Node &node = nodes[index];
+            if (node.prev != detail::NIL)
+            {
+                nodes[node.prev].next = node.next;
+            }
+            else
+            {
+                heads[node.bucket] = node.next;
+            }
+            if (node.next != detail::NIL)
+            {
+                nodes[node.next].prev = node.prev;
+            }
+            if (heads[node.bucket] == detail::NIL && node.bucket != detail::OVERFLOW_BUCKET)
+            {
+                occupied[node.bucket / WHEEL_SLOTS] &= ~((uint64_t)1 << (node.bucket % WHEEL_SLOTS));
+            }
+        }
+
+        void release(uint32_t index)
+        {
+            Node &node = nodes[index];
+            node.callback = nullptr;
+            node.bucket = detail::FREE;
+            ++node.generation;
+            node.next = free_head;
+            free_head = index;
+            --count;
+        }
+
+        // Re-files every timer of a bucket against the current tick.
+        void relink(uint32_t bucket)
+        {
+            uint32_t index = heads[bucket];
+            heads[bucket] = detail::NIL;
+            if (bucket != detail::OVERFLOW_BUCKET)
+            {
+                occupied[bucket / WHEEL_SLOTS] &= ~((uint64_t)1 << (bucket % WHEEL_SLOTS));
+            }
+            while (index != detail::NIL)
+            {
+                uint32_t next = nodes[index].next;
+                link(index);
+                index = next;
+            }
+        }
+
+        std::vector<Node> nodes;
+        std::vector<uint32_t> heads;
+        uint64_t occupied[WHEEL_LEVELS];
+        uint64_t current;
+        uint32_t free_head;
+        size_t count;
+    };
+
+    // The first local time after `after` that lies `offset` past a multiple of `period`
+    // counted from local midnight: next_aligned(now, hours(1)) is the next :00,
+    // next_aligned(now, hours(24), hours(3)) the next 03:00.
+    inline std::chrono::system_clock::time_point next_aligned(std::chrono::system_clock::time_point after,
+                                                              std::chrono::seconds period,
+                                                              std::chrono::seconds offset = std::chrono::seconds(0))
+    {
+        int64_t total_ms = std::chrono::duration_cast<std::chrono::milliseconds>(after.time_since_epoch()).count();
+        int64_t seconds = (total_ms >= 0 ? total_ms : total_ms - 999) / 1000;
+        int64_t local = seconds + timelib::detail::utc_offset((time_t)seconds);
+        int64_t step = period.count() > 0 ? period.count() : 1;
+        int64_t phase = ((local - offset.count()) % step + step) % step;
+        int64_t next_local = local - phase + step;
+        // Convert back with the offset in effect at the target, which differs across a
+        // DST change; a local time skipped by the change fires an hour late.
+        int64_t next = next_local - timelib::detail::utc_offset((time_t)(next_local - (local - seconds)));
+        if (next <= seconds)
+        {
+            next += step;
+        }
+        return std::chrono::system_clock::time_point(std::chrono::seconds(next));
+    }
+
+    // Runs jobs on its own thread. Deadlines are wall-clock times kept on a TimerWheel
+    // of steady_clock ticks; periodic jobs re-derive their next deadline from the wall
+    // clock each time they run, so clock corrections do not accumulate. Jobs run one at a
+    // time without the scheduler lock held, so they may schedule or cancel jobs.
+    class Scheduler
+    {
+    public:
+        typedef uint64_t JobId;
+        // Receives the time the job was due, which is what a rollup should be stamped with.
+        typedef std::function<void(std::chrono::system_clock::time_point)> Job;
+
+        explicit Scheduler(std::chrono::milliseconds resolution = std::chrono::milliseconds(10))
+            : resolution(resolution), origin(std::chrono::steady_clock::now()), last_job(0), stopping(false)
+        {
+            worker = std::thread(&Scheduler::run, this);
+        }
+
+        ~Scheduler()
+        {
+            stop();
+        }
+
+        Scheduler(const Scheduler &) = delete;
+        Scheduler &operator=(const Scheduler &) = delete;
+
+        // Runs `job` at every next_aligned(period, offset) boundary from now on.
+        JobId every(std::chrono::seconds period, Job job, std::chrono::seconds offset = std::chrono::seconds(0))
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            JobId id = ++last_job;
+            Entry &entry = jobs[id];
+            entry.job = std::move(job);
+            entry.period = period;
+            entry.offset = offset;
+            entry.interval = std::chrono::milliseconds(0);
+            arm(id, entry, next_aligned(std::chrono::system_clock::now(), period, offset));
+            return id;
+        }
+
+        // Runs `job` every `interval` from now on, for sub-second or unaligned periods.
+        // Deadlines advance by `interval` from the previous one; runs missed while a
+        // job was late are skipped rather than run back to back.
+        JobId repeat(std::chrono::milliseconds interval, Job job)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            JobId id = ++last_job;
+            Entry &entry = jobs[id];
+            entry.job = std::move(job);
+            entry.period = std::chrono::seconds(0);
+            entry.offset = std::chrono::seconds(0);
+            entry.interval = interval.count() > 0 ? interval : std::chrono::milliseconds(1);
+            arm(id, entry, std::chrono::system_clock::now() + entry.interval);
+            return id;
+        }
+
+        // Runs `job` once, `delay` from now.
+        JobId after(std::chrono::milliseconds delay, Job job)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            JobId id = ++last_job;
+            Entry &entry = jobs[id];
+            entry.job = std::move(job);
+            entry.period = std::chrono::seconds(0);
+            entry.offset = std::chrono::seconds(0);
+            entry.interval = std::chrono::milliseconds(0);
+            arm(id, entry, std::chrono::system_clock::now() + delay);
+            return id;
+        }
+
+        // A job that is already running finishes, but is not run again.
+        bool cancel(JobId id)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = jobs.find(id);
+            if (found == jobs.end())
+            {
+                return false;
+            }
+            wheel.cancel(found->second.timer);
+            jobs.erase(found);
+            return true;
+        }
+
+        // Waits for the running job, if any, and drops the rest.
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wakeup.notify_all();
+            if (worker.joinable())
+            {
+                worker.join();
+            }
+        }
+
+    private:
+        struct Entry
+        {
+            Job job;
+            std::chrono::seconds period;
+            std::chrono::seconds offset;
+            std::chrono::milliseconds interval;
+            std::chrono::system_clock::time_point due;
+            TimerId timer;
+        };
+
+        uint64_t tick_at(std::chrono::steady_clock::time_point time) const
+        {
+            return (uint64_t)((time - origin) / resolution);
+        }
+
+        void arm(JobId id, Entry &entry, std::chrono::system_clock::time_point due)
+        {
+            entry.due = due;
+            auto delay = due - std::chrono::system_clock::now();
+            auto target = std::chrono::steady_clock::now() - origin;
+            if (delay.count() > 0)
+            {
+                target += std::chrono::duration_cast<std::chrono::steady_clock::duration>(delay);
+            }
+            // Round up: a job never runs before its wall-clock time.
+            uint64_t tick = (uint64_t)((target + resolution - std::chrono::steady_clock::duration(1)) / resolution);
+            entry.timer = wheel.schedule(tick, [this, id]() { fire(id); });
+            wakeup.notify_all();
+        }
+
+        // Called on the worker thread without the lock.
+        void fire(JobId id)
+        {
+            Job job;
+            std::chrono::system_clock::time_point due;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto found = jobs.find(id);
+                if (found == jobs.end() || stopping)
+                {
+                    return;
+                }
+                Entry &entry = found->second;
+                job = entry.job;
+                due = entry.due;
+                if (entry.interval.count() > 0)
+                {
+                    auto now = std::chrono::system_clock::now();
+                    auto next = due + entry.interval;
+                    if (next <= now)
+                    {
+                        next += (now - due) / entry.interval * entry.interval;
+                    }
+                    arm(id, entry, next);
+                }
+                else if (entry.period.count() == 0)
+                {
+                    jobs.erase(found);
+                }
+                else
+                {
+                    // Past `due` even if the steady clock ran slightly ahead of the wall clock.
+                    auto now = std::chrono::system_clock::now();
+                    arm(id, entry, next_aligned(now > due ? now : due, entry.period, entry.offset));
+                }
+            }
+            job(due);
+        }
+
+        void run()
+        {
+            std::vector<std::function<void()>> expired;
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!stopping)
+            {
+                wheel.advance(tick_at(std::chrono::steady_clock::now()), expired);
+                if (!expired.empty())
+                {
+                    lock.unlock();
+                    for (std::function<void()> &callback : expired)
+                    {
+                        callback();
+                    }
+                    expired.clear();
+                    lock.lock();
+                    continue;
+                }
+                uint64_t next = wheel.next_event();
+                if (next == std::numeric_limits<uint64_t>::max())
+                {
+                    wakeup.wait(lock);
+                }
+                else
+                {
+                    wakeup.wait_until(lock, origin + resolution * (int64_t)next);
+                }
+            }
+        }
+
+        const std::chrono::milliseconds resolution;
+        const std::chrono::steady_clock::time_point origin;
+        TimerWheel wheel;
+        std::unordered_map<JobId, Entry> jobs;
+        JobId last_job;
+        bool stopping;
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        std::thread worker;
+    };
+}
+
+#endif
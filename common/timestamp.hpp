@@ -0,0 +1,181 @@
+#ifndef TIMESTAMP_HPP
+#define TIMESTAMP_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+// Local-time "YYYY-MM-DD HH:MM:SS[.mmm]" formatting shared by the labs. It is meant for
+// hot logging paths: localtime_r is consulted at most once per 15 minutes per thread,
+// and the formatted date/time prefix is reused for every call within the same second.
+// C++11 so that every lab can include it.
+namespace timelib
+{
+    // Longest output of format_local, without a terminating NUL.
+    const size_t TIMESTAMP_SIZE = 23;
+
+    namespace detail
+    {
+        static const char DIGIT_PAIRS[] =
+            "00010203040506070809"
+            "10111213141516171819"
+            "20212223242526272829"
+            "30313233343536373839"
+            "40414243444546474849"
+            "50515253545556575859"
+            "60616263646566676869"
+            "70717273747576777879"
+            "80818283848586878889"
+            "90919293949596979899";
+
+        inline char *write_2(char *out, unsigned value)
+        {
+            std::memcpy(out, DIGIT_PAIRS + value * 2, 2);
+            return out + 2;
+        }
+
+        // Days since 1970-01-01 for a proleptic Gregorian date, and back again
+        // (H. Hinnant's civil-date algorithms).
+        inline int64_t days_from_civil(int64_t year, unsigned month, unsigned day)
+        {
+            year -= month <= 2;
+            const int64_t era = (year >= 0 ? year : year - 399) / 400;
+            const unsigned year_of_era = (unsigned)(year - era * 400);
+            const unsigned day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+            const unsigned day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+            return era * 146097 + (int64_t)day_of_era - 719468;
+        }
+
+        inline void civil_from_days(int64_t days, int64_t &year, unsigned &month, unsigned &day)
+        {
+            days += 719468;
+            const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+            const unsigned day_of_era = (unsigned)(days - era * 146097);
+            const unsigned year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+            const unsigned day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+            const unsigned shifted_month = (5 * day_of_year + 2) / 153;
+            day = day_of_year - (153 * shifted_month + 2) / 5 + 1;
+            month = shifted_month < 10 ? shifted_month + 3 : shifted_month - 9;
+            year = (int64_t)year_of_era + era * 400 + (month <= 2);
+        }
+
+        inline bool local_tm(time_t seconds, std::tm &result)
+        {
+#ifdef _WIN32
+            return localtime_s(&result, &seconds) == 0;
+#else
+            return localtime_r(&seconds, &result) != nullptr;
+#endif
+        }
+
+        // UTC offset in effect at `seconds`. Every time zone changes its offset on a
+        // quarter-hour boundary, so one localtime_r answer is reused until the next one.
+        inline int64_t utc_offset(time_t seconds)
+        {
+            struct OffsetCache
+            {
+                int64_t valid_from = 1;
+                int64_t valid_until = 0;
+                int64_t offset = 0;
+            };
+            static thread_local OffsetCache cache;
+
+            if (seconds >= cache.valid_from && seconds < cache.valid_until)
+            {
+                return cache.offset;
+            }
+
+            std::tm local{};
+            if (!local_tm(seconds, local))
+            {
+                return 0;
+            }
+            int64_t local_seconds = days_from_civil(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday) * 86400 +
+                                    local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec;
+            const int64_t quarter = 15 * 60;
+            int64_t floor = (int64_t)seconds - (((int64_t)seconds % quarter) + quarter) % quarter;
+            cache.offset = local_seconds - (int64_t)seconds;
+            cache.valid_from = floor;
+            cache.valid_until = floor + quarter;
+            return cache.offset;
+        }
+
+        inline void format_second(char *out, time_t seconds, char date_separator)
+        {
+            int64_t local = (int64_t)seconds + utc_offset(seconds);
+            int64_t days = (local >= 0 ? local : local - 86399) / 86400;
+            unsigned second_of_day = (unsigned)(local - days * 86400);
+
+            int64_t year;
+            unsigned month, day;
+            civil_from_days(days, year, month, day);
+
+            out = write_2(out, (unsigned)(year / 100 % 100));
+            out = write_2(out, (unsigned)(year % 100));
+            *out++ = date_separator;
+            out = write_2(out, month);
+            *out++ = date_separator;
+            out = write_2(out, day);
+            *out++ = ' ';
+            out = write_2(out, second_of_day / 3600);
+            *out++ = ':';
+            out = write_2(out, second_of_day / 60 % 60);
+            *out++ = ':';
+            write_2(out, second_of_day % 60);
+        }
+    }
+
+    // Writes the local time of `seconds` as "YYYY-MM-DD HH:MM:SS", followed by ".mmm" when
+    // `milliseconds` is non-negative. Returns the number of characters written; no NUL is
+    // appended. Years outside 0..9999 are not supported.
+    inline size_t format_local(char *out, time_t seconds, int milliseconds = -1, char date_separator = '-')
+    {
+        struct SecondCache
+        {
+            time_t second = 0;
+            char date_separator = 0;
+            char text[19];
+        };
+        static thread_local SecondCache cache;
+
+        if (cache.date_separator != date_separator || cache.second != seconds)
+        {
+            detail::format_second(cache.text, seconds, date_separator);
+            cache.second = seconds;
+            cache.date_separator = date_separator;
+        }
+        std::memcpy(out, cache.text, sizeof(cache.text));
+        if (milliseconds < 0)
+        {
+            return sizeof(cache.text);
+        }
+
+        out[19] = '.';
+        out[20] = (char)('0' + milliseconds / 100 % 10);
+        detail::write_2(out + 21, (unsigned)(milliseconds % 100));
+        return TIMESTAMP_SIZE;
+    }
+
+    inline size_t format_local(char *out, std::chrono::system_clock::time_point time, bool with_milliseconds = false, char date_separator = '-')
+    {
+        int64_t total_ms = std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+        int64_t seconds = (total_ms >= 0 ? total_ms : total_ms - 999) / 1000;
+        int milliseconds = with_milliseconds ? (int)(total_ms - seconds * 1000) : -1;
+        return format_local(out, (time_t)seconds, milliseconds, date_separator);
+    }
+
+    inline std::string local_timestamp(std::chrono::system_clock::time_point time, bool with_milliseconds = false, char date_separator = '-')
+    {
+        char buffer[TIMESTAMP_SIZE];
+        return std::string(buffer, format_local(buffer, time, with_milliseconds, date_separator));
+    }
+
+    inline std::string local_timestamp_now(bool with_milliseconds = false, char date_separator = '-')
+    {
+        return local_timestamp(std::chrono::system_clock::now(), with_milliseconds, date_separator);
+    }
+}
+
+#endif
@@ -0,0 +1,344 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define TRACELIB_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TRACELIB_RDTSC 1
+#endif
+
+// In-process span recorder. TRACE_SPAN("name") measures the enclosing scope and, when
+// tracing is on, writes one complete event into a ring buffer owned by the current
+// thread: no locks, no allocation and no shared cache lines on the hot path. When
+// tracing is off a span costs one relaxed load and a branch; building with
+// TRACELIB_DISABLED removes the spans entirely.
+//
+// Timestamps come from the TSC where available (assumed invariant, as on any x86 CPU of
+// the last decade) and from steady_clock elsewhere; ticks are converted to time only when
+// the buffers are exported as Chrome trace / Perfetto JSON (chrome://tracing, ui.perfetto.dev).
+// The rings keep the newest RING_CAPACITY spans per thread. C++11 so that every lab can
+// include it.
+namespace tracelib
+{
+    const size_t RING_CAPACITY = 1 << 15;
+
+    namespace detail
+    {
+        inline uint64_t now_ticks()
+        {
+#if defined(TRACELIB_RDTSC)
+            return __rdtsc();
+#else
+            return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+        }
+
+        inline uint64_t now_ns()
+        {
+            return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        struct Event
+        {
+            const char *name;
+            uint64_t begin;
+            uint64_t end;
+        };
+
+        // Written only by its thread; `head` is published with release ordering after
+        // the slot, so an exporter that reads `head` with acquire sees complete events.
+        struct Ring
+        {
+            Event events[RING_CAPACITY];
+            std::atomic<uint64_t> head;
+            unsigned thread_id;
+            char thread_name[32];
+
+            explicit Ring(unsigned id) : head(0), thread_id(id)
+            {
+                std::snprintf(thread_name, sizeof(thread_name), "thread %u", id);
+            }
+        };
+
+        struct State
+        {
+            std::atomic<bool> enabled;
+            std::atomic<bool> dump_requested;
+            std::mutex mutex;
+            std::vector<std::unique_ptr<Ring>> rings;
+            // Pair of clock readings taken when tracing was enabled: the trace origin
+            // and the first calibration point for ticks -> nanoseconds.
+            uint64_t origin_ticks;
+            uint64_t origin_ns;
+            std::string dump_path;
+
+            State() : enabled(false), dump_requested(false), origin_ticks(0), origin_ns(0), dump_path("trace.json") {}
+        };
+
+        inline State &state()
+        {
+            static State instance;
+            return instance;
+        }
+
+        inline Ring &local_ring()
+        {
+            thread_local Ring *ring = nullptr;
+            if (ring == nullptr)
+            {
+                State &s = state();
+                std::lock_guard<std::mutex> lock(s.mutex);
+                s.rings.push_back(std::unique_ptr<Ring>(new Ring((unsigned)s.rings.size() + 1)));
+                ring = s.rings.back().get();
+            }
+            return *ring;
+        }
+
+        inline void record(const char *name, uint64_t begin, uint64_t end)
+        {
+            Ring &ring = local_ring();
+            uint64_t head = ring.head.load(std::memory_order_relaxed);
+            Event &event = ring.events[head % RING_CAPACITY];
+            event.name = name;
+            event.begin = begin;
+            event.end = end;
+            ring.head.store(head + 1, std::memory_order_release);
+        }
+
+        inline void append_json_string(std::string &out, const char *text)
+        {
+            out += '"';
+            for (; *text != '\0'; ++text)
+            {
+                char c = *text;
+                if (c == '"' || c == '\\')
+                {
+                    out += '\\';
+                    out += c;
+                }
+                else if ((unsigned char)c >= 0x20)
+                {
+                    out += c;
+                }
+            }
+            out += '"';
+        }
+
+        inline void on_dump_signal(int)
+        {
+            state().dump_requested.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    inline bool is_enabled()
+    {
+        return detail::state().enabled.load(std::memory_order_relaxed);
+    }
+
+    // Starts recording. The first call fixes the trace origin; spans recorded before it are
+    // not kept.
+    inline void enable()
+    {
+        detail::State &s = detail::state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (s.origin_ns == 0)
+        {
+            s.origin_ticks = detail::now_ticks();
+            s.origin_ns = detail::now_ns();
+        }
+        s.enabled.store(true, std::memory_order_relaxed);
+    }
+
+    inline void disable()
+    {
+        detail::state().enabled.store(false, std::memory_order_relaxed);
+    }
+
+    // Names the calling thread in exported traces; `name` is copied.
+    inline void set_thread_name(const char *name)
+    {
+        detail::Ring &ring = detail::local_ring();
+        std::snprintf(ring.thread_name, sizeof(ring.thread_name), "%s", name);
+    }
+
+    // Measures its own lifetime. `name` must outlive the trace (use string literals).
+    class Span
+    {
+    public:
+        explicit Span(const char *name) : name(name), begin(0)
+        {
+            if (is_enabled())
+            {
+                begin = detail::now_ticks();
+            }
+        }
+
+        ~Span()
+        {
+            if (begin != 0)
+            {
+                detail::record(name, begin, detail::now_ticks());
+            }
+        }
+
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+
+    private:
+        const char *name;
+        uint64_t begin;
+    };
+
+    // Chrome trace event format: one "X" (complete) event per span plus thread names.
+    // Readers do not stop the writers; slots that may have been overwritten while being
+    // copied are skipped.
+    inline std::string export_chrome_json()
+    {
+        detail::State &s = detail::state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        std::string out = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+        if (s.origin_ns == 0)
+        {
+            return out + "]}";
+        }
+
+        double ns_per_tick = 1.0;
+#if defined(TRACELIB_RDTSC)
+        // Calibrate over at least 10 ms so that the ratio is good to a few ppm.
+        uint64_t ticks = detail::now_ticks();
+        uint64_t ns = detail::now_ns();
+        while (ns - s.origin_ns < 10000000)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            ticks = detail::now_ticks();
+            ns = detail::now_ns();
+        }
+        ns_per_tick = (double)(ns - s.origin_ns) / (double)(ticks - s.origin_ticks);
+#endif
+
+        bool is_first = true;
+        char number[96];
+        std::vector<detail::Event> events;
+        for (const auto &ring : s.rings)
+        {
+            if (!is_first)
+            {
+                out += ',';
+            }
+            is_first = false;
+            std::snprintf(number, sizeof(number), "\n{\"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"name\": \"thread_name\", \"args\": {\"name\": ",
+                          ring->thread_id);
+            out += number;
+            detail::append_json_string(out, ring->thread_name);
+            out += "}}";
+
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            uint64_t first = head > RING_CAPACITY ? head - RING_CAPACITY : 0;
+            events.clear();
+            for (uint64_t i = first; i < head; ++i)
+            {
+                events.push_back(ring->events[i % RING_CAPACITY]);
+            }
+            uint64_t head_after = ring->head.load(std::memory_order_acquire);
+            size_t skip = head_after > RING_CAPACITY && head_after - RING_CAPACITY > first
+                              ? (size_t)(head_after - RING_CAPACITY - first)
+                              : 0;
+
+            for (size_t i = skip; i < events.size(); ++i)
+            {
+                const detail::Event &event = events[i];
+                if (event.begin < s.origin_ticks || event.end < event.begin)
+                {
+                    continue;
+                }
+                double ts = (double)(event.begin - s.origin_ticks) * ns_per_tick / 1000.0;
+                double dur = (double)(event.end - event.begin) * ns_per_tick / 1000.0;
+                out += ",\n{\"ph\": \"X\", \"pid\": 1, \"name\": ";
+                detail::append_json_string(out, event.name);
+                std::snprintf(number, sizeof(number), ", \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}", ring->thread_id, ts, dur);
+                out += number;
+            }
+        }
+        out += "\n]}\n";
+        return out;
+    }
+
+    inline bool write_chrome_json(const std::string &path)
+    {
+        std::string json = export_chrome_json();
+        FILE *file = std::fopen(path.c_str(), "wb");
+        if (file == nullptr)
+        {
+            return false;
+        }
+        bool is_written = std::fwrite(json.data(), 1, json.size(), file) == json.size();
+        return std::fclose(file) == 0 && is_written;
+    }
+
+    // Enables tracing when the environment variable is set. Its value is the dump file
+    // path ("1" keeps the default trace.json). On POSIX, SIGUSR2 then requests a dump,
+    // which the program writes from its own loop with dump_if_requested (a signal handler
+    // may not allocate or do file I/O).
+    inline bool enable_from_env(const char *variable)
+    {
+        const char *value = std::getenv(variable);
+        if (value == nullptr || *value == '\0' || std::strcmp(value, "0") == 0)
+        {
+            return false;
+        }
+        detail::State &s = detail::state();
+        if (std::strcmp(value, "1") != 0)
+        {
+            s.dump_path = value;
+        }
+        enable();
+#if defined(SIGUSR2)
+        std::signal(SIGUSR2, detail::on_dump_signal);
+#endif
+        return true;
+    }
+
+    // Writes the trace to the configured path if a dump was requested since the last call.
+    inline bool dump_if_requested()
+    {
+        detail::State &s = detail::state();
+        if (!s.dump_requested.exchange(false, std::memory_order_relaxed))
+        {
+            return false;
+        }
+        return write_chrome_json(s.dump_path);
+    }
+
+    inline const std::string &dump_path()
+    {
+        return detail::state().dump_path;
+    }
+}
+
+#define TRACELIB_CONCAT_INNER(a, b) a##b
+#define TRACELIB_CONCAT(a, b) TRACELIB_CONCAT_INNER(a, b)
+
+#if defined(TRACELIB_DISABLED)
+#define TRACE_SPAN(name) ((void)0)
+#else
+#define TRACE_SPAN(name) tracelib::Span TRACELIB_CONCAT(trace_span_, __LINE__)(name)
+#endif
+
+#endif
@@ -1,17 +1,35 @@
 #ifdef _WIN32
 #include <windows.h>
+#include <io.h>
+#include <psapi.h>
 #else
 #include <spawn.h>
+#include <stdio.h>
 #include <wait.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <signal.h>
 #endif
 
+#include <chrono>
+#include <string>
+#include <vector>
+
 #include "background.hpp"
+#include "spawn_placement.hpp"
+
+#ifndef _WIN32
+extern char **environ;
+#endif
 
 
+#ifdef _WIN32
 int launch_on_windows(const char *program_path, int &status) {
     STARTUPINFO si{};
     PROCESS_INFORMATION pi;
+    auto started = std::chrono::steady_clock::now();
     int success = CreateProcess(program_path, 
                                NULL,         
                                NULL,         
@@ -26,15 +44,170 @@ int launch_on_windows(const char *program_path, int &status) {
 
     if (success == 0) {
         status = GetLastError();
+    } else {
+        record_job_spawn(pi.dwProcessId, started);
     }
 
     return pi.dwProcessId;
 }
 
 
+int launch_with_options_on_windows(const char *program_path, const LaunchOptions &options, int &status) {
+    std::string command_line = std::string("\"") + program_path + "\"";
+    if (options.argv != nullptr && options.argv[0] != nullptr) {
+        command_line.clear();
+        for (int i = 0; options.argv[i] != nullptr; ++i) {
+            command_line += i == 0 ? "\"" : " \"";
+            command_line += options.argv[i];
+            command_line += "\"";
+        }
+    }
+
+    std::string environment;
+    if (options.envp != nullptr) {
+        for (int i = 0; options.envp[i] != nullptr; ++i) {
+            environment += options.envp[i];
+            environment += '\0';
+        }
+        environment += '\0';
+    }
+
+    STARTUPINFO si{};
+    si.cb = sizeof(si);
+    bool redirect = options.stdin_fd != -1 || options.stdout_fd != -1 || options.stderr_fd != -1;
+    if (redirect) {
+        si.dwFlags = STARTF_USESTDHANDLES;
+        si.hStdInput = options.stdin_fd != -1 ? (HANDLE)_get_osfhandle(options.stdin_fd) : GetStdHandle(STD_INPUT_HANDLE);
+        si.hStdOutput = options.stdout_fd != -1 ? (HANDLE)_get_osfhandle(options.stdout_fd) : GetStdHandle(STD_OUTPUT_HANDLE);
+        si.hStdError = options.stderr_fd != -1 ? (HANDLE)_get_osfhandle(options.stderr_fd) : GetStdHandle(STD_ERROR_HANDLE);
+    }
+
+    DWORD flags = options.cpus.empty() ? 0 : CREATE_SUSPENDED;
+    if (options.idle_priority) {
+        flags |= IDLE_PRIORITY_CLASS;
+    } else if (options.nice > 0) {
+        flags |= BELOW_NORMAL_PRIORITY_CLASS;
+    }
+
+    PROCESS_INFORMATION pi{};
+    auto started = std::chrono::steady_clock::now();
+    int success = CreateProcess(program_path,
+                               &command_line[0],
+                               NULL,
+                               NULL,
+                               redirect,
+                               flags,
+                               options.envp != nullptr ? &environment[0] : NULL,
+                               options.working_directory,
+                               &si,
+                               &pi
+    );
+
+    status = success == 0 ? GetLastError() : 0;
+    if (success != 0) {
+        if (!options.cpus.empty()) {
+            DWORD_PTR mask = 0;
+            for (int cpu : options.cpus) {
+                mask |= (DWORD_PTR)1 << cpu;
+            }
+            SetProcessAffinityMask(pi.hProcess, mask);
+            ResumeThread(pi.hThread);
+        }
+        CloseHandle(pi.hThread);
+        CloseHandle(pi.hProcess);
+        record_job_spawn(pi.dwProcessId, started);
+    }
+
+    return pi.dwProcessId;
+}
+
+#else
+int launch_with_options_on_unix(const char *program_path, const LaunchOptions &options, int &status) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (options.stdin_fd != -1) {
+        posix_spawn_file_actions_adddup2(&actions, options.stdin_fd, STDIN_FILENO);
+    }
+    if (options.stdout_fd != -1) {
+        posix_spawn_file_actions_adddup2(&actions, options.stdout_fd, STDOUT_FILENO);
+    }
+    if (options.stderr_fd != -1) {
+        posix_spawn_file_actions_adddup2(&actions, options.stderr_fd, STDERR_FILENO);
+    }
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 29)
+    if (options.working_directory != nullptr) {
+        posix_spawn_file_actions_addchdir_np(&actions, options.working_directory);
+    }
+#endif
+
+    // glibc >= 2.24 always spawns through clone(CLONE_VM | CLONE_VFORK), so the parent's
+    // page tables are never copied no matter how large it is; the flag asks older C
+    // libraries for the same vfork path.
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    short flags = 0;
+#ifdef POSIX_SPAWN_USEVFORK
+    flags |= POSIX_SPAWN_USEVFORK;
+#endif
+    bool idle_pending = options.idle_priority && !spawnlib::add_idle_policy(attributes, flags);
+    posix_spawnattr_setflags(&attributes, flags);
+
+    const char *default_argv[] = {program_path, NULL};
+    const char *const *argv = options.argv != nullptr ? options.argv : default_argv;
+    const char *const *envp = options.envp != nullptr ? options.envp : environ;
+
+#ifdef __linux__
+    if (options.cgroup != nullptr) {
+        status = spawnlib::prepare_cgroup(options.cgroup, options.cpu_max_us, options.cpu_period_us, options.memory_max_bytes);
+        if (status != 0) {
+            posix_spawnattr_destroy(&attributes);
+            posix_spawn_file_actions_destroy(&actions);
+            return -1;
+        }
+    }
+#endif
+
+    pid_t pid = -1;
+    auto started = std::chrono::steady_clock::now();
+    {
+#ifdef __linux__
+        spawnlib::ScopedSpawnAffinity affinity(options.cpus);
+#endif
+        status = posix_spawnp(
+            &pid,
+            program_path,
+            &actions,
+            &attributes,
+            (char *const *)argv,
+            (char *const *)envp);
+    }
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (status != 0) {
+        return -1;
+    }
+
+    if (idle_pending) {
+        spawnlib::set_idle_policy(pid);
+    }
+    spawnlib::adjust_nice(pid, options.nice);
+#ifdef __linux__
+    if (options.cgroup != nullptr && (status = spawnlib::move_to_cgroup(options.cgroup, pid)) != 0) {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return -1;
+    }
+#endif
+    record_job_spawn(pid, started);
+    return pid;
+}
+
+
 int launch_on_unix(const char *program_path, int &status) {
     pid_t pid;
-    char *const argv[] = {NULL};
+    char *const argv[] = {(char *)program_path, NULL};
+    auto started = std::chrono::steady_clock::now();
     status = posix_spawnp(
         &pid,
         program_path,
@@ -43,8 +216,12 @@ int launch_on_unix(const char *program_path, int &status) {
         argv,
         NULL);
 
+    if (status == 0) {
+        record_job_spawn(pid, started);
+    }
     return pid;
 }
+#endif
 
 int launch_program_with_status(const char *program_path, int &status) {
 #ifdef _WIN32
@@ -59,10 +236,20 @@ int launch_program(const char *program_path) {
     return launch_program_with_status(program_path, status);
 }
 
+int launch_program(const char *program_path, const LaunchOptions &options, int &status) {
+#ifdef _WIN32
+    return launch_with_options_on_windows(program_path, options, status);
+#else
+    return launch_with_options_on_unix(program_path, options, status);
+#endif
+}
+
 
+#ifdef _WIN32
 int await_on_windows(const int pid, int* exit_code) {
     HANDLE handle = OpenProcess(PROCESS_ALL_ACCESS, FALSE, pid);
     int status = WaitForSingleObject(handle, INFINITE);
+    take_job_wall_seconds(pid);
     if (exit_code != nullptr) {
         GetExitCodeProcess(handle, (unsigned long*)exit_code);
     }
@@ -72,9 +259,44 @@ int await_on_windows(const int pid, int* exit_code) {
 }
 
 
+static double filetime_to_seconds(const FILETIME &time) {
+    ULARGE_INTEGER value;
+    value.LowPart = time.dwLowDateTime;
+    value.HighPart = time.dwHighDateTime;
+    return value.QuadPart / 1e7;
+}
+
+int await_metrics_on_windows(const int pid, JobMetrics &metrics) {
+    HANDLE handle = OpenProcess(PROCESS_ALL_ACCESS, FALSE, pid);
+    int status = WaitForSingleObject(handle, INFINITE);
+    metrics.pid = pid;
+    metrics.wall_seconds = take_job_wall_seconds(pid);
+
+    DWORD code = 0;
+    GetExitCodeProcess(handle, &code);
+    metrics.exit_code = (int)code;
+
+    FILETIME created, exited, kernel, user;
+    if (GetProcessTimes(handle, &created, &exited, &kernel, &user)) {
+        metrics.user_seconds = filetime_to_seconds(user);
+        metrics.system_seconds = filetime_to_seconds(kernel);
+    }
+
+    PROCESS_MEMORY_COUNTERS memory{};
+    if (K32GetProcessMemoryInfo(handle, &memory, sizeof(memory))) {
+        metrics.max_rss_kb = (long)(memory.PeakWorkingSetSize / 1024);
+        metrics.minor_faults = (long)memory.PageFaultCount;
+    }
+    CloseHandle(handle);
+
+    return status;
+}
+
+#else
 int await_on_unix(const int pid, int* exit_code) {
-    int status;
+    int status = 0;
     waitpid(pid, &status, 0);
+    take_job_wall_seconds(pid);
     if (exit_code != nullptr) {
         *exit_code = WEXITSTATUS(status);
     }
@@ -82,10 +304,51 @@ int await_on_unix(const int pid, int* exit_code) {
     return WTERMSIG(status);
 }
 
+int await_metrics_on_unix(const int pid, JobMetrics &metrics) {
+    int status = 0;
+    struct rusage usage{};
+    wait4(pid, &status, 0, &usage);
+    metrics.pid = pid;
+    metrics.wall_seconds = take_job_wall_seconds(pid);
+    fill_rusage_metrics(usage, metrics);
+    if (WIFEXITED(status)) {
+        metrics.exit_code = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        metrics.signal = WTERMSIG(status);
+    }
+
+    return WTERMSIG(status);
+}
+#endif
+
 int await_program_completion(const int pid, int* exit_code) {
 #ifdef _WIN32
     return await_on_windows(pid, exit_code);
 #else
     return await_on_unix(pid, exit_code);
 #endif
+}
+
+int await_program_metrics(const int pid, JobMetrics &metrics, const char *cgroup_path) {
+#ifdef _WIN32
+    int status = await_metrics_on_windows(pid, metrics);
+#else
+    int status = await_metrics_on_unix(pid, metrics);
+#endif
+    read_cgroup_metrics(cgroup_path, metrics);
+    return status;
+}
+
+int terminate_program(const int pid, bool force) {
+#ifdef _WIN32
+    HANDLE handle = OpenProcess(PROCESS_TERMINATE, FALSE, pid);
+    if (handle == NULL) {
+        return GetLastError();
+    }
+    int status = TerminateProcess(handle, force ? 9 : 15) ? 0 : GetLastError();
+    CloseHandle(handle);
+    return status;
+#else
+    return kill(pid, force ? SIGKILL : SIGTERM) == 0 ? 0 : errno;
+#endif
 }
\ No newline at end of file
@@ -1,7 +1,49 @@
 #pragma once
 
+#include <vector>
+
+#include "job_metrics.hpp"
+
+// Extra spawn parameters for launch_program. Null / -1 members keep the default of
+// inheriting from the parent.
+struct LaunchOptions {
+    // Null-terminated argument vector; argv[0] defaults to program_path when unset.
+    const char *const *argv = nullptr;
+    // Null-terminated "NAME=value" environment of the child.
+    const char *const *envp = nullptr;
+    const char *working_directory = nullptr;
+    // Descriptors that become the child's stdin / stdout / stderr.
+    int stdin_fd = -1;
+    int stdout_fd = -1;
+    int stderr_fd = -1;
+
+    // CPUs the child may run on; empty inherits the parent's affinity.
+    std::vector<int> cpus;
+    // Added to the parent's nice value (BELOW_NORMAL_PRIORITY_CLASS on Windows when > 0).
+    int nice = 0;
+    // SCHED_IDLE on Linux, IDLE_PRIORITY_CLASS on Windows.
+    bool idle_priority = false;
+    // cgroup v2 directory for the child, relative to /sys/fs/cgroup unless absolute.
+    // Created when missing; cpu.max / memory.max are written when the limits are set.
+    // Linux only.
+    const char *cgroup = nullptr;
+    long long cpu_max_us = 0;
+    long long cpu_period_us = 100000;
+    long long memory_max_bytes = 0;
+};
+
 int launch_program(const char *program_path);
 
+int launch_program(const char *program_path, const LaunchOptions &options, int &status);
+
 int launch_program_with_status(const char *program_path, int &status);
 
-int await_program_completion(const int pid, int* exit_code = nullptr);
\ No newline at end of file
+int await_program_completion(const int pid, int* exit_code = nullptr);
+
+// Asks the program to stop (SIGTERM), or kills it outright when `force` is set
+// (SIGKILL). Windows has no graceful variant, so both terminate the process.
+int terminate_program(const int pid, bool force = false);
+
+// Like await_program_completion, but also collects the job's resource usage and wall
+// time. `cgroup_path` optionally names the cgroup v2 directory the job ran in.
+int await_program_metrics(const int pid, JobMetrics &metrics, const char *cgroup_path = nullptr);
\ No newline at end of file
@@ -0,0 +1,142 @@
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <string>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "job_metrics.hpp"
+
+static std::mutex spawn_times_mutex;
+static std::unordered_map<int, std::chrono::steady_clock::time_point> spawn_times;
+
+void record_job_spawn(int pid, std::chrono::steady_clock::time_point started) {
+    if (pid <= 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(spawn_times_mutex);
+    spawn_times[pid] = started;
+}
+
+double take_job_wall_seconds(int pid) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(spawn_times_mutex);
+    auto it = spawn_times.find(pid);
+    if (it == spawn_times.end()) {
+        return -1.0;
+    }
+    double seconds = std::chrono::duration<double>(now - it->second).count();
+    spawn_times.erase(it);
+    return seconds;
+}
+
+#ifndef _WIN32
+void fill_rusage_metrics(const struct rusage &usage, JobMetrics &metrics) {
+    metrics.user_seconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    metrics.system_seconds = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    metrics.max_rss_kb = usage.ru_maxrss;
+    metrics.minor_faults = usage.ru_minflt;
+    metrics.major_faults = usage.ru_majflt;
+    metrics.voluntary_switches = usage.ru_nvcsw;
+    metrics.involuntary_switches = usage.ru_nivcsw;
+}
+#endif
+
+void read_cgroup_metrics(const char *cgroup_path, JobMetrics &metrics) {
+    if (cgroup_path == nullptr) {
+        return;
+    }
+    std::string directory = cgroup_path[0] == '/' ? cgroup_path : std::string("/sys/fs/cgroup/") + cgroup_path;
+
+    FILE *cpu_stat = fopen((directory + "/cpu.stat").c_str(), "r");
+    if (cpu_stat != nullptr) {
+        char key[64];
+        long long value;
+        while (fscanf(cpu_stat, "%63s %lld", key, &value) == 2) {
+            if (strcmp(key, "usage_usec") == 0) {
+                metrics.cgroup_cpu_usec = value;
+                break;
+            }
+        }
+        fclose(cpu_stat);
+    }
+
+    FILE *memory_peak = fopen((directory + "/memory.peak").c_str(), "r");
+    if (memory_peak != nullptr) {
+        long long value;
+        if (fscanf(memory_peak, "%lld", &value) == 1) {
+            metrics.cgroup_memory_peak_bytes = value;
+        }
+        fclose(memory_peak);
+    }
+}
+
+void Log2Histogram::record(uint64_t value) {
+    int bucket = 0;
+    while (bucket < BUCKETS - 1 && (value >> bucket) != 0) {
+        ++bucket;
+    }
+    _buckets[bucket]++;
+    _count++;
+    _sum += value;
+    if (value > _max) {
+        _max = value;
+    }
+}
+
+uint64_t Log2Histogram::quantile(double q) const {
+    if (_count == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(q * (_count - 1)) + 1;
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < BUCKETS; ++bucket) {
+        seen += _buckets[bucket];
+        if (seen >= rank) {
+            uint64_t upper = bucket == 0 ? 0 : (1ULL << bucket) - 1;
+            return upper < _max ? upper : _max;
+        }
+    }
+    return _max;
+}
+
+void JobMetricsAggregator::record(const std::string &program, const JobMetrics &metrics) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    ProgramStats &stats = _programs[program];
+    stats.jobs++;
+    if (metrics.exit_code != 0 || metrics.signal != 0) {
+        stats.failures++;
+    }
+    if (metrics.wall_seconds >= 0) {
+        stats.wall_us.record((uint64_t)(metrics.wall_seconds * 1e6));
+    }
+    stats.cpu_us.record((uint64_t)((metrics.user_seconds + metrics.system_seconds) * 1e6));
+    stats.max_rss_kb.record((uint64_t)metrics.max_rss_kb);
+    stats.major_faults.record((uint64_t)metrics.major_faults);
+    stats.context_switches.record((uint64_t)(metrics.voluntary_switches + metrics.involuntary_switches));
+}
+
+static void report_histogram(std::ostream &out, const char *name, const Log2Histogram &histogram) {
+    out << "    " << std::left << std::setw(18) << name << std::right
+        << " p50<=" << histogram.quantile(0.5)
+        << " p90<=" << histogram.quantile(0.9)
+        << " p99<=" << histogram.quantile(0.99)
+        << " max=" << histogram.max()
+        << " total=" << histogram.sum() << "\n";
+}
+
+void JobMetricsAggregator::report(std::ostream &out) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto &entry : _programs) {
+        const ProgramStats &stats = entry.second;
+        out << entry.first << ": " << stats.jobs << " jobs, " << stats.failures << " failed\n";
+        report_histogram(out, "wall_us", stats.wall_us);
+        report_histogram(out, "cpu_us", stats.cpu_us);
+        report_histogram(out, "max_rss_kb", stats.max_rss_kb);
+        report_histogram(out, "major_faults", stats.major_faults);
+        report_histogram(out, "context_switches", stats.context_switches);
+    }
+}
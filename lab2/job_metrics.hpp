@@ -0,0 +1,85 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+// Resource usage of one finished background program.
+struct JobMetrics {
+    int pid = -1;
+    int exit_code = 0;
+    int signal = 0;
+    double wall_seconds = 0.0;      // from launch_program to the reaped exit, -1 if unknown
+    double user_seconds = 0.0;
+    double system_seconds = 0.0;
+    long max_rss_kb = 0;
+    long minor_faults = 0;
+    long major_faults = 0;
+    long voluntary_switches = 0;
+    long involuntary_switches = 0;
+    // Filled from cgroup v2 accounting when a cgroup path is given, -1 otherwise.
+    int64_t cgroup_cpu_usec = -1;
+    int64_t cgroup_memory_peak_bytes = -1;
+};
+
+#ifndef _WIN32
+struct rusage;
+
+void fill_rusage_metrics(const struct rusage &usage, JobMetrics &metrics);
+#endif
+
+// Called by the launch functions with the time taken right before the spawn, so wall
+// time covers the launch itself.
+void record_job_spawn(int pid, std::chrono::steady_clock::time_point started);
+
+// Returns the seconds elapsed since `pid` was launched and forgets it, or -1. Every path
+// that reaps a launched program calls it, so no entry outlives its process and a reused
+// pid never picks up an old start time.
+double take_job_wall_seconds(int pid);
+
+// Reads cpu.stat / memory.peak of a cgroup v2 directory (absolute, or relative to
+// /sys/fs/cgroup) into `metrics`.
+void read_cgroup_metrics(const char *cgroup_path, JobMetrics &metrics);
+
+// Power-of-two bucketed histogram; bucket i counts values in [2^(i-1), 2^i).
+class Log2Histogram {
+public:
+    static const int BUCKETS = 48;
+
+    void record(uint64_t value);
+    uint64_t count() const { return _count; }
+    uint64_t sum() const { return _sum; }
+    uint64_t max() const { return _max; }
+    // Upper bound of the bucket holding the given quantile (0..1).
+    uint64_t quantile(double q) const;
+
+private:
+    uint64_t _buckets[BUCKETS] = {};
+    uint64_t _count = 0;
+    uint64_t _sum = 0;
+    uint64_t _max = 0;
+};
+
+// Aggregates metrics of finished jobs per program so hot programs stand out.
+class JobMetricsAggregator {
+public:
+    void record(const std::string &program, const JobMetrics &metrics);
+    void report(std::ostream &out) const;
+
+private:
+    struct ProgramStats {
+        uint64_t jobs = 0;
+        uint64_t failures = 0;
+        Log2Histogram wall_us;
+        Log2Histogram cpu_us;
+        Log2Histogram max_rss_kb;
+        Log2Histogram major_faults;
+        Log2Histogram context_switches;
+    };
+
+    mutable std::mutex _mutex;
+    std::map<std::string, ProgramStats> _programs;
+};
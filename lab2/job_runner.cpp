@@ -0,0 +1,60 @@
+#include "background.hpp"
+#include "job_scheduler.hpp"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Runs every job of a job list through JobScheduler.
+// Usage: job_runner <job_list> [max_concurrency]
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <job_list> [max_concurrency]" << std::endl;
+        return 1;
+    }
+
+    std::vector<JobSpec> jobs;
+    std::string error;
+    if (!load_job_list(argv[1], jobs, error)) {
+        std::cerr << "Ошибка: " << error << std::endl;
+        return 1;
+    }
+
+    size_t max_concurrency = argc > 2 ? std::stoul(argv[2]) : 0;
+    JobScheduler scheduler(max_concurrency);
+    JobMetricsAggregator aggregator;
+    int failed = 0;
+
+    scheduler.on_result([&](const JobResult &result) {
+        bool ok = result.launched && !result.timed_out && result.metrics.exit_code == 0 && result.metrics.signal == 0;
+        if (!ok) {
+            failed++;
+        }
+        aggregator.record(result.program, result.metrics);
+        std::cout << std::fixed << std::setprecision(3)
+                  << "[" << (ok ? "OK" : "FAIL") << "] #" << result.id
+                  << " attempts=" << result.attempts
+                  << " exit=" << result.metrics.exit_code
+                  << " signal=" << result.metrics.signal
+                  << (result.timed_out ? " timed_out" : "")
+                  << " queue=" << result.queue_seconds << "s"
+                  << " run=" << result.metrics.wall_seconds << "s"
+                  << " latency=" << result.latency_seconds << "s"
+                  << " : " << result.name << std::endl;
+    });
+
+    for (auto &job : jobs) {
+        scheduler.submit(std::move(job));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<JobResult> results = scheduler.run();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "\n" << results.size() << " jobs, " << failed << " failed, "
+              << seconds << " s, " << results.size() / seconds << " jobs/s\n\n";
+    aggregator.report(std::cout);
+
+    return failed == 0 ? 0 : 2;
+}
@@ -0,0 +1,225 @@
+#include <algorithm>
+#include <fstream>
+#include <queue>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#include "background.hpp"
+#include "job_scheduler.hpp"
+#include "process_supervisor.hpp"
+
+JobScheduler::JobScheduler(size_t max_concurrency)
+    : _max_concurrency(max_concurrency) {
+    if (_max_concurrency == 0) {
+        _max_concurrency = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+int JobScheduler::submit(JobSpec spec) {
+    QueuedJob job;
+    job.id = _next_id++;
+    job.spec = std::move(spec);
+    job.submitted = Clock::now();
+    job.ready_at = job.submitted;
+    _queue.push_back(std::move(job));
+    return _queue.back().id;
+}
+
+std::vector<JobResult> JobScheduler::run() {
+    // Jobs are addressed by their position in `jobs` here; ids keep counting across
+    // runs and are only reported back in the results.
+    struct RunningJob {
+        int index = -1;
+        Clock::time_point started;
+        Clock::time_point terminate_at = Clock::time_point::max();
+        Clock::time_point kill_at = Clock::time_point::max();
+        bool terminate_sent = false;
+        bool kill_sent = false;
+    };
+
+    std::vector<QueuedJob> jobs = std::move(_queue);
+    _queue.clear();
+    std::vector<JobResult> results(jobs.size());
+
+    auto runs_before = [&jobs](int a, int b) {
+        if (jobs[a].spec.priority != jobs[b].spec.priority) {
+            return jobs[a].spec.priority < jobs[b].spec.priority;
+        }
+        return a > b;
+    };
+    std::priority_queue<int, std::vector<int>, decltype(runs_before)> ready(runs_before);
+    std::vector<int> delayed;
+    for (int index = 0; index < (int)jobs.size(); ++index) {
+        ready.push(index);
+    }
+
+    std::unordered_map<int, RunningJob> running;
+    ProcessSupervisor supervisor;
+
+    auto complete = [&](int index, const JobMetrics &metrics, bool launched, bool timed_out, Clock::time_point started) {
+        QueuedJob &job = jobs[index];
+        bool failed = !launched || timed_out || metrics.exit_code != 0 || metrics.signal != 0;
+        if (failed && job.attempts <= job.spec.max_retries) {
+            job.ready_at = Clock::now() + job.spec.retry_delay;
+            delayed.push_back(index);
+            return;
+        }
+
+        JobResult &result = results[index];
+        result.id = job.id;
+        result.name = job.spec.name;
+        result.program = job.spec.argv.empty() ? std::string() : job.spec.argv[0];
+        result.attempts = job.attempts;
+        result.launched = launched;
+        result.timed_out = timed_out;
+        result.metrics = metrics;
+        result.queue_seconds = std::chrono::duration<double>(started - job.submitted).count();
+        result.latency_seconds = std::chrono::duration<double>(Clock::now() - job.submitted).count();
+        if (_callback) {
+            _callback(result);
+        }
+    };
+
+    while (!ready.empty() || !delayed.empty() || !running.empty()) {
+        Clock::time_point now = Clock::now();
+
+        for (auto it = delayed.begin(); it != delayed.end();) {
+            if (jobs[*it].ready_at <= now) {
+                ready.push(*it);
+                it = delayed.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        while (running.size() < _max_concurrency && !ready.empty()) {
+            int index = ready.top();
+            ready.pop();
+            QueuedJob &job = jobs[index];
+            job.attempts++;
+
+            std::vector<const char *> argv;
+            for (const auto &argument : job.spec.argv) {
+                argv.push_back(argument.c_str());
+            }
+            argv.push_back(nullptr);
+            LaunchOptions options;
+            options.argv = argv.data();
+            options.cpus = job.spec.cpus;
+            options.nice = job.spec.nice;
+            options.idle_priority = job.spec.idle_priority;
+            options.cgroup = job.spec.cgroup.empty() ? nullptr : job.spec.cgroup.c_str();
+            options.cpu_max_us = job.spec.cpu_max_us;
+            options.memory_max_bytes = job.spec.memory_max_bytes;
+
+            int status = 0;
+            int pid = job.spec.argv.empty() ? -1 : launch_program(argv[0], options, status);
+            if (pid <= 0) {
+                // Report spawn failures the way a shell reports a missing command.
+                JobMetrics metrics;
+                metrics.exit_code = 127;
+                complete(index, metrics, false, false, now);
+                continue;
+            }
+
+            RunningJob entry;
+            entry.index = index;
+            entry.started = now;
+            if (job.spec.timeout.count() > 0) {
+                entry.terminate_at = now + job.spec.timeout;
+            }
+            running[pid] = entry;
+            supervisor.watch(pid);
+        }
+
+        Clock::time_point wake_at = Clock::time_point::max();
+        for (auto &entry : running) {
+            RunningJob &job = entry.second;
+            if (!job.terminate_sent && now >= job.terminate_at) {
+                supervisor.terminate(entry.first, false);
+                job.terminate_sent = true;
+                job.kill_at = now + jobs[job.index].spec.kill_grace;
+            }
+            if (job.terminate_sent && !job.kill_sent && now >= job.kill_at) {
+                supervisor.terminate(entry.first, true);
+                job.kill_sent = true;
+            }
+            if (!job.terminate_sent) {
+                wake_at = std::min(wake_at, job.terminate_at);
+            } else if (!job.kill_sent) {
+                wake_at = std::min(wake_at, job.kill_at);
+            }
+        }
+        if (running.size() < _max_concurrency) {
+            for (int index : delayed) {
+                wake_at = std::min(wake_at, jobs[index].ready_at);
+            }
+        }
+
+        if (running.empty()) {
+            if (ready.empty() && wake_at != Clock::time_point::max()) {
+                std::this_thread::sleep_until(wake_at);
+            }
+            continue;
+        }
+
+        std::chrono::milliseconds timeout(-1);
+        if (wake_at != Clock::time_point::max()) {
+            timeout = std::chrono::duration_cast<std::chrono::milliseconds>(wake_at - Clock::now()) + std::chrono::milliseconds(1);
+            timeout = std::max(timeout, std::chrono::milliseconds(0));
+        }
+
+        JobExit exit;
+        bool has_exit = supervisor.wait_any(exit, timeout);
+        while (has_exit) {
+            auto it = running.find(exit.pid);
+            if (it != running.end()) {
+                RunningJob job = it->second;
+                running.erase(it);
+                complete(job.index, exit.metrics, true, job.terminate_sent, job.started);
+            }
+            has_exit = supervisor.wait_any(exit, std::chrono::milliseconds(0));
+        }
+    }
+
+    return results;
+}
+
+bool load_job_list(const std::string &path, std::vector<JobSpec> &jobs, std::string &error) {
+    std::ifstream input(path);
+    if (!input.is_open()) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(input, line)) {
+        line_number++;
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        JobSpec spec;
+        double timeout_seconds = 0;
+        std::string argument;
+        if (!(fields >> spec.priority >> timeout_seconds >> spec.max_retries)) {
+            error = path + ":" + std::to_string(line_number) + ": expected <priority> <timeout_seconds> <retries>";
+            return false;
+        }
+        while (fields >> argument) {
+            spec.argv.push_back(argument);
+        }
+        if (spec.argv.empty()) {
+            error = path + ":" + std::to_string(line_number) + ": missing program";
+            return false;
+        }
+        spec.timeout = std::chrono::milliseconds((long long)(timeout_seconds * 1000));
+        spec.name = line.substr(first);
+        jobs.push_back(std::move(spec));
+    }
+    return true;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "job_metrics.hpp"
+
+struct JobSpec {
+    std::string name;
+    // argv[0] is the program, looked up in PATH.
+    std::vector<std::string> argv;
+    // Higher priorities start first; equal priorities start in submission order.
+    int priority = 0;
+    // Zero disables the timeout. A job that runs past it gets SIGTERM, and SIGKILL
+    // once `kill_grace` has passed as well (TerminateProcess on Windows).
+    std::chrono::milliseconds timeout{0};
+    std::chrono::milliseconds kill_grace{2000};
+    // Failed or timed-out jobs are started again up to this many times.
+    int max_retries = 0;
+    std::chrono::milliseconds retry_delay{0};
+    // Placement and limits, passed through to LaunchOptions.
+    std::vector<int> cpus;
+    int nice = 0;
+    bool idle_priority = false;
+    std::string cgroup;
+    long long cpu_max_us = 0;
+    long long memory_max_bytes = 0;
+};
+
+struct JobResult {
+    int id = -1;
+    std::string name;
+    std::string program;
+    int attempts = 0;
+    bool launched = false;
+    bool timed_out = false;
+    // Time spent queued before the final attempt started, and from submission to the end.
+    double queue_seconds = 0.0;
+    double latency_seconds = 0.0;
+    JobMetrics metrics;
+};
+
+// Runs a queue of background jobs with at most `max_concurrency` of them alive at once.
+// Jobs are spawned with launch_program and reaped through a ProcessSupervisor, so the
+// scheduling loop only wakes up on an exit or on the next timeout / retry deadline.
+class JobScheduler {
+public:
+    using ResultCallback = std::function<void(const JobResult &)>;
+
+    // Zero picks the number of hardware threads.
+    explicit JobScheduler(size_t max_concurrency = 0);
+
+    // Returns the job's id; ids keep increasing across runs.
+    int submit(JobSpec spec);
+    void on_result(ResultCallback callback) { _callback = std::move(callback); }
+
+    // Blocks until every job submitted since the last run finished for good; returns
+    // their results in submission order.
+    std::vector<JobResult> run();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct QueuedJob {
+        int id = -1;
+        JobSpec spec;
+        int attempts = 0;
+        Clock::time_point submitted;
+        Clock::time_point ready_at;
+    };
+
+    size_t _max_concurrency;
+    std::vector<QueuedJob> _queue;
+    int _next_id = 0;
+    ResultCallback _callback;
+};
+
+// Reads a job list: one job per line as
+//   <priority> <timeout_seconds> <retries> <program> [args...]
+// Arguments are split on whitespace without quoting rules. Blank lines and lines
+// starting with '#' are skipped.
+bool load_job_list(const std::string &path, std::vector<JobSpec> &jobs, std::string &error);
@@ -0,0 +1,259 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+
+#include "output_capture.hpp"
+
+#define MAX_READS_PER_EVENT 8
+
+
+OutputCollector::OutputCollector(ChunkCallback callback, size_t pipe_size)
+    : _callback(std::move(callback)), _pipe_size(pipe_size), _buffer(pipe_size) {
+    _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+}
+
+OutputCollector::~OutputCollector() {
+    while (!_streams.empty()) {
+        close_stream(_streams.begin()->first);
+    }
+    if (_epoll_fd != -1) {
+        close(_epoll_fd);
+    }
+}
+
+int OutputCollector::launch(const char *program_path, const LaunchOptions &options, int &status, int job_id) {
+    return launch_captured(program_path, options, -1, status, job_id);
+}
+
+int OutputCollector::launch_to_fd(const char *program_path, const LaunchOptions &options, int sink_fd, int &status, int job_id) {
+    return launch_captured(program_path, options, sink_fd, status, job_id);
+}
+
+bool OutputCollector::open_pipe(int fds[2]) {
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        return false;
+    }
+    // A larger pipe lets chatty jobs run ahead of the collector instead of blocking on
+    // every 64 KiB; the kernel may cap the size at /proc/sys/fs/pipe-max-size.
+    fcntl(fds[0], F_SETPIPE_SZ, (int)_pipe_size);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+int OutputCollector::launch_captured(const char *program_path, const LaunchOptions &options, int sink_fd, int &status, int job_id) {
+    int out_pipe[2];
+    int err_pipe[2];
+    if (!open_pipe(out_pipe)) {
+        status = errno;
+        return -1;
+    }
+    if (!open_pipe(err_pipe)) {
+        status = errno;
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        return -1;
+    }
+
+    LaunchOptions captured = options;
+    captured.stdout_fd = out_pipe[1];
+    captured.stderr_fd = err_pipe[1];
+    int pid = launch_program(program_path, captured, status);
+
+    close(out_pipe[1]);
+    close(err_pipe[1]);
+    if (pid <= 0) {
+        close(out_pipe[0]);
+        close(err_pipe[0]);
+        return -1;
+    }
+
+    Stream stream;
+    stream.job_id = job_id;
+    stream.pid = pid;
+    stream.sink_fd = sink_fd;
+    stream.stream = OutputStream::Stdout;
+    add_stream(out_pipe[0], stream);
+    stream.stream = OutputStream::Stderr;
+    add_stream(err_pipe[0], stream);
+    return pid;
+}
+
+void OutputCollector::add_stream(int fd, const Stream &stream) {
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    _streams[fd] = stream;
+}
+
+void OutputCollector::close_stream(int fd) {
+    auto stream = _streams.find(fd);
+    auto parked = stream == _streams.end() ? _parked.end() : _parked.find(stream->second.sink_fd);
+    if (parked != _parked.end()) {
+        auto &sources = parked->second;
+        for (auto it = sources.begin(); it != sources.end(); ++it) {
+            if (*it == fd) {
+                sources.erase(it);
+                break;
+            }
+        }
+        if (sources.empty()) {
+            epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, parked->first, nullptr);
+            _parked.erase(parked);
+        }
+    }
+    epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    _streams.erase(fd);
+}
+
+// Stops watching `fd` until its sink can take more data; a level-triggered source would
+// otherwise wake poll() over and over for input that cannot be moved anywhere.
+bool OutputCollector::wait_for_sink(int fd, Stream &stream) {
+    std::vector<int> &sources = _parked[stream.sink_fd];
+    if (sources.empty()) {
+        epoll_event event{};
+        event.events = EPOLLOUT;
+        event.data.fd = stream.sink_fd;
+        if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, stream.sink_fd, &event) != 0) {
+            // Not pollable through epoll (e.g. a regular file): wait for it right here.
+            _parked.erase(stream.sink_fd);
+            pollfd sink{stream.sink_fd, POLLOUT, 0};
+            ::poll(&sink, 1, -1);
+            return true;
+        }
+    }
+    epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    sources.push_back(fd);
+    return true;
+}
+
+void OutputCollector::resume_sources(int sink_fd) {
+    auto parked = _parked.find(sink_fd);
+    epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, sink_fd, nullptr);
+    for (int fd : parked->second) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+    _parked.erase(parked);
+}
+
+// Writes out what the read() path took from the source but the sink did not accept yet.
+// Returns false while the sink is full or once it failed (then `sink_error` is set).
+bool OutputCollector::flush_pending(Stream &stream) {
+    size_t written = 0;
+    while (written < stream.pending.size()) {
+        ssize_t result = write(stream.sink_fd, stream.pending.data() + written, stream.pending.size() - written);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            if (result < 0 && errno != EAGAIN) {
+                stream.sink_error = errno;
+            }
+            stream.pending.erase(0, written);
+            return false;
+        }
+        written += (size_t)result;
+    }
+    stream.pending.clear();
+    return true;
+}
+
+// Returns false once the stream reached end of file or its sink failed.
+bool OutputCollector::drain(int fd, Stream &stream) {
+    if (!flush_pending(stream)) {
+        return stream.sink_error == 0 && wait_for_sink(fd, stream);
+    }
+
+    for (int i = 0; i < MAX_READS_PER_EVENT; ++i) {
+        ssize_t moved;
+        if (stream.sink_fd != -1 && stream.splice_supported) {
+            moved = splice(fd, NULL, stream.sink_fd, NULL, _pipe_size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (moved < 0 && errno == EINVAL) {
+                stream.splice_supported = false;
+                continue;
+            }
+            if (moved < 0 && errno == EAGAIN) {
+                // Data still queued in the pipe means it was the sink that had no room.
+                int queued = 0;
+                if (ioctl(fd, FIONREAD, &queued) == 0 && queued > 0) {
+                    return wait_for_sink(fd, stream);
+                }
+                return true;
+            }
+            if (moved < 0 && errno != EINTR) {
+                stream.sink_error = errno;
+                return false;
+            }
+        } else {
+            moved = read(fd, _buffer.data(), _buffer.size());
+            if (moved > 0) {
+                if (stream.sink_fd != -1) {
+                    stream.pending.assign(_buffer.data(), (size_t)moved);
+                    if (!flush_pending(stream)) {
+                        return stream.sink_error == 0 && wait_for_sink(fd, stream);
+                    }
+                } else if (_callback) {
+                    OutputChunk chunk;
+                    chunk.job_id = stream.job_id;
+                    chunk.pid = stream.pid;
+                    chunk.stream = stream.stream;
+                    chunk.data = _buffer.data();
+                    chunk.size = (size_t)moved;
+                    _callback(chunk);
+                }
+            }
+        }
+
+        if (moved == 0) {
+            return false;
+        }
+        if (moved < 0) {
+            return errno == EAGAIN || errno == EINTR;
+        }
+    }
+    return true;
+}
+
+size_t OutputCollector::poll(int timeout_ms) {
+    if (_streams.empty()) {
+        return 0;
+    }
+
+    epoll_event events[64];
+    int ready = epoll_wait(_epoll_fd, events, 64, timeout_ms);
+    for (int i = 0; i < ready; ++i) {
+        int fd = events[i].data.fd;
+        if (_parked.count(fd) != 0) {
+            resume_sources(fd);
+            continue;
+        }
+        auto it = _streams.find(fd);
+        if (it == _streams.end()) {
+            continue;
+        }
+        if (!drain(fd, it->second)) {
+            if (it->second.sink_error != 0 && _callback) {
+                OutputChunk chunk;
+                chunk.job_id = it->second.job_id;
+                chunk.pid = it->second.pid;
+                chunk.stream = it->second.stream;
+                chunk.error = it->second.sink_error;
+                _callback(chunk);
+            }
+            close_stream(fd);
+        }
+    }
+    return _streams.size();
+}
+
+void OutputCollector::run_until_closed() {
+    while (poll(-1) > 0) {
+    }
+}
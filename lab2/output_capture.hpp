@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "background.hpp"
+
+enum class OutputStream {
+    Stdout,
+    Stderr
+};
+
+struct OutputChunk {
+    int job_id = 0;
+    int pid = -1;
+    OutputStream stream = OutputStream::Stdout;
+    const char *data = nullptr;
+    size_t size = 0;
+    // errno of a failed write to the stream's sink. Such a chunk carries no data and the
+    // stream is closed right after it.
+    int error = 0;
+};
+
+// Captures stdout / stderr of many background programs from one thread (Linux only).
+// Every captured stream is a pipe with an enlarged kernel buffer (F_SETPIPE_SZ) whose
+// non-blocking read end sits in an epoll set; poll() drains whatever is ready. Streams
+// launched with a sink descriptor are moved there with splice(), so the bytes never
+// enter user space; all other streams are read once into a shared buffer and handed to
+// the chunk callback, which must consume the data before returning. A stream whose sink
+// is full stops being watched until the sink becomes writable again.
+class OutputCollector {
+public:
+    using ChunkCallback = std::function<void(const OutputChunk &)>;
+
+    explicit OutputCollector(ChunkCallback callback, size_t pipe_size = 1 << 20);
+    ~OutputCollector();
+
+    OutputCollector(const OutputCollector &) = delete;
+    OutputCollector &operator=(const OutputCollector &) = delete;
+
+    // Launches a program with stdout and stderr delivered to the chunk callback.
+    int launch(const char *program_path, const LaunchOptions &options, int &status, int job_id = 0);
+
+    // Launches a program whose stdout and stderr are spliced into `sink_fd`.
+    int launch_to_fd(const char *program_path, const LaunchOptions &options, int sink_fd, int &status, int job_id = 0);
+
+    // Waits up to `timeout_ms` (-1 forever) for output and dispatches it; returns the
+    // number of streams that are still open.
+    size_t poll(int timeout_ms);
+
+    // Keeps polling until every captured stream reached end of file.
+    void run_until_closed();
+
+    size_t open_streams() const { return _streams.size(); }
+
+private:
+    struct Stream {
+        int job_id = 0;
+        int pid = -1;
+        OutputStream stream = OutputStream::Stdout;
+        int sink_fd = -1;
+        bool splice_supported = true;
+        // Bytes read for the sink that it has not accepted yet (read/write fallback).
+        std::string pending;
+        int sink_error = 0;
+    };
+
+    int launch_captured(const char *program_path, const LaunchOptions &options, int sink_fd, int &status, int job_id);
+    bool open_pipe(int fds[2]);
+    void add_stream(int fd, const Stream &stream);
+    bool drain(int fd, Stream &stream);
+    bool flush_pending(Stream &stream);
+    bool wait_for_sink(int fd, Stream &stream);
+    void resume_sources(int sink_fd);
+    void close_stream(int fd);
+
+    ChunkCallback _callback;
+    size_t _pipe_size;
+    int _epoll_fd = -1;
+    std::vector<char> _buffer;
+    std::unordered_map<int, Stream> _streams;
+    // Sinks waited on for EPOLLOUT, with the source descriptors parked behind each.
+    std::unordered_map<int, std::vector<int>> _parked;
+};
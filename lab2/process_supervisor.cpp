@@ -0,0 +1,395 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+#endif
+
+#include "process_supervisor.hpp"
+#include "pidfd.hpp"
+
+#define UNTRACKED_POLL_MS 10
+#define MAX_QUEUED_EXITS 4096
+
+#ifndef _WIN32
+static void fill_exit_status(JobExit &exit, int status) {
+    if (WIFEXITED(status)) {
+        exit.exit_code = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        exit.signal = WTERMSIG(status);
+    }
+}
+#endif
+
+
+ProcessSupervisor::ProcessSupervisor() {
+#ifdef _WIN32
+    _wake_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+#elif defined(__linux__)
+    _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    _wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = _wake_fd;
+    epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _wake_fd, &event);
+#endif
+    _thread = std::thread(&ProcessSupervisor::run, this);
+}
+
+ProcessSupervisor::~ProcessSupervisor() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    wake();
+    _thread.join();
+
+    // Jobs still running are killed and reaped here, so none is left as a zombie and
+    // every future and callback still completes.
+#ifdef _WIN32
+    std::vector<std::unique_ptr<Job>> running = std::move(_jobs);
+    for (auto &job : running) {
+        JobExit exit;
+        exit.pid = job->pid;
+        if (job->handle != NULL) {
+            TerminateProcess(job->handle, 1);
+            WaitForSingleObject(job->handle, INFINITE);
+            DWORD code = 0;
+            GetExitCodeProcess(job->handle, &code);
+            exit.exit_code = (int)code;
+            CloseHandle(job->handle);
+        }
+        finish(std::move(job), exit);
+    }
+    CloseHandle(_wake_event);
+#else
+    std::vector<std::unique_ptr<Job>> running = std::move(_untracked);
+    for (auto &entry : _jobs) {
+        running.push_back(std::move(entry.second));
+    }
+    _jobs.clear();
+    for (auto &job : running) {
+        kill(job->pid, SIGKILL);
+    }
+    for (auto &job : running) {
+        JobExit exit;
+        exit.pid = job->pid;
+        int status = 0;
+        struct rusage usage{};
+        pid_t result;
+        while ((result = wait4(job->pid, &status, 0, &usage)) == -1 && errno == EINTR) {
+        }
+        if (result == job->pid) {
+            fill_exit_status(exit, status);
+            fill_rusage_metrics(usage, exit.metrics);
+        } else {
+            exit.exit_code = -1;
+        }
+        if (job->pidfd != -1) {
+            close(job->pidfd);
+        }
+        finish(std::move(job), exit);
+    }
+    if (_epoll_fd != -1) {
+        close(_epoll_fd);
+    }
+    if (_wake_fd != -1) {
+        close(_wake_fd);
+    }
+#endif
+}
+
+std::shared_future<JobExit> ProcessSupervisor::watch(int pid, ExitCallback callback) {
+    auto job = std::make_unique<Job>();
+    job->pid = pid;
+    job->callback = std::move(callback);
+    std::shared_future<JobExit> result = job->promise.get_future().share();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _active++;
+#ifdef _WIN32
+    job->handle = OpenProcess(SYNCHRONIZE | PROCESS_QUERY_LIMITED_INFORMATION | PROCESS_TERMINATE, FALSE, pid);
+    _jobs.push_back(std::move(job));
+#else
+#ifdef __linux__
+    int pidfd = pidfdlib::open_pidfd(pid);
+    if (pidfd != -1) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = pidfd;
+        if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, pidfd, &event) == 0) {
+            job->pidfd = pidfd;
+            _jobs[pidfd] = std::move(job);
+            return result;
+        }
+        close(pidfd);
+    }
+#endif
+    _untracked.push_back(std::move(job));
+#endif
+    wake();
+    return result;
+}
+
+bool ProcessSupervisor::wait_any(JobExit &exit, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    auto ready = [this] { return !_completed.empty(); };
+    if (timeout.count() < 0) {
+        _exited.wait(lock, ready);
+    } else if (!_exited.wait_for(lock, timeout, ready)) {
+        return false;
+    }
+    exit = _completed.front();
+    _completed.pop_front();
+    return true;
+}
+
+bool ProcessSupervisor::wait_all(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    auto done = [this] { return _active == 0; };
+    if (timeout.count() < 0) {
+        _exited.wait(lock, done);
+        return true;
+    }
+    return _exited.wait_for(lock, timeout, done);
+}
+
+size_t ProcessSupervisor::active() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _active;
+}
+
+int ProcessSupervisor::terminate(int pid, bool force) {
+    std::lock_guard<std::mutex> lock(_mutex);
+#ifdef _WIN32
+    for (auto &job : _jobs) {
+        if (job->pid == pid && job->handle != NULL) {
+            return TerminateProcess(job->handle, force ? 9 : 15) ? 0 : GetLastError();
+        }
+    }
+    return ERROR_INVALID_PARAMETER;
+#else
+    int sig = force ? SIGKILL : SIGTERM;
+#ifdef __linux__
+    for (auto &entry : _jobs) {
+        if (entry.second->pid == pid) {
+            return pidfdlib::send_signal(entry.first, sig);
+        }
+    }
+#endif
+    for (auto &job : _untracked) {
+        if (job->pid == pid) {
+            return kill(pid, sig) == 0 ? 0 : errno;
+        }
+    }
+    return ESRCH;
+#endif
+}
+
+void ProcessSupervisor::wake() {
+#ifdef _WIN32
+    SetEvent(_wake_event);
+#elif defined(__linux__)
+    uint64_t one = 1;
+    ssize_t written = write(_wake_fd, &one, sizeof(one));
+    (void)written;
+#endif
+}
+
+void ProcessSupervisor::finish(std::unique_ptr<Job> job, JobExit &exit) {
+    exit.metrics.pid = exit.pid;
+    exit.metrics.exit_code = exit.exit_code;
+    exit.metrics.signal = exit.signal;
+    exit.metrics.wall_seconds = take_job_wall_seconds(exit.pid);
+    if (job->callback) {
+        job->callback(exit);
+    }
+    job->promise.set_value(exit);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_completed.size() == MAX_QUEUED_EXITS) {
+        _completed.pop_front();
+    }
+    _completed.push_back(exit);
+    _active--;
+    _exited.notify_all();
+}
+
+#ifdef _WIN32
+
+void ProcessSupervisor::run() {
+    while (true) {
+        std::vector<HANDLE> handles;
+        size_t pending = 0;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_stopping) {
+                return;
+            }
+            handles.push_back(_wake_event);
+            for (auto &job : _jobs) {
+                if (handles.size() < MAXIMUM_WAIT_OBJECTS) {
+                    handles.push_back(job->handle);
+                }
+            }
+            pending = _jobs.size();
+        }
+
+        // Jobs beyond the wait limit are picked up by the periodic sweep below.
+        DWORD timeout = pending + 1 > handles.size() ? UNTRACKED_POLL_MS : INFINITE;
+        WaitForMultipleObjects((DWORD)handles.size(), handles.data(), FALSE, timeout);
+
+        std::vector<std::unique_ptr<Job>> finished;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (auto it = _jobs.begin(); it != _jobs.end();) {
+                if ((*it)->handle == NULL || WaitForSingleObject((*it)->handle, 0) == WAIT_OBJECT_0) {
+                    finished.push_back(std::move(*it));
+                    it = _jobs.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        for (auto &job : finished) {
+            JobExit exit;
+            exit.pid = job->pid;
+            DWORD code = 0;
+            if (job->handle != NULL) {
+                GetExitCodeProcess(job->handle, &code);
+                FILETIME created, exited, kernel, user;
+                if (GetProcessTimes(job->handle, &created, &exited, &kernel, &user)) {
+                    exit.metrics.user_seconds = (((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime) / 1e7;
+                    exit.metrics.system_seconds = (((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime) / 1e7;
+                }
+                CloseHandle(job->handle);
+            }
+            exit.exit_code = (int)code;
+            finish(std::move(job), exit);
+        }
+    }
+}
+
+#else
+
+void ProcessSupervisor::poll_untracked() {
+    std::vector<std::unique_ptr<Job>> finished;
+    std::vector<JobExit> exits;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto it = _untracked.begin(); it != _untracked.end();) {
+            int status = 0;
+            struct rusage usage{};
+            pid_t result = wait4((*it)->pid, &status, WNOHANG, &usage);
+            if (result == 0) {
+                ++it;
+                continue;
+            }
+            JobExit exit;
+            exit.pid = (*it)->pid;
+            if (result == (*it)->pid) {
+                fill_exit_status(exit, status);
+                fill_rusage_metrics(usage, exit.metrics);
+            } else {
+                exit.exit_code = -1;
+            }
+            exits.push_back(exit);
+            finished.push_back(std::move(*it));
+            it = _untracked.erase(it);
+        }
+    }
+    for (size_t i = 0; i < finished.size(); ++i) {
+        finish(std::move(finished[i]), exits[i]);
+    }
+}
+
+#ifdef __linux__
+
+void ProcessSupervisor::run() {
+    epoll_event events[256];
+    while (true) {
+        int timeout = -1;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_stopping) {
+                return;
+            }
+            if (!_untracked.empty()) {
+                timeout = UNTRACKED_POLL_MS;
+            }
+        }
+
+        int ready = epoll_wait(_epoll_fd, events, 256, timeout);
+        for (int i = 0; i < ready; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == _wake_fd) {
+                uint64_t value;
+                ssize_t drained = read(_wake_fd, &value, sizeof(value));
+                (void)drained;
+                continue;
+            }
+
+            pidfdlib::PidfdExit reaped;
+            pidfdlib::ReapResult result = pidfdlib::reap_pidfd(fd, reaped);
+            if (result == pidfdlib::REAP_RUNNING) {
+                continue;
+            }
+
+            // A pidfd whose waitid failed (ECHILD: reaped elsewhere or not our child) stays
+            // readable, so it is dropped like an exited one instead of spinning epoll_wait.
+            std::unique_ptr<Job> job;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto it = _jobs.find(fd);
+                if (it == _jobs.end()) {
+                    epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+                    continue;
+                }
+                job = std::move(it->second);
+                _jobs.erase(it);
+            }
+            epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+            close(fd);
+            job->pidfd = -1;
+
+            JobExit exit;
+            exit.pid = job->pid;
+            if (result == pidfdlib::REAP_EXITED) {
+                exit.exit_code = reaped.exit_code;
+                exit.signal = reaped.signal;
+                fill_rusage_metrics(reaped.usage, exit.metrics);
+            } else {
+                exit.exit_code = -1;
+            }
+            finish(std::move(job), exit);
+        }
+
+        poll_untracked();
+    }
+}
+
+#else
+
+void ProcessSupervisor::run() {
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_stopping) {
+                return;
+            }
+        }
+        poll_untracked();
+        usleep(UNTRACKED_POLL_MS * 1000);
+    }
+}
+
+#endif
+#endif
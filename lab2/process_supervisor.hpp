@@ -0,0 +1,94 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "job_metrics.hpp"
+
+struct JobExit {
+    int pid = -1;
+    // -1 when the job could not be waited for (e.g. it was reaped outside the supervisor).
+    int exit_code = 0;
+    int signal = 0;
+    JobMetrics metrics;
+};
+
+// Watches many background programs from a single event-loop thread. On Linux every
+// job is a pidfd in an epoll set, so an exit is reported as soon as the kernel marks the
+// child as exited, without a blocking waitpid per job. Each exit completes the job's
+// future, runs its callback on the supervisor thread and is queued for wait_any().
+// Destroying the supervisor kills and reaps the jobs still running.
+class ProcessSupervisor {
+public:
+    using ExitCallback = std::function<void(const JobExit &)>;
+
+    ProcessSupervisor();
+    ~ProcessSupervisor();
+
+    ProcessSupervisor(const ProcessSupervisor &) = delete;
+    ProcessSupervisor &operator=(const ProcessSupervisor &) = delete;
+
+    // Starts supervising a child of this process returned by launch_program.
+    std::shared_future<JobExit> watch(int pid, ExitCallback callback = nullptr);
+
+    // Pops the oldest exit not yet returned by wait_any. A negative timeout waits forever.
+    // Only the latest 4096 exits are kept, so callers that rely on futures or callbacks
+    // alone do not accumulate them.
+    bool wait_any(JobExit &exit, std::chrono::milliseconds timeout = std::chrono::milliseconds(-1));
+
+    // Waits until no supervised job is running.
+    bool wait_all(std::chrono::milliseconds timeout = std::chrono::milliseconds(-1));
+
+    size_t active() const;
+
+    // Sends SIGTERM (SIGKILL when `force`, TerminateProcess on Windows) to a job that is
+    // still supervised. Returns 0, an errno / GetLastError value, or ESRCH once the job
+    // has been reaped. Unlike terminate_program(pid) this never reaches a process that
+    // reused the pid: the signal goes through the job's pidfd or handle, and untracked
+    // jobs are only reaped under the same lock.
+    int terminate(int pid, bool force);
+
+private:
+    struct Job {
+        int pid = -1;
+        std::promise<JobExit> promise;
+        ExitCallback callback;
+#ifdef _WIN32
+        void *handle = nullptr;
+#else
+        int pidfd = -1;
+#endif
+    };
+
+    void run();
+    void wake();
+    void finish(std::unique_ptr<Job> job, JobExit &exit);
+#ifndef _WIN32
+    void poll_untracked();
+#endif
+
+    mutable std::mutex _mutex;
+    std::condition_variable _exited;
+    std::deque<JobExit> _completed;
+    size_t _active = 0;
+    bool _stopping = false;
+
+#ifdef _WIN32
+    void *_wake_event = nullptr;
+    std::vector<std::unique_ptr<Job>> _jobs;
+#else
+    int _epoll_fd = -1;
+    int _wake_fd = -1;
+    std::unordered_map<int, std::unique_ptr<Job>> _jobs;
+    std::vector<std::unique_ptr<Job>> _untracked;
+#endif
+    std::thread _thread;
+};
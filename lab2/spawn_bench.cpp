@@ -0,0 +1,82 @@
+#include "background.hpp"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+// Spawn-rate benchmark: launches `count` short-lived programs one after another with
+// each spawn path while the parent holds `rss_mb` of touched memory, which is what makes
+// fork()-style spawning slow.
+//
+// Usage: spawn_bench [rss_mb] [count] [program]
+
+static double run_legacy(const char *program, int count) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        int pid = launch_program(program);
+        await_program_completion(pid);
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double run_with_options(const char *program, int count) {
+    const char *argv[] = {program, NULL};
+    LaunchOptions options;
+    options.argv = argv;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        int status = 0;
+        int pid = launch_program(program, options, status);
+        await_program_completion(pid);
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+#ifndef _WIN32
+static double run_fork_exec(const char *program, int count) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            execlp(program, program, (char *)NULL);
+            _exit(127);
+        }
+        waitpid(pid, nullptr, 0);
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+#endif
+
+static void report(const char *name, int count, double seconds) {
+    std::cout << name << ": " << count << " spawns in " << seconds << " s, "
+              << count / seconds << " spawns/s, "
+              << seconds * 1e6 / count << " us/spawn" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    size_t rss_mb = argc > 1 ? std::stoul(argv[1]) : 1024;
+    int count = argc > 2 ? std::stoi(argv[2]) : 200;
+#ifdef _WIN32
+    std::string program = argc > 3 ? argv[3] : "C:\\Windows\\System32\\hostname.exe";
+#else
+    std::string program = argc > 3 ? argv[3] : "true";
+#endif
+
+    std::vector<char> ballast(rss_mb * 1024 * 1024);
+    memset(ballast.data(), 1, ballast.size());
+    std::cout << "Parent RSS ballast: " << rss_mb << " MB, program: " << program << std::endl;
+
+    report("launch_program (legacy)", count, run_legacy(program.c_str(), count));
+    report("launch_program (options)", count, run_with_options(program.c_str(), count));
+#ifndef _WIN32
+    report("fork + exec", count, run_fork_exec(program.c_str(), count));
+#endif
+
+    return ballast[ballast.size() / 2] == 1 ? 0 : 1;
+}
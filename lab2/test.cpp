@@ -15,15 +15,17 @@ int main(int argc, char *argv[]) {
         programPath = argv[2];
     }
 
-    int processId = start_background(programPath.c_str());
+    int processId = launch_program(programPath.c_str());
     if (processId == -1) {
         std::cerr << "Ошибка: не удалось запустить программу." << std::endl;
         return 1;
     }
 
     int exitCode = 0, status = 0;
+    JobMetrics metrics;
     if (waitForCompletion) {
-        status = wait_program(processId, &exitCode);
+        status = await_program_metrics(processId, metrics);
+        exitCode = metrics.exit_code;
         if (status != 0) {
             std::cerr << "Ошибка: не удалось дождаться завершения программы." << std::endl;
             return 1;
@@ -34,5 +36,14 @@ int main(int argc, char *argv[]) {
               << ", Код завершения: " << exitCode
               << ", Статус: " << status << std::endl;
 
+    if (waitForCompletion) {
+        std::cout << "Время: " << metrics.wall_seconds << " с"
+                  << ", CPU user/sys: " << metrics.user_seconds << "/" << metrics.system_seconds << " с"
+                  << ", Max RSS: " << metrics.max_rss_kb << " КБ"
+                  << ", Page faults minor/major: " << metrics.minor_faults << "/" << metrics.major_faults
+                  << ", Context switches vol/invol: " << metrics.voluntary_switches << "/" << metrics.involuntary_switches
+                  << std::endl;
+    }
+
     return 0;
 }
\ No newline at end of file
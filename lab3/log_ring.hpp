@@ -0,0 +1,117 @@
+#ifndef LOG_RING_HPP
+#define LOG_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace memlib
+{
+    // Bounded multi-producer / single-consumer message ring meant to live inside
+    // a SharedMemory<T> segment. Producers reserve a slot with a CAS on the head
+    // and publish it through the slot sequence number, so logging never takes the
+    // segment semaphore. A single drainer collects published slots in order and
+    // hands them out as one batch. When the ring is full the message is dropped
+    // and counted instead of blocking the producer.
+    template <size_t SlotCount, size_t SlotSize>
+    class LogRing
+    {
+        static_assert(SlotCount > 1 && (SlotCount & (SlotCount - 1)) == 0, "SlotCount must be a power of two");
+        static_assert(SlotSize > 1, "SlotSize must hold at least one character");
+        static_assert(std::atomic<uint64_t>::is_always_lock_free, "LogRing requires address-free 64-bit atomics");
+
+    public:
+        LogRing()
+        {
+            for (size_t i = 0; i < SlotCount; ++i)
+            {
+                _slots[i].sequence.store(i, std::memory_order_relaxed);
+                _slots[i].length = 0;
+            }
+            _head.store(0, std::memory_order_relaxed);
+            _tail.store(0, std::memory_order_relaxed);
+            _dropped.store(0, std::memory_order_relaxed);
+        }
+
+        LogRing(const LogRing &) = delete;
+        LogRing &operator=(const LogRing &) = delete;
+
+        // Copies the message into a free slot. Messages longer than SlotSize are truncated.
+        bool push(std::string_view message)
+        {
+            uint64_t position = _head.load(std::memory_order_relaxed);
+            Slot *slot;
+            while (true)
+            {
+                slot = &_slots[position & (SlotCount - 1)];
+                uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+                int64_t difference = (int64_t)sequence - (int64_t)position;
+                if (difference == 0)
+                {
+                    if (_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+                }
+                else if (difference < 0)
+                {
+                    _dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                else
+                {
+                    position = _head.load(std::memory_order_relaxed);
+                }
+            }
+
+            size_t length = message.size() < SlotSize ? message.size() : SlotSize;
+            memcpy(slot->text, message.data(), length);
+            slot->length = (uint32_t)length;
+            slot->sequence.store(position + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Appends every published message to `batch`, one per line, and frees the slots.
+        // Must be called from a single drainer at a time.
+        size_t drain(std::string &batch, size_t max_messages = SlotCount)
+        {
+            uint64_t position = _tail.load(std::memory_order_relaxed);
+            size_t drained = 0;
+            while (drained < max_messages)
+            {
+                Slot &slot = _slots[position & (SlotCount - 1)];
+                if (slot.sequence.load(std::memory_order_acquire) != position + 1)
+                {
+                    break;
+                }
+                batch.append(slot.text, slot.length);
+                batch += '\n';
+                slot.sequence.store(position + SlotCount, std::memory_order_release);
+                ++position;
+                ++drained;
+            }
+            _tail.store(position, std::memory_order_relaxed);
+            return drained;
+        }
+
+        uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+    private:
+        struct Slot
+        {
+            std::atomic<uint64_t> sequence;
+            uint32_t length;
+            char text[SlotSize];
+        };
+
+        alignas(64) std::atomic<uint64_t> _head;
+        alignas(64) std::atomic<uint64_t> _tail;
+        alignas(64) std::atomic<uint64_t> _dropped;
+        Slot _slots[SlotCount];
+    };
+}
+
+#endif
@@ -1,15 +1,32 @@
 #include "shared_memory.hpp"
 #include "task_manager.hpp"
+#include "log_ring.hpp"
+#include "shared_arena.hpp"
+#include "timer_wheel.hpp"
 #include <iostream>
 #include <fstream>
 #include <thread>
 #include <chrono>
-#include <atomic>
+#include <functional>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <algorithm>
 #include <format>
 
 #define LOG_FILE "task_log.txt"
+#define LOG_RING_SLOTS 256
+#define LOG_RING_SLOT_SIZE 240
+#define HISTORY_ARENA_CAPACITY (16 << 20)
+#define HISTORY_ARENA_INITIAL_SIZE (64 << 10)
+#define HISTORY_SHOWN 10
+#define COUNTER_PERIOD_MS 300
+#define COUNTER_LOG_PERIOD_S 1
+#define COPY_PERIOD_S 3
+#define LOG_FLUSH_PERIOD_MS 100
+#define MAIN_ROLE_RETRY_MS 10
+
+using TaskLogRing = memlib::LogRing<LOG_RING_SLOTS, LOG_RING_SLOT_SIZE>;
 
 struct TaskData
 {
@@ -17,6 +34,7 @@ struct TaskData
     int active_copies = 0;
     int total_processes = 0;
     int main_process_id = -1;
+    TaskLogRing log_ring;
 };
 
 memlib::SharedMem<TaskData> get_shared_memory()
@@ -24,13 +42,76 @@ memlib::SharedMem<TaskData> get_shared_memory()
     return memlib::SharedMem<TaskData>("task_shared_memory");
 }
 
-template <typename T>
-void log_message(memlib::SharedMem<TaskData> &shared_memory, const T &message)
+void log_message(memlib::SharedMem<TaskData> &shared_memory, std::string_view message)
+{
+    shared_memory.data()->log_ring.push(message);
+}
+
+void drain_log(TaskData &data, std::ofstream &log, std::string &batch)
+{
+    batch.clear();
+    if (data.log_ring.drain(batch) > 0)
+    {
+        log << batch;
+        log.flush();
+    }
+}
+
+void drain_log(memlib::SharedMem<TaskData> &shared_memory, std::ofstream &log, std::string &batch)
+{
+    drain_log(*shared_memory.data(), log, batch);
+}
+
+// Copies may outlive the main program: whoever detaches last writes out their records.
+void drain_on_last_release(TaskData &data)
 {
-    shared_memory.lock();
     std::ofstream log(LOG_FILE, std::ios::app);
-    log << message << "\n";
-    shared_memory.unlock();
+    std::string batch;
+    drain_log(data, log, batch);
+}
+
+using CopyHistory = memlib::SharedVector<tasklib::ProcessExit>;
+
+// Exits of every copy started so far, shared by all main instances through the arena root.
+CopyHistory get_copy_history(memlib::SharedArena &arena)
+{
+    uint64_t root = arena.root();
+    if (root != 0)
+    {
+        return CopyHistory(arena, root);
+    }
+
+    CopyHistory history = CopyHistory::create(arena);
+    if (history.is_valid() && !arena.set_root(0, history.offset()))
+    {
+        // Another instance published its history first.
+        history.destroy();
+        return CopyHistory(arena, arena.root());
+    }
+    return history;
+}
+
+void record_copy_exit(CopyHistory &history, const tasklib::ProcessExit &exit)
+{
+    // A full arena starts the history over instead of dropping the newest exits.
+    if (!history.push_back(exit))
+    {
+        history.clear();
+        history.push_back(exit);
+    }
+}
+
+void show_copy_history(const CopyHistory &history)
+{
+    std::vector<tasklib::ProcessExit> exits = history.snapshot();
+    std::cout << std::format("Copies exited: {}\n", exits.size());
+    size_t first = exits.size() > HISTORY_SHOWN ? exits.size() - HISTORY_SHOWN : 0;
+    for (size_t i = first; i < exits.size(); ++i)
+    {
+        const tasklib::ProcessExit &exit = exits[i];
+        std::cout << std::format("  PID={} code {}, signal {}, cpu {:.3f}s, max rss {} KB\n", exit.pid, exit.exit_code,
+                                 exit.signal, exit.user_seconds + exit.system_seconds, exit.max_rss_kb);
+    }
 }
 
 bool is_any_process_running(memlib::SharedMem<TaskData> &shared_memory)
@@ -51,89 +132,71 @@ std::string get_process_id()
     return std::to_string(tasklib::get_current_process_id());
 }
 
-void wait_for_main_role(memlib::SharedMem<TaskData> &shared_memory, const std::atomic_bool &is_running)
+bool take_main_role(memlib::SharedMem<TaskData> &shared_memory)
 {
     int current_pid = tasklib::get_current_process_id();
-    auto sleep_duration = std::chrono::milliseconds(10);
-
-    do
+    shared_memory.lock();
+    if (shared_memory.data()->main_process_id == -1)
     {
-        shared_memory.lock();
-        if (shared_memory.data()->main_process_id == -1)
-        {
-            shared_memory.data()->main_process_id = current_pid;
-        }
-        shared_memory.unlock();
-        if (shared_memory.data()->main_process_id == current_pid)
-        {
-            break;
-        }
-        std::this_thread::sleep_for(sleep_duration);
-    } while (is_running);
+        shared_memory.data()->main_process_id = current_pid;
+    }
+    bool is_main = shared_memory.data()->main_process_id == current_pid;
+    shared_memory.unlock();
+    return is_main;
 }
 
-void counter_thread(memlib::SharedMem<TaskData> &shared_memory, const std::atomic_bool &is_running)
+void increment_counter(memlib::SharedMem<TaskData> &shared_memory)
 {
-    auto sleep_duration = std::chrono::milliseconds(300);
-
-    while (shared_memory.is_valid() && is_running)
-    {
-        shared_memory.lock();
-        shared_memory.data()->counter += 1;
-        shared_memory.unlock();
-        std::this_thread::sleep_for(sleep_duration);
-    }
+    shared_memory.lock();
+    shared_memory.data()->counter += 1;
+    shared_memory.unlock();
 }
 
-void copy_thread(memlib::SharedMem<TaskData> &shared_memory, const std::atomic_bool &is_running, const char *program_name)
+void log_counter(memlib::SharedMem<TaskData> &shared_memory)
 {
-    wait_for_main_role(shared_memory, is_running);
-
-    auto sleep_duration = std::chrono::seconds(3);
-
-    while (shared_memory.is_valid() && is_running)
-    {
-        shared_memory.lock();
-        if (shared_memory.data()->active_copies > 0)
-        {
-            std::string message = std::format("[{} | {}] Failed to start copies: {} copies are still running.",
-                                              get_current_time(), get_process_id(), shared_memory.data()->active_copies);
-            log_message(shared_memory, message);
-        }
-        else
-        {
-            int status = 0;
-            char *argv[] = {(char *)program_name, (char *)"1", nullptr};
-            tasklib::launch_process(2, argv, status);
-
-            argv[1] = (char *)"2";
-            tasklib::launch_process(2, argv, status);
-        }
-        shared_memory.unlock();
-        std::this_thread::sleep_for(sleep_duration);
-    }
+    shared_memory.lock();
+    int counter = shared_memory.data()->counter;
+    std::string message = std::format("[{} | {}] Counter: {}", get_current_time(), get_process_id(), counter);
+    shared_memory.unlock();
+    log_message(shared_memory, message);
 }
 
-
-void log_thread(memlib::SharedMem<TaskData> &shared_memory, const std::atomic_bool &is_running)
+void spawn_copies(memlib::SharedMem<TaskData> &shared_memory, CopyHistory &history, tasklib::ProcessGroup &copies,
+                  const tasklib::SpawnOptions &copy_options, const char *program_name)
 {
-    wait_for_main_role(shared_memory, is_running);
+    for (const auto &exit : copies.reap())
+    {
+        std::string message = std::format("[{} | {}] Copy {} exited: code {}, signal {}, cpu {:.3f}s, max rss {} KB",
+                                          get_current_time(), get_process_id(), exit.pid, exit.exit_code, exit.signal,
+                                          exit.user_seconds + exit.system_seconds, exit.max_rss_kb);
+        log_message(shared_memory, message);
+        record_copy_exit(history, exit);
+    }
 
-    auto sleep_duration = std::chrono::seconds(1);
+    shared_memory.lock();
+    int active_copies = shared_memory.data()->active_copies;
+    shared_memory.unlock();
 
-    while (shared_memory.is_valid() && is_running)
+    if (active_copies > 0 || copies.running() > 0)
     {
-        shared_memory.lock();
-        int counter = shared_memory.data()->counter;
-        std::string message = std::format("[{} | {}] Counter: {}", get_current_time(), get_process_id(), counter);
-        shared_memory.unlock();
+        std::string message = std::format("[{} | {}] Failed to start copies: {} copies are still running.",
+                                          get_current_time(), get_process_id(), std::max<size_t>(active_copies, copies.running()));
         log_message(shared_memory, message);
-        std::this_thread::sleep_for(sleep_duration);
     }
+    else
+    {
+        copies.spawn({{program_name, "1"}, {program_name, "2"}}, copy_options);
+    }
+}
 
+void release_main_role(memlib::SharedMem<TaskData> &shared_memory)
+{
     shared_memory.lock();
     if (shared_memory.data()->main_process_id == tasklib::get_current_process_id())
     {
+        std::ofstream log(LOG_FILE, std::ios::app);
+        std::string batch;
+        drain_log(shared_memory, log, batch);
         shared_memory.data()->main_process_id = -1;
     }
     shared_memory.unlock();
@@ -169,6 +232,7 @@ int main(int argc, char **argv)
         std::cerr << "Failed to initialize shared memory!" << std::endl;
         return -1;
     }
+    shared_memory.set_last_release_hook(drain_on_last_release);
 
     ProgramBehavior behavior = ProgramBehavior::MAIN;
     if (argc > 1)
@@ -189,14 +253,47 @@ int main(int argc, char **argv)
     {
         std::cout << std::format("Started {} : PID={}. Log file: {}\n", argv[0], get_process_id(), LOG_FILE);
 
-        std::vector<std::thread> threads;
-        std::atomic_bool is_running = true;
+        memlib::SharedArena arena("task_shared_arena", HISTORY_ARENA_CAPACITY, HISTORY_ARENA_INITIAL_SIZE);
+        if (!arena.is_valid())
+        {
+            std::cerr << "Failed to initialize shared arena!" << std::endl;
+            return -1;
+        }
+        CopyHistory history = get_copy_history(arena);
+
+        // Copies are background work; keep them from competing with the main program's threads.
+        tasklib::ProcessGroup copies;
+        tasklib::SpawnOptions copy_options;
+        copy_options.idle_priority = true;
+        std::ofstream log;
+        std::string log_batch;
+
+        // All periodic work shares one timer thread. Only the instance holding the main
+        // role logs, spawns copies and writes out the log ring, so those jobs start once
+        // the role is free; until then it is retried every MAIN_ROLE_RETRY_MS.
+        timerlib::Scheduler scheduler;
+        std::function<void(std::chrono::system_clock::time_point)> start_main_role_jobs =
+            [&](std::chrono::system_clock::time_point)
+        {
+            if (!take_main_role(shared_memory))
+            {
+                scheduler.after(std::chrono::milliseconds(MAIN_ROLE_RETRY_MS), start_main_role_jobs);
+                return;
+            }
+            log.open(LOG_FILE, std::ios::app);
+            scheduler.every(std::chrono::seconds(COUNTER_LOG_PERIOD_S), [&](std::chrono::system_clock::time_point)
+                            { log_counter(shared_memory); });
+            scheduler.every(std::chrono::seconds(COPY_PERIOD_S), [&](std::chrono::system_clock::time_point)
+                            { spawn_copies(shared_memory, history, copies, copy_options, argv[0]); });
+            scheduler.repeat(std::chrono::milliseconds(LOG_FLUSH_PERIOD_MS), [&](std::chrono::system_clock::time_point)
+                             { drain_log(shared_memory, log, log_batch); });
+        };
 
         shared_memory.lock();
         shared_memory.data()->total_processes++;
-        threads.emplace_back(counter_thread, std::ref(shared_memory), std::ref(is_running));
-        threads.emplace_back(log_thread, std::ref(shared_memory), std::ref(is_running));
-        threads.emplace_back(copy_thread, std::ref(shared_memory), std::ref(is_running), argv[0]);
+        scheduler.repeat(std::chrono::milliseconds(COUNTER_PERIOD_MS), [&](std::chrono::system_clock::time_point)
+                         { increment_counter(shared_memory); });
+        scheduler.after(std::chrono::milliseconds(0), start_main_role_jobs);
         shared_memory.unlock();
 
         std::string command;
@@ -223,6 +320,10 @@ int main(int argc, char **argv)
                 shared_memory.unlock();
                 std::cout << "Current counter value: " << counter << "\n";
             }
+            else if (command == "history" || command == "h")
+            {
+                show_copy_history(history);
+            }
         }
 
         std::cout << "Exiting...\n";
@@ -231,11 +332,8 @@ int main(int argc, char **argv)
         shared_memory.data()->total_processes--;
         shared_memory.unlock();
 
-        is_running = false;
-        for (auto &thread : threads)
-        {
-            thread.join();
-        }
+        scheduler.stop();
+        copies.wait_all();
 
         std::cout << "Goodbye!\n";
     }
@@ -263,5 +361,10 @@ int main(int argc, char **argv)
     std::string shutdown_message = std::format("[{} | {}] Finished {}", get_current_time(), get_process_id(), behavior_to_string(behavior));
     log_message(shared_memory, shutdown_message);
 
+    if (behavior == ProgramBehavior::MAIN)
+    {
+        release_main_role(shared_memory);
+    }
+
     return 0;
 }
\ No newline at end of file
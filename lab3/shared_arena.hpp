@@ -0,0 +1,698 @@
+#ifndef SHARED_ARENA_HPP
+#define SHARED_ARENA_HPP
+
+#include "shared_memory.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <thread>
+#include <vector>
+
+#define ARENA_MAGIC 0x414e455241524853ULL
+#define ARENA_SIZE_CLASSES 37
+#define ARENA_MIN_CLASS_SHIFT 4
+#define ARENA_OFFSET_BITS 40
+#define ARENA_OPEN_ATTEMPTS 50
+#define ARENA_OPEN_RETRY_MS 10
+
+namespace memlib
+{
+    // Process-independent reference into a SharedArena. Every process maps the arena at
+    // a different address, so shared structures store offsets and resolve them locally.
+    template <typename T>
+    struct ShmOffset
+    {
+        uint64_t value = 0;
+
+        bool is_null() const { return value == 0; }
+    };
+
+    // Growable shared-memory heap. The whole `capacity` is reserved in every process's
+    // address space up front, while the backing object only grows (ftruncate) as the
+    // bump pointer reaches the committed size, so attached processes see new memory
+    // without remapping. Freed blocks are recycled through lock-free power-of-two size
+    // class lists; the segment semaphore is only taken to grow the segment.
+    class SharedArena
+    {
+    public:
+        SharedArena(const char *name, size_t capacity, size_t initial_size = 1 << 20, bool create_if_not_exists = true)
+            : _handle(INVALID_SHM_HANDLE), _semaphore(nullptr), _header(nullptr), _capacity(0)
+        {
+            _name = (char *)malloc(strlen(name) + strlen(SHM_PREFIX) + 1);
+            strcpy(_name, SHM_PREFIX);
+            strcat(_name, name);
+
+            _sem_name = (char *)malloc(strlen(_name) + strlen(SEMAPHORE_SUFFIX) + 1);
+            strcpy(_sem_name, _name);
+            strcat(_sem_name, SEMAPHORE_SUFFIX);
+
+            size_t page_size = get_page_size();
+            capacity = round_up(capacity < page_size ? page_size : capacity, page_size);
+            initial_size = round_up(initial_size < sizeof(ArenaHeader) ? sizeof(ArenaHeader) : initial_size, page_size);
+            if (initial_size > capacity)
+            {
+                initial_size = capacity;
+            }
+
+            // Attaching and creating race with other processes doing the same: an attach can
+            // see the segment before its creator made the semaphore, and a create loses to
+            // whoever created it first. Either way the other side is about to finish, so the
+            // attach is retried a few times before giving up.
+            bool is_new = false;
+            for (int attempt = 0; attempt < ARENA_OPEN_ATTEMPTS; ++attempt)
+            {
+                if (open_arena())
+                {
+                    break;
+                }
+                close_arena();
+                if (!create_if_not_exists)
+                {
+                    break;
+                }
+                bool exists = false;
+                if (create_arena(capacity, initial_size, exists))
+                {
+                    is_new = true;
+                    break;
+                }
+                close_arena();
+                if (!exists)
+                {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(ARENA_OPEN_RETRY_MS));
+            }
+
+            if (is_new && is_valid())
+            {
+                _header->magic = ARENA_MAGIC;
+                _header->capacity = _capacity;
+                _header->committed.store(initial_size, std::memory_order_relaxed);
+                _header->top.store(round_up(sizeof(ArenaHeader), 64), std::memory_order_relaxed);
+                _header->root.store(0, std::memory_order_relaxed);
+                _header->reference_count = 0;
+                for (size_t i = 0; i < ARENA_SIZE_CLASSES; ++i)
+                {
+                    _header->free_lists[i].store(0, std::memory_order_relaxed);
+                }
+                unlock();
+            }
+
+            if (is_valid() && _header->magic == ARENA_MAGIC)
+            {
+                lock();
+                _header->reference_count++;
+                unlock();
+            }
+            else if (is_new)
+            {
+                destroy_arena();
+            }
+            else
+            {
+                close_arena();
+            }
+        }
+
+        ~SharedArena()
+        {
+            if (is_valid())
+            {
+                lock();
+                bool is_last = --_header->reference_count <= 0;
+                unlock();
+
+                if (is_last)
+                {
+                    destroy_arena();
+                }
+                else
+                {
+                    close_arena();
+                }
+            }
+            free(_name);
+            free(_sem_name);
+        }
+
+        SharedArena(const SharedArena &) = delete;
+        SharedArena &operator=(const SharedArena &) = delete;
+
+        bool is_valid() const { return _handle != INVALID_SHM_HANDLE && _semaphore != nullptr && _header != nullptr; }
+        size_t capacity() const { return _capacity; }
+        size_t committed() const { return _header->committed.load(std::memory_order_acquire); }
+        size_t used() const { return _header->top.load(std::memory_order_relaxed); }
+
+        void lock()
+        {
+#ifdef _WIN32
+            WaitForSingleObject(_semaphore, INFINITE);
+#else
+            sem_wait(_semaphore);
+#endif
+        }
+
+        void unlock()
+        {
+#ifdef _WIN32
+            ReleaseSemaphore(_semaphore, 1, nullptr);
+#else
+            sem_post(_semaphore);
+#endif
+        }
+
+        // Returns the offset of `size` bytes aligned to `alignment` (a power of two), or 0
+        // when the arena is exhausted. Blocks start 16-byte aligned, so larger alignments
+        // are paid for with padding in front of the block header.
+        uint64_t allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+        {
+            if (alignment < sizeof(BlockHeader))
+            {
+                alignment = sizeof(BlockHeader);
+            }
+            size_t padding = alignment - sizeof(BlockHeader);
+            if (size > class_size(ARENA_SIZE_CLASSES - 1) - sizeof(BlockHeader) - padding)
+            {
+                return 0;
+            }
+            size_t size_class = class_of(size + sizeof(BlockHeader) + padding);
+
+            uint64_t block = pop_free(size_class);
+            if (block == 0)
+            {
+                // Only publish the new top once the block is known to fit and to be backed,
+                // so a failed allocation leaves the arena as it was.
+                uint64_t block_size = class_size(size_class);
+                block = _header->top.load(std::memory_order_relaxed);
+                do
+                {
+                    if (block + block_size > _capacity || !ensure_committed(block + block_size))
+                    {
+                        return 0;
+                    }
+                } while (!_header->top.compare_exchange_weak(block, block + block_size, std::memory_order_relaxed));
+            }
+
+            uint64_t offset = round_up(block + sizeof(BlockHeader), alignment);
+            BlockHeader *header = resolve<BlockHeader>(offset - sizeof(BlockHeader));
+            header->size_class = size_class;
+            header->block = block;
+            return offset;
+        }
+
+        void deallocate(uint64_t offset)
+        {
+            if (offset == 0)
+            {
+                return;
+            }
+            BlockHeader *header = resolve<BlockHeader>(offset - sizeof(BlockHeader));
+            push_free(header->size_class, header->block);
+        }
+
+        template <typename T>
+        ShmOffset<T> allocate_object()
+        {
+            static_assert(std::is_trivially_destructible<T>::value, "SharedArena objects are never destroyed");
+            uint64_t offset = allocate(sizeof(T), alignof(T));
+            if (offset != 0)
+            {
+                new (resolve<T>(offset)) T();
+            }
+            return ShmOffset<T>{offset};
+        }
+
+        template <typename T>
+        T *resolve(uint64_t offset) const { return offset == 0 ? nullptr : (T *)((char *)_header + offset); }
+
+        template <typename T>
+        T *resolve(ShmOffset<T> offset) const { return resolve<T>(offset.value); }
+
+        // Well-known entry point so processes can find the first shared structure.
+        uint64_t root() const { return _header->root.load(std::memory_order_acquire); }
+        bool set_root(uint64_t expected, uint64_t desired)
+        {
+            return _header->root.compare_exchange_strong(expected, desired, std::memory_order_acq_rel);
+        }
+
+    private:
+        // Sits right before the returned offset; `block` is where the (possibly padded)
+        // block starts, which is what goes back on the free list.
+        struct BlockHeader
+        {
+            uint64_t size_class;
+            uint64_t block;
+        };
+
+        struct FreeBlock
+        {
+            uint64_t size_class;
+            uint64_t next;
+        };
+
+        struct ArenaHeader
+        {
+            uint64_t magic;
+            uint64_t capacity;
+            std::atomic<uint64_t> committed;
+            std::atomic<uint64_t> top;
+            std::atomic<uint64_t> root;
+            std::atomic<uint64_t> free_lists[ARENA_SIZE_CLASSES];
+            int reference_count;
+        };
+
+        static size_t round_up(size_t value, size_t alignment) { return (value + alignment - 1) / alignment * alignment; }
+
+        static size_t get_page_size()
+        {
+#ifdef _WIN32
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            return info.dwAllocationGranularity;
+#else
+            return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+        }
+
+        static size_t class_of(size_t size)
+        {
+            size_t size_class = 0;
+            while (class_size(size_class) < size)
+            {
+                ++size_class;
+            }
+            return size_class;
+        }
+
+        static uint64_t class_size(size_t size_class) { return 1ULL << (size_class + ARENA_MIN_CLASS_SHIFT); }
+
+        // Free list heads pack the block offset with a modification tag to rule out ABA.
+        static uint64_t head_offset(uint64_t head) { return head & ((1ULL << ARENA_OFFSET_BITS) - 1); }
+        static uint64_t head_tag(uint64_t head) { return head >> ARENA_OFFSET_BITS; }
+        static uint64_t make_head(uint64_t offset, uint64_t tag) { return (tag << ARENA_OFFSET_BITS) | offset; }
+
+        uint64_t pop_free(size_t size_class)
+        {
+            std::atomic<uint64_t> &list = _header->free_lists[size_class];
+            uint64_t head = list.load(std::memory_order_acquire);
+            while (head_offset(head) != 0)
+            {
+                uint64_t next = resolve<FreeBlock>(head_offset(head))->next;
+                if (list.compare_exchange_weak(head, make_head(next, head_tag(head) + 1), std::memory_order_acq_rel))
+                {
+                    return head_offset(head);
+                }
+            }
+            return 0;
+        }
+
+        void push_free(size_t size_class, uint64_t block)
+        {
+            std::atomic<uint64_t> &list = _header->free_lists[size_class];
+            uint64_t head = list.load(std::memory_order_relaxed);
+            do
+            {
+                resolve<FreeBlock>(block)->next = head_offset(head);
+            } while (!list.compare_exchange_weak(head, make_head(block, head_tag(head) + 1), std::memory_order_release));
+        }
+
+        bool ensure_committed(uint64_t end)
+        {
+            if (end <= _header->committed.load(std::memory_order_acquire))
+            {
+                return true;
+            }
+
+            lock();
+            uint64_t committed = _header->committed.load(std::memory_order_relaxed);
+            bool success = true;
+            if (end > committed)
+            {
+                uint64_t new_size = committed * 2;
+                while (new_size < end)
+                {
+                    new_size *= 2;
+                }
+                new_size = round_up(new_size < _capacity ? new_size : _capacity, get_page_size());
+#ifndef _WIN32
+                success = ftruncate(_handle, new_size) == 0;
+#endif
+                if (success)
+                {
+                    _header->committed.store(new_size, std::memory_order_release);
+                }
+            }
+            unlock();
+            return success;
+        }
+
+        bool open_arena()
+        {
+            _capacity = 0;
+#ifdef _WIN32
+            _handle = OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, _name);
+            if (_handle != INVALID_SHM_HANDLE)
+            {
+                _semaphore = OpenSemaphore(SEMAPHORE_ALL_ACCESS, FALSE, _sem_name);
+            }
+            if (_semaphore != nullptr)
+            {
+                lock();
+                ArenaHeader *header = (ArenaHeader *)MapViewOfFile(_handle, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(ArenaHeader));
+                if (header != nullptr)
+                {
+                    _capacity = header->capacity;
+                    UnmapViewOfFile(header);
+                }
+                unlock();
+            }
+#else
+            _handle = shm_open(_name, O_RDWR, 0644);
+            if (_handle != INVALID_SHM_HANDLE)
+            {
+                _semaphore = sem_open(_sem_name, 0);
+                if (_semaphore == SEM_FAILED)
+                {
+                    _semaphore = nullptr;
+                }
+            }
+            if (_semaphore != nullptr)
+            {
+                lock();
+                void *header = mmap(nullptr, sizeof(ArenaHeader), PROT_READ, MAP_SHARED, _handle, 0);
+                if (header != MAP_FAILED)
+                {
+                    _capacity = ((ArenaHeader *)header)->capacity;
+                    munmap(header, sizeof(ArenaHeader));
+                }
+                unlock();
+            }
+#endif
+            return _handle != INVALID_SHM_HANDLE && _semaphore != nullptr && _capacity != 0 && map_arena();
+        }
+
+        // The semaphore starts taken so attaching processes wait until the header is initialized.
+        // `exists` is set when another process created the arena first. On failure the caller
+        // closes whatever was opened; a segment created here is unlinked again.
+        bool create_arena(size_t capacity, size_t initial_size, bool &exists)
+        {
+            _capacity = capacity;
+#ifdef _WIN32
+            _handle = CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)capacity >> 32), (DWORD)capacity, _name);
+            if (_handle != INVALID_SHM_HANDLE && GetLastError() == ERROR_ALREADY_EXISTS)
+            {
+                exists = true;
+                return false;
+            }
+            if (_handle != INVALID_SHM_HANDLE)
+            {
+                _semaphore = CreateSemaphore(nullptr, 0, 1, _sem_name);
+            }
+#else
+            _handle = shm_open(_name, O_CREAT | O_EXCL | O_RDWR, 0644);
+            if (_handle == INVALID_SHM_HANDLE)
+            {
+                exists = errno == EEXIST;
+                return false;
+            }
+            if (ftruncate(_handle, initial_size) != 0)
+            {
+                shm_unlink(_name);
+                return false;
+            }
+            _semaphore = sem_open(_sem_name, O_CREAT | O_EXCL, 0644, 0);
+            if (_semaphore == SEM_FAILED)
+            {
+                _semaphore = nullptr;
+                shm_unlink(_name);
+                return false;
+            }
+#endif
+            if (_handle == INVALID_SHM_HANDLE || _semaphore == nullptr || !map_arena())
+            {
+#ifndef _WIN32
+                shm_unlink(_name);
+                sem_unlink(_sem_name);
+#endif
+                return false;
+            }
+            return true;
+        }
+
+        bool map_arena()
+        {
+#ifdef _WIN32
+            _header = (ArenaHeader *)MapViewOfFile(_handle, FILE_MAP_ALL_ACCESS, 0, 0, _capacity);
+#else
+            void *result = mmap(nullptr, _capacity, PROT_READ | PROT_WRITE, MAP_SHARED, _handle, 0);
+            _header = result == MAP_FAILED ? nullptr : (ArenaHeader *)result;
+#endif
+            return _header != nullptr;
+        }
+
+        void close_arena()
+        {
+#ifdef _WIN32
+            if (_header != nullptr)
+            {
+                UnmapViewOfFile(_header);
+            }
+            if (_handle != INVALID_SHM_HANDLE)
+            {
+                CloseHandle(_handle);
+            }
+            if (_semaphore != nullptr)
+            {
+                CloseHandle(_semaphore);
+            }
+#else
+            if (_header != nullptr)
+            {
+                munmap(_header, _capacity);
+            }
+            if (_handle != INVALID_SHM_HANDLE)
+            {
+                close(_handle);
+            }
+            if (_semaphore != nullptr)
+            {
+                sem_close(_semaphore);
+            }
+#endif
+            _header = nullptr;
+            _handle = INVALID_SHM_HANDLE;
+            _semaphore = nullptr;
+        }
+
+        void destroy_arena()
+        {
+            close_arena();
+#ifndef _WIN32
+            shm_unlink(_name);
+            sem_unlink(_sem_name);
+#endif
+        }
+
+        SHM_HANDLE _handle;
+        SHM_SEMAPHORE _semaphore;
+        ArenaHeader *_header;
+        size_t _capacity;
+        char *_name;
+        char *_sem_name;
+    };
+
+    // Variable-length array of trivially copyable values living in a SharedArena. The
+    // vector itself is only a local handle around the offset of its shared header, so any
+    // process can attach to the same vector through that offset (e.g. via the arena root).
+    // Element storage is reallocated geometrically; a spin lock in the shared header keeps
+    // readers from seeing a buffer that is being moved.
+    template <typename T>
+    class SharedVector
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "SharedVector elements must be trivially copyable");
+
+    public:
+        // Returns an invalid vector (offset 0) when the arena cannot hold the header or
+        // the initial buffer.
+        static SharedVector create(SharedArena &arena, size_t initial_capacity = 16)
+        {
+            ShmOffset<Header> header = arena.allocate_object<Header>();
+            SharedVector vector(arena, header.value);
+            if (vector.is_valid() && !vector.reserve(initial_capacity))
+            {
+                arena.deallocate(header.value);
+                vector._offset = 0;
+            }
+            return vector;
+        }
+
+        SharedVector(SharedArena &arena, uint64_t offset)
+            : _arena(&arena), _offset(offset)
+        {
+        }
+
+        // Operations on an invalid vector behave as on an empty one that cannot grow.
+        bool is_valid() const { return _offset != 0; }
+        uint64_t offset() const { return _offset; }
+
+        size_t size() const
+        {
+            if (!is_valid())
+            {
+                return 0;
+            }
+            Guard guard(header());
+            return header()->size;
+        }
+
+        bool push_back(const T &value)
+        {
+            if (!is_valid())
+            {
+                return false;
+            }
+            Guard guard(header());
+            Header *shared = header();
+            if (shared->size == shared->capacity && !grow(shared, shared->capacity ? shared->capacity * 2 : 16))
+            {
+                return false;
+            }
+            _arena->resolve<T>(shared->data)[shared->size++] = value;
+            return true;
+        }
+
+        bool get(size_t index, T &value) const
+        {
+            if (!is_valid())
+            {
+                return false;
+            }
+            Guard guard(header());
+            if (index >= header()->size)
+            {
+                return false;
+            }
+            value = _arena->resolve<T>(header()->data)[index];
+            return true;
+        }
+
+        bool set(size_t index, const T &value)
+        {
+            if (!is_valid())
+            {
+                return false;
+            }
+            Guard guard(header());
+            if (index >= header()->size)
+            {
+                return false;
+            }
+            _arena->resolve<T>(header()->data)[index] = value;
+            return true;
+        }
+
+        bool reserve(size_t capacity)
+        {
+            if (!is_valid())
+            {
+                return false;
+            }
+            Guard guard(header());
+            return capacity <= header()->capacity || grow(header(), capacity);
+        }
+
+        void clear()
+        {
+            if (!is_valid())
+            {
+                return;
+            }
+            Guard guard(header());
+            header()->size = 0;
+        }
+
+        // Frees the element buffer and the header; other handles to it become dangling.
+        void destroy()
+        {
+            if (!is_valid())
+            {
+                return;
+            }
+            _arena->deallocate(header()->data);
+            _arena->deallocate(_offset);
+            _offset = 0;
+        }
+
+        std::vector<T> snapshot() const
+        {
+            if (!is_valid())
+            {
+                return {};
+            }
+            Guard guard(header());
+            const T *data = _arena->resolve<T>(header()->data);
+            return std::vector<T>(data, data + header()->size);
+        }
+
+    private:
+        struct Header
+        {
+            std::atomic<uint32_t> busy;
+            uint64_t size;
+            uint64_t capacity;
+            uint64_t data;
+        };
+
+        class Guard
+        {
+        public:
+            explicit Guard(Header *header) : _header(header)
+            {
+                uint32_t expected = 0;
+                while (!_header->busy.compare_exchange_weak(expected, 1, std::memory_order_acquire))
+                {
+                    expected = 0;
+                    std::this_thread::yield();
+                }
+            }
+
+            ~Guard() { _header->busy.store(0, std::memory_order_release); }
+
+        private:
+            Header *_header;
+        };
+
+        Header *header() const { return _arena->resolve<Header>(_offset); }
+
+        bool grow(Header *shared, size_t capacity)
+        {
+            if (capacity > SIZE_MAX / sizeof(T))
+            {
+                return false;
+            }
+            uint64_t data = _arena->allocate(capacity * sizeof(T), alignof(T));
+            if (data == 0)
+            {
+                return false;
+            }
+            if (shared->data != 0)
+            {
+                memcpy(_arena->resolve<T>(data), _arena->resolve<T>(shared->data), shared->size * sizeof(T));
+                _arena->deallocate(shared->data);
+            }
+            shared->data = data;
+            shared->capacity = capacity;
+            return true;
+        }
+
+        SharedArena *_arena;
+        uint64_t _offset;
+    };
+}
+
+#endif
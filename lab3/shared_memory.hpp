@@ -3,6 +3,10 @@
 
 #include <cstring>
 #include <cstdlib>
+#include <cstdio>
+#include <cstddef>
+#include <cerrno>
+#include <new>
 #ifdef _WIN32
 #include <windows.h>
 #define SHM_HANDLE HANDLE
@@ -14,6 +18,10 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <semaphore.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
 #define SHM_HANDLE int
 #define INVALID_SHM_HANDLE (-1)
 #define SHM_SEMAPHORE sem_t *
@@ -21,19 +29,64 @@
 
 #define SEMAPHORE_SUFFIX "_sem"
 
+#ifndef SHM_PREFIX
+#ifdef _WIN32
+#define SHM_PREFIX "Local\\"
+#else
+#define SHM_PREFIX "/"
+#endif
+#endif
+
 namespace memlib
 {
+    // Mapping options for large segments. Everything except the defaults is Linux only
+    // and is ignored on Windows.
+    struct SharedMemoryOptions
+    {
+        // Back the segment with huge pages. With `hugetlbfs_dir` set (for example
+        // "/dev/hugepages") the segment is a named file on that hugetlbfs mount, so every
+        // process can attach to it by name; otherwise the POSIX shm segment is advised to
+        // use transparent huge pages.
+        bool huge_pages = false;
+        const char *hugetlbfs_dir = nullptr;
+        // Fault every page in right after mapping instead of on first touch.
+        bool populate = false;
+        // Pin the mapping in RAM with mlock; the mapping fails if it cannot be pinned
+        // (see RLIMIT_MEMLOCK).
+        bool lock_pages = false;
+        // Place the pages on this NUMA node (-1 keeps the default first-touch policy).
+        int numa_node = -1;
+        // Fail allocations instead of falling back to other nodes. Also makes a failed
+        // mbind fail the mapping instead of only being reported.
+        bool numa_strict = false;
+    };
+
     template <typename T>
     class SharedMemory
     {
     public:
-        SharedMemory(const char *name, bool create_if_not_exists = true)
-            : _handle(INVALID_SHM_HANDLE), _memory(nullptr), _semaphore(nullptr)
+        // Called with the segment locked by the process that drops the last reference,
+        // right before the data is destroyed and the segment unlinked.
+        using LastReleaseHook = void (*)(T &data);
+
+        SharedMemory(const char *name, bool create_if_not_exists = true, const SharedMemoryOptions &options = SharedMemoryOptions())
+            : _handle(INVALID_SHM_HANDLE), _memory(nullptr), _semaphore(nullptr), _options(options), _last_release_hook(nullptr)
         {
             _name = (char *)malloc(strlen(name) + strlen(SHM_PREFIX) + 1);
             strcpy(_name, SHM_PREFIX);
             strcat(_name, name);
 
+            _path = nullptr;
+#ifndef _WIN32
+            if (_options.huge_pages && _options.hugetlbfs_dir != nullptr)
+            {
+                _path = (char *)malloc(strlen(_options.hugetlbfs_dir) + strlen(_name) + 1);
+                strcpy(_path, _options.hugetlbfs_dir);
+                strcat(_path, _name);
+            }
+#endif
+            _size = mapping_size();
+
             _sem_name = (char *)malloc(strlen(_name) + strlen(SEMAPHORE_SUFFIX) + 1);
             strcpy(_sem_name, _name);
             strcat(_sem_name, SEMAPHORE_SUFFIX);
@@ -47,7 +100,7 @@ namespace memlib
             if (map_memory() && is_new)
             {
                 _memory->reference_count = 0;
-                _memory->data = T();
+                new (&_memory->data) T();
             }
 
             if (is_valid())
@@ -75,7 +128,18 @@ namespace memlib
             {
                 lock();
                 _memory->reference_count--;
-                if (_memory->reference_count <= 0)
+                bool is_last = _memory->reference_count <= 0;
+                if (is_last)
+                {
+                    if (_last_release_hook != nullptr)
+                    {
+                        _last_release_hook(_memory->data);
+                    }
+                    _memory->data.~T();
+                }
+                unlock();
+
+                if (is_last)
                 {
                     destroy_memory();
                 }
@@ -83,18 +147,126 @@ namespace memlib
                 {
                     close_memory();
                 }
-                unlock();
             }
             free(_name);
             free(_sem_name);
+            free(_path);
         }
 
         bool is_valid() const { return _handle != INVALID_SHM_HANDLE && _semaphore != nullptr && _memory != nullptr; }
         void lock() { lock_semaphore(); }
         void unlock() { unlock_semaphore(); }
         T *data() { return is_valid() ? &_memory->data : nullptr; }
+        size_t mapped_size() const { return _size; }
+        void set_last_release_hook(LastReleaseHook hook) { _last_release_hook = hook; }
 
     private:
+        size_t mapping_size() const
+        {
+            size_t page_size = 0;
+#ifdef _WIN32
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            page_size = info.dwAllocationGranularity;
+#else
+            page_size = (size_t)sysconf(_SC_PAGESIZE);
+            if (_options.huge_pages)
+            {
+                page_size = huge_page_size();
+            }
+#endif
+            return (sizeof(SharedMemoryData) + page_size - 1) / page_size * page_size;
+        }
+
+#ifndef _WIN32
+        static size_t huge_page_size()
+        {
+            size_t size = 2 * 1024 * 1024;
+            FILE *meminfo = fopen("/proc/meminfo", "r");
+            if (meminfo != nullptr)
+            {
+                char line[128];
+                unsigned long kilobytes = 0;
+                while (fgets(line, sizeof(line), meminfo) != nullptr)
+                {
+                    if (sscanf(line, "Hugepagesize: %lu kB", &kilobytes) == 1)
+                    {
+                        size = kilobytes * 1024;
+                        break;
+                    }
+                }
+                fclose(meminfo);
+            }
+            return size;
+        }
+
+        void report_option_failure(const char *option) const
+        {
+            fprintf(stderr, "SharedMemory %s: %s failed: %s\n", _name, option, strerror(errno));
+        }
+
+        // Every failure is reported on stderr. Failures of the options that are requests
+        // rather than hints (a strict NUMA binding, mlock) also fail the mapping.
+        bool apply_mapping_options(void *address)
+        {
+            bool is_applied = true;
+#ifdef __linux__
+            if (_options.huge_pages && _path == nullptr && madvise(address, _size, MADV_HUGEPAGE) != 0)
+            {
+                report_option_failure("madvise(MADV_HUGEPAGE)");
+            }
+            if (_options.numa_node >= 0)
+            {
+                unsigned long node_mask[16] = {};
+                size_t bits = sizeof(unsigned long) * 8;
+                long status = -1;
+                errno = EINVAL;
+                if ((size_t)_options.numa_node < sizeof(node_mask) * 8)
+                {
+                    node_mask[_options.numa_node / bits] |= 1UL << (_options.numa_node % bits);
+                    status = syscall(SYS_mbind, address, _size, _options.numa_strict ? MPOL_BIND : MPOL_PREFERRED,
+                                     node_mask, sizeof(node_mask) * 8, 0);
+                }
+                if (status != 0)
+                {
+                    report_option_failure("mbind");
+                    is_applied = is_applied && !_options.numa_strict;
+                }
+            }
+#endif
+            if (_options.populate)
+            {
+                // MAP_POPULATE would fault the pages in before mbind could place them,
+                // so prefault explicitly once the policy is set.
+#if defined(__linux__) && defined(MADV_POPULATE_WRITE)
+                if (madvise(address, _size, MADV_POPULATE_WRITE) != 0)
+#endif
+                {
+                    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+                    for (size_t offset = 0; offset < _size; offset += page_size)
+                    {
+                        __atomic_fetch_add((char *)address + offset, 0, __ATOMIC_RELAXED);
+                    }
+                }
+            }
+            if (_options.lock_pages && mlock(address, _size) != 0)
+            {
+                report_option_failure("mlock");
+                is_applied = false;
+            }
+            return is_applied;
+        }
+
+        int open_segment(int flags)
+        {
+            if (_path != nullptr)
+            {
+                return open(_path, flags, 0644);
+            }
+            return shm_open(_name, flags, 0644);
+        }
+#endif
+
         bool open_memory()
         {
 #ifdef _WIN32
@@ -104,7 +276,7 @@ namespace memlib
                 _semaphore = OpenSemaphore(SEMAPHORE_ALL_ACCESS, FALSE, _sem_name);
             }
 #else
-            _handle = shm_open(_name, O_RDWR, 0644);
+            _handle = open_segment(O_RDWR);
             if (_handle != INVALID_SHM_HANDLE)
             {
                 _semaphore = sem_open(_sem_name, 0);
@@ -120,16 +292,16 @@ namespace memlib
         bool create_memory()
         {
 #ifdef _WIN32
-            _handle = CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(SharedMemoryData), _name);
+            _handle = CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, (DWORD)_size, _name);
             if (_handle != INVALID_SHM_HANDLE)
             {
                 _semaphore = CreateSemaphore(nullptr, 1, 1, _sem_name);
             }
 #else
-            _handle = shm_open(_name, O_CREAT | O_EXCL | O_RDWR, 0644);
+            _handle = open_segment(O_CREAT | O_EXCL | O_RDWR);
             if (_handle != INVALID_SHM_HANDLE)
             {
-                ftruncate(_handle, sizeof(SharedMemoryData));
+                ftruncate(_handle, _size);
                 _semaphore = sem_open(_sem_name, O_CREAT | O_EXCL, 0644, 1);
                 if (_semaphore == SEM_FAILED)
                 {
@@ -143,13 +315,18 @@ namespace memlib
         bool map_memory()
         {
 #ifdef _WIN32
-            _memory = (SharedMemoryData *)MapViewOfFile(_handle, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SharedMemoryData));
+            _memory = (SharedMemoryData *)MapViewOfFile(_handle, FILE_MAP_ALL_ACCESS, 0, 0, _size);
 #else
-            void *result = mmap(nullptr, sizeof(SharedMemoryData), PROT_READ | PROT_WRITE, MAP_SHARED, _handle, 0);
+            void *result = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _handle, 0);
             if (result == MAP_FAILED)
             {
                 _memory = nullptr;
             }
+            else if (!apply_mapping_options(result))
+            {
+                munmap(result, _size);
+                _memory = nullptr;
+            }
             else
             {
                 _memory = (SharedMemoryData *)result;
@@ -176,7 +353,7 @@ namespace memlib
 #else
             if (_memory != nullptr)
             {
-                munmap(_memory, sizeof(SharedMemoryData));
+                munmap(_memory, _size);
             }
             if (_handle != INVALID_SHM_HANDLE)
             {
@@ -196,7 +373,14 @@ namespace memlib
         {
             close_memory();
 #ifndef _WIN32
-            shm_unlink(_name);
+            if (_path != nullptr)
+            {
+                unlink(_path);
+            }
+            else
+            {
+                shm_unlink(_name);
+            }
             sem_unlink(_sem_name);
 #endif
         }
@@ -229,7 +413,14 @@ namespace memlib
         SHM_HANDLE _handle;
         char *_name;
         char *_sem_name;
+        char *_path;
+        size_t _size;
+        SharedMemoryOptions _options;
+        LastReleaseHook _last_release_hook;
     };
+
+    template <typename T>
+    using SharedMem = SharedMemory<T>;
 }
 
 #endif 
\ No newline at end of file
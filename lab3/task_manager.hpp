@@ -5,14 +5,28 @@
 #include <windows.h>
 #else
 #include <spawn.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <cerrno>
 #include <ctime>
 #include <chrono>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 #endif
 
 #include <string>
+#include <vector>
+#include <unordered_map>
 #include <format>
 
+#include "timestamp.hpp"
+#include "pidfd.hpp"
+#include "spawn_placement.hpp"
+
 namespace tasklib
 {
     int launch_process(int argc, char **argv, int &status)
@@ -67,28 +81,449 @@ namespace tasklib
 
     std::string get_current_timestamp()
     {
+        return timelib::local_timestamp_now(true);
+    }
+
+    // Optional stdio redirection and resource limits for spawned children. Defaults keep
+    // whatever the parent has.
+    struct SpawnOptions
+    {
+        const char *stdin_path = nullptr;
+        const char *stdout_path = nullptr;
+        const char *stderr_path = nullptr;
+
+        // CPUs the child may run on; empty inherits the parent's mask.
+        std::vector<int> cpus;
+        // Added to the parent's nice value (BELOW_NORMAL_PRIORITY_CLASS on Windows when > 0).
+        int nice = 0;
+        // Runs the child under SCHED_IDLE (IDLE_PRIORITY_CLASS on Windows), so it only
+        // gets CPU time nothing else wants.
+        bool idle_priority = false;
+
+        // cgroup v2 directory to place the child in, relative to /sys/fs/cgroup unless
+        // absolute. It is created if missing; the limits below are written to it when
+        // set. Linux only.
+        const char *cgroup = nullptr;
+        long long cpu_max_us = 0;
+        long long cpu_period_us = 100000;
+        long long memory_max_bytes = 0;
+    };
+
+    struct ProcessExit
+    {
+        int pid = -1;
+        // -1 when the child could not be waited for (e.g. it was reaped elsewhere).
+        int exit_code = 0;
+        int signal = 0;
+        double user_seconds = 0.0;
+        double system_seconds = 0.0;
+        long max_rss_kb = 0;
+    };
+
+    // Spawns batches of children and reaps them without blocking the caller. On Linux
+    // every child is tracked through a pidfd registered in an epoll set, so `reap` can
+    // wait for "any child of this group" with a timeout and collect its rusage without
+    // touching unrelated children of the process. Children still running when the group
+    // is destroyed are waited for, so the group never leaves zombies behind.
+    class ProcessGroup
+    {
+    public:
+        ProcessGroup()
+        {
+#ifdef __linux__
+            _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+#endif
+        }
+
+        ~ProcessGroup()
+        {
+            wait_all();
+#ifdef __linux__
+            if (_epoll_fd != -1)
+            {
+                close(_epoll_fd);
+            }
+#endif
+        }
+
+        ProcessGroup(const ProcessGroup &) = delete;
+        ProcessGroup &operator=(const ProcessGroup &) = delete;
+
+        // Starts one child per command line; returns how many were started.
+        int spawn(const std::vector<std::vector<std::string>> &commands, const SpawnOptions &options = SpawnOptions(), std::vector<int> *pids = nullptr)
+        {
+            int started = 0;
+            for (const auto &command : commands)
+            {
+                std::vector<char *> argv;
+                for (const auto &argument : command)
+                {
+                    argv.push_back((char *)argument.c_str());
+                }
+                argv.push_back(nullptr);
+
+                int pid = spawn_one(argv.data(), options);
+                if (pid > 0)
+                {
+                    track(pid);
+                    started++;
+                    if (pids != nullptr)
+                    {
+                        pids->push_back(pid);
+                    }
+                }
+            }
+            return started;
+        }
+
+        // Starts `count` copies of the same null-terminated command line.
+        int spawn(int count, char **argv, const SpawnOptions &options = SpawnOptions())
+        {
+            int started = 0;
+            for (int i = 0; i < count; ++i)
+            {
+                int pid = spawn_one(argv, options);
+                if (pid > 0)
+                {
+                    track(pid);
+                    started++;
+                }
+            }
+            return started;
+        }
+
+        size_t running() const
+        {
 #ifdef _WIN32
-        SYSTEMTIME st;
-        GetLocalTime(&st);
+            return _children.size();
+#else
+            return _children.size() + _untracked.size();
+#endif
+        }
 
-        return std::format(
-            "{:04}-{:02}-{:02} {:02}:{:02}:{:02}.{:03}",
-            st.wYear, st.wMonth, st.wDay,
-            st.wHour, st.wMinute, st.wSecond, st.wMilliseconds
-        );
+        // Collects children that have exited, waiting up to `timeout_ms` for the first
+        // one (-1 waits indefinitely, 0 only polls).
+        std::vector<ProcessExit> reap(int timeout_ms = 0)
+        {
+            std::vector<ProcessExit> exits;
+            if (running() == 0)
+            {
+                return exits;
+            }
+#ifdef _WIN32
+            collect_finished(exits);
+            if (exits.empty() && timeout_ms != 0)
+            {
+                std::vector<HANDLE> handles;
+                for (const auto &child : _children)
+                {
+                    if (handles.size() == MAXIMUM_WAIT_OBJECTS)
+                    {
+                        break;
+                    }
+                    handles.push_back(child.first);
+                }
+                WaitForMultipleObjects((DWORD)handles.size(), handles.data(), FALSE, timeout_ms < 0 ? INFINITE : (DWORD)timeout_ms);
+                collect_finished(exits);
+            }
 #else
-        auto now = std::chrono::system_clock::now();
-        time_t t = std::chrono::system_clock::to_time_t(now);
-        tm *st = localtime(&t);
-
-        return std::format(
-            "{:04}-{:02}-{:02} {:02}:{:02}:{:02}.{:03}",
-            st->tm_year + 1900, st->tm_mon + 1, st->tm_mday,
-            st->tm_hour, st->tm_min, st->tm_sec,
-            std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000
-        );
+            collect_untracked(exits);
+#ifdef __linux__
+            if (!_children.empty())
+            {
+                epoll_event events[64];
+                int ready = epoll_wait(_epoll_fd, events, 64, exits.empty() && _untracked.empty() ? timeout_ms : 0);
+                for (int i = 0; i < ready; ++i)
+                {
+                    int pidfd = events[i].data.fd;
+                    ProcessExit exit;
+                    // A failed waitid leaves the pidfd readable; dropping it is the only way
+                    // to keep epoll from reporting it forever and wait_all() from never ending.
+                    if (reap_pidfd(pidfd, exit) != pidfdlib::REAP_RUNNING)
+                    {
+                        epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, pidfd, nullptr);
+                        close(pidfd);
+                        _children.erase(pidfd);
+                        exits.push_back(exit);
+                    }
+                }
+            }
 #endif
-    }
+            // Without pidfds there is nothing to block on, so fall back to short polls.
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+            while (exits.empty() && !_untracked.empty() && timeout_ms != 0 && (timeout_ms < 0 || std::chrono::steady_clock::now() < deadline))
+            {
+                usleep(10000);
+                collect_untracked(exits);
+            }
+#endif
+            return exits;
+        }
+
+        std::vector<ProcessExit> wait_all()
+        {
+            std::vector<ProcessExit> exits;
+            while (running() > 0)
+            {
+                std::vector<ProcessExit> reaped = reap(-1);
+                exits.insert(exits.end(), reaped.begin(), reaped.end());
+            }
+            return exits;
+        }
+
+    private:
+#ifdef _WIN32
+        int spawn_one(char **argv, const SpawnOptions &options)
+        {
+            std::string command = "";
+            for (int i = 0; argv[i] != nullptr; ++i)
+            {
+                command += std::format("{} ", argv[i]);
+            }
+
+            DWORD flags = options.cpus.empty() ? 0 : CREATE_SUSPENDED;
+            if (options.idle_priority)
+            {
+                flags |= IDLE_PRIORITY_CLASS;
+            }
+            else if (options.nice > 0)
+            {
+                flags |= BELOW_NORMAL_PRIORITY_CLASS;
+            }
+
+            STARTUPINFOA si{};
+            si.cb = sizeof(si);
+            PROCESS_INFORMATION pi{};
+            if (!CreateProcessA(nullptr, (char *)command.c_str(), nullptr, nullptr, FALSE, flags, nullptr, nullptr, &si, &pi))
+            {
+                return -1;
+            }
+            if (!options.cpus.empty())
+            {
+                DWORD_PTR mask = 0;
+                for (int cpu : options.cpus)
+                {
+                    mask |= (DWORD_PTR)1 << cpu;
+                }
+                SetProcessAffinityMask(pi.hProcess, mask);
+                ResumeThread(pi.hThread);
+            }
+            CloseHandle(pi.hThread);
+            _pending = pi.hProcess;
+            return pi.dwProcessId;
+        }
+
+        void track(int pid)
+        {
+            _children[_pending] = pid;
+        }
+
+        static double filetime_seconds(const FILETIME &time)
+        {
+            ULARGE_INTEGER value;
+            value.LowPart = time.dwLowDateTime;
+            value.HighPart = time.dwHighDateTime;
+            return value.QuadPart / 1e7;
+        }
+
+        void collect_finished(std::vector<ProcessExit> &exits)
+        {
+            for (auto it = _children.begin(); it != _children.end();)
+            {
+                if (WaitForSingleObject(it->first, 0) != WAIT_OBJECT_0)
+                {
+                    ++it;
+                    continue;
+                }
+                ProcessExit exit;
+                exit.pid = it->second;
+                DWORD code = 0;
+                GetExitCodeProcess(it->first, &code);
+                exit.exit_code = (int)code;
+                FILETIME created, exited, kernel, user;
+                if (GetProcessTimes(it->first, &created, &exited, &kernel, &user))
+                {
+                    exit.user_seconds = filetime_seconds(user);
+                    exit.system_seconds = filetime_seconds(kernel);
+                }
+                CloseHandle(it->first);
+                it = _children.erase(it);
+                exits.push_back(exit);
+            }
+        }
+
+        HANDLE _pending = nullptr;
+        std::unordered_map<HANDLE, int> _children;
+#else
+        int spawn_one(char **argv, const SpawnOptions &options)
+        {
+            posix_spawn_file_actions_t actions;
+            posix_spawn_file_actions_init(&actions);
+            if (options.stdin_path != nullptr)
+            {
+                posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, options.stdin_path, O_RDONLY, 0);
+            }
+            if (options.stdout_path != nullptr)
+            {
+                posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, options.stdout_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+            }
+            if (options.stderr_path != nullptr)
+            {
+                posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, options.stderr_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+            }
+
+            // Children must not inherit signals the parent's threads happen to block.
+            posix_spawnattr_t attributes;
+            posix_spawnattr_init(&attributes);
+            sigset_t empty_mask;
+            sigemptyset(&empty_mask);
+            posix_spawnattr_setsigmask(&attributes, &empty_mask);
+            short flags = POSIX_SPAWN_SETSIGMASK;
+            bool idle_pending = options.idle_priority && !spawnlib::add_idle_policy(attributes, flags);
+            posix_spawnattr_setflags(&attributes, flags);
+
+#ifdef __linux__
+            if (options.cgroup != nullptr &&
+                spawnlib::prepare_cgroup(options.cgroup, options.cpu_max_us, options.cpu_period_us, options.memory_max_bytes) != 0)
+            {
+                posix_spawnattr_destroy(&attributes);
+                posix_spawn_file_actions_destroy(&actions);
+                return -1;
+            }
+#endif
+
+            pid_t pid = -1;
+            int status;
+            {
+#ifdef __linux__
+                spawnlib::ScopedSpawnAffinity affinity(options.cpus);
+#endif
+                status = posix_spawnp(&pid, argv[0], &actions, &attributes, argv, environ);
+            }
+            posix_spawnattr_destroy(&attributes);
+            posix_spawn_file_actions_destroy(&actions);
+            if (status != 0)
+            {
+                return -1;
+            }
+
+            if (idle_pending)
+            {
+                spawnlib::set_idle_policy(pid);
+            }
+            spawnlib::adjust_nice(pid, options.nice);
+#ifdef __linux__
+            if (options.cgroup != nullptr && spawnlib::move_to_cgroup(options.cgroup, pid) != 0)
+            {
+                kill(pid, SIGKILL);
+                waitpid(pid, nullptr, 0);
+                return -1;
+            }
+#endif
+            return pid;
+        }
+
+        static void fill_usage(ProcessExit &exit, const rusage &usage)
+        {
+            exit.user_seconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+            exit.system_seconds = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+            exit.max_rss_kb = usage.ru_maxrss;
+        }
+
+        static void fill_status(ProcessExit &exit, int status)
+        {
+            if (WIFEXITED(status))
+            {
+                exit.exit_code = WEXITSTATUS(status);
+            }
+            else if (WIFSIGNALED(status))
+            {
+                exit.signal = WTERMSIG(status);
+            }
+        }
+
+        // Children whose pidfd could not be opened (pre-5.3 kernels) are polled with wait4.
+        void collect_untracked(std::vector<ProcessExit> &exits)
+        {
+            for (auto it = _untracked.begin(); it != _untracked.end();)
+            {
+                int status = 0;
+                rusage usage{};
+                int reaped = wait4(*it, &status, WNOHANG, &usage);
+                if (reaped == 0 || (reaped == -1 && errno == EINTR))
+                {
+                    ++it;
+                    continue;
+                }
+                ProcessExit exit;
+                exit.pid = *it;
+                if (reaped == -1)
+                {
+                    // Not (or no longer) our child: polling it again would never succeed.
+                    exit.exit_code = -1;
+                }
+                else
+                {
+                    fill_status(exit, status);
+                    fill_usage(exit, usage);
+                }
+                exits.push_back(exit);
+                it = _untracked.erase(it);
+            }
+        }
+
+#ifdef __linux__
+        void track(int pid)
+        {
+            int pidfd = pidfdlib::open_pidfd(pid);
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = pidfd;
+            if (pidfd == -1 || _epoll_fd == -1 || epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, pidfd, &event) != 0)
+            {
+                if (pidfd != -1)
+                {
+                    close(pidfd);
+                }
+                _untracked.push_back(pid);
+                return;
+            }
+            _children[pidfd] = pid;
+        }
+
+        // On REAP_FAILED `exit` reports the child with exit_code -1.
+        pidfdlib::ReapResult reap_pidfd(int pidfd, ProcessExit &exit)
+        {
+            pidfdlib::PidfdExit reaped;
+            pidfdlib::ReapResult result = pidfdlib::reap_pidfd(pidfd, reaped);
+            if (result == pidfdlib::REAP_FAILED)
+            {
+                exit.pid = _children[pidfd];
+                exit.exit_code = -1;
+                return result;
+            }
+            if (result == pidfdlib::REAP_RUNNING)
+            {
+                return result;
+            }
+            exit.pid = reaped.pid;
+            exit.exit_code = reaped.exit_code;
+            exit.signal = reaped.signal;
+            fill_usage(exit, reaped.usage);
+            return result;
+        }
+
+        int _epoll_fd = -1;
+#else
+        void track(int pid)
+        {
+            _untracked.push_back(pid);
+        }
+#endif
+        std::unordered_map<int, int> _children;
+        std::vector<int> _untracked;
+#endif
+    };
 
     int wait_for_process(int pid)
     {
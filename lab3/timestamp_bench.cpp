@@ -0,0 +1,100 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "timestamp.hpp"
+
+// Measures how many "YYYY-MM-DD HH:MM:SS.mmm" timestamps per second all threads format
+// together, for the old localtime + std::format path and for timelib.
+// Usage: timestamp_bench [threads] [seconds_per_case]
+
+std::string format_with_localtime(std::chrono::system_clock::time_point now)
+{
+    time_t t = std::chrono::system_clock::to_time_t(now);
+    tm st{};
+#ifdef _WIN32
+    localtime_s(&st, &t);
+#else
+    localtime_r(&t, &st);
+#endif
+    return std::format(
+        "{:04}-{:02}-{:02} {:02}:{:02}:{:02}.{:03}",
+        st.tm_year + 1900, st.tm_mon + 1, st.tm_mday,
+        st.tm_hour, st.tm_min, st.tm_sec,
+        std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000
+    );
+}
+
+double run_case(int threads, double seconds, const std::function<size_t()> &format_one)
+{
+    std::atomic_bool is_running = true;
+    std::atomic<unsigned long long> total = 0;
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i)
+    {
+        workers.emplace_back([&]
+        {
+            unsigned long long count = 0;
+            size_t checksum = 0;
+            while (is_running.load(std::memory_order_relaxed))
+            {
+                for (int j = 0; j < 256; ++j)
+                {
+                    checksum += format_one();
+                }
+                count += 256;
+            }
+            total += count + (checksum == 0);
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    is_running = false;
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    return total / seconds;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = argc > 1 ? std::atoi(argv[1]) : (int)std::max(1u, std::thread::hardware_concurrency());
+    double seconds = argc > 2 ? std::atof(argv[2]) : 2.0;
+
+    struct Case
+    {
+        const char *name;
+        std::function<size_t()> format_one;
+    };
+    std::vector<Case> cases = {
+        {"localtime + std::format", []
+         {
+             return format_with_localtime(std::chrono::system_clock::now()).size();
+         }},
+        {"timelib::local_timestamp_now", []
+         {
+             return timelib::local_timestamp_now(true).size();
+         }},
+        {"timelib::format_local (buffer)", []
+         {
+             char buffer[timelib::TIMESTAMP_SIZE];
+             return timelib::format_local(buffer, std::chrono::system_clock::now(), true);
+         }},
+    };
+
+    std::cout << std::format("{} threads, {:.1f}s per case\n", threads, seconds);
+    for (const auto &c : cases)
+    {
+        double rate = run_case(threads, seconds, c.format_one);
+        std::cout << std::format("{:<32} {:>10.2f} M timestamps/s\n", c.name, rate / 1e6);
+    }
+    return 0;
+}
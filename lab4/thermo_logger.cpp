@@ -6,6 +6,7 @@
 #include <thread>
 #include <vector>
 #include <iomanip>
+#include <mutex>
 
 #include <boost/asio.hpp>
 #include <boost/date_time.hpp>
@@ -19,11 +20,25 @@
 #endif
 
 #include "thermo_logger.hpp"
+#include "timestamp.hpp"
+#include "temperature_parser.hpp"
+#include "trace.hpp"
+#include "timer_wheel.hpp"
 
 using namespace std;
 using namespace boost::asio;
 
+std::vector<double> hourlyTemperatures;
+double dailyTotalTemperature = 0.0;
+int dailyTemperatureCount = 0;
+std::string COMM;
+
+// Rollups and retention run on the scheduler thread: guards the log files and the
+// accumulators above against the read loop.
+static std::mutex logMutex;
+
 void clearOldEntries(const std::string& filename, const boost::chrono::system_clock::time_point& threshold) {
+    TRACE_SPAN("log.clear");
     std::ifstream inputFile(filename);
     if (!inputFile.is_open()) {
         std::cerr << "Failed to open log file: " << filename << std::endl;
@@ -57,17 +72,22 @@ void clearOldEntries(const std::string& filename, const boost::chrono::system_cl
 }
 
 void logTemperature(double temperature, const string& filename) {
+    TRACE_SPAN("log.append");
     ofstream logfile(filename, ios::app);
     if (logfile.is_open()) {
         auto now = boost::chrono::system_clock::to_time_t(boost::chrono::system_clock::now());
-        std::tm* ptm{std::localtime(&now)};
-        logfile << "[" << std::put_time(ptm, "%Y/%m/%d %H:%M:%S") << "] " << temperature << " C\n";
+        char timestamp[timelib::TIMESTAMP_SIZE];
+        size_t length = timelib::format_local(timestamp, now, -1, '/');
+        logfile << "[";
+        logfile.write(timestamp, length);
+        logfile << "] " << temperature << " C\n";
     } else {
         cerr << "Failed to open logfile: " << filename << endl;
     }
 }
 
 void updateHourlyLog() {
+    TRACE_SPAN("rollup.hour");
     if (!hourlyTemperatures.empty()) {
         double sum = 0.0;
         for (double temp : hourlyTemperatures) {
@@ -80,6 +100,7 @@ void updateHourlyLog() {
 }
 
 void updateDailyLog() {
+    TRACE_SPAN("rollup.day");
     if (dailyTemperatureCount > 0) {
         double average = dailyTotalTemperature / dailyTemperatureCount;
         logTemperature(average, LOG_FILE_DAY);
@@ -94,6 +115,11 @@ int main(int argc, char** argv) {
         return 1;
     }
     COMM = argv[1];
+    // THERMO_TRACE=1 (or a file path) records spans; SIGUSR2 writes them as Chrome trace JSON
+    // once the next read returns.
+    if (tracelib::enable_from_env("THERMO_TRACE")) {
+        tracelib::set_thread_name("thermo_logger");
+    }
 
     io_service io;
     serial_port port(io, COMM);
@@ -128,44 +154,59 @@ int main(int argc, char** argv) {
         }
 #endif
 
-    boost::chrono::system_clock::time_point lastHourlyUpdate = boost::chrono::system_clock::now();
-    boost::chrono::system_clock::time_point lastDailyUpdate = boost::chrono::system_clock::now();
-    boost::chrono::system_clock::time_point lastMonthlyUpdate = boost::chrono::system_clock::now();
-    boost::chrono::system_clock::time_point lastYearUpdate = boost::chrono::system_clock::now();
-    boost::chrono::system_clock::time_point lastAllLogUpdate = boost::chrono::system_clock::now();
+    // Hourly and daily averages at :00 and midnight local time, retention checked once
+    // an hour for the raw log and once a day for the averages.
+    timerlib::Scheduler scheduler;
+    scheduler.every(std::chrono::hours(1), [](std::chrono::system_clock::time_point) {
+        std::lock_guard<std::mutex> lock(logMutex);
+        updateHourlyLog();
+        clearOldEntries(LOG_FILE_ALL, boost::chrono::system_clock::now() - boost::chrono::hours(24));
+    });
+    scheduler.every(std::chrono::hours(24), [](std::chrono::system_clock::time_point) {
+        std::lock_guard<std::mutex> lock(logMutex);
+        updateDailyLog();
+        clearOldEntries(LOG_FILE_HOUR, boost::chrono::system_clock::now() - boost::chrono::hours(24 * 30));
+        clearOldEntries(LOG_FILE_DAY, boost::chrono::system_clock::now() - boost::chrono::hours(24 * 365));
+    });
+
+    // Samples are '\n'-terminated; a read may end mid-line or carry several lines.
+    std::string pending;
+    std::vector<double> temperatures;
     while (true) {
+        tracelib::dump_if_requested();
         char data[256];
-        size_t bytesRead = port.read_some(buffer(data, 256));
-        cerr << "bytesRead: " << bytesRead << endl << "data: " << data << endl;
-
-        if (bytesRead > 0) {
-            double temperature = atof(data);
-            
-            logTemperature(temperature, LOG_FILE_ALL);
-            if (boost::chrono::system_clock::now() - lastAllLogUpdate > boost::chrono::hours(24)) {
-                clearOldEntries(LOG_FILE_ALL, boost::chrono::system_clock::now() - boost::chrono::hours(24));
-                lastAllLogUpdate = boost::chrono::system_clock::now();
-            }
-
-            hourlyTemperatures.push_back(temperature);
-            if (boost::chrono::system_clock::now() - lastHourlyUpdate > LOG_HOUR) {
-                updateHourlyLog();
-                lastHourlyUpdate = boost::chrono::system_clock::now();
-            }
-            if (boost::chrono::system_clock::now() - lastMonthlyUpdate > boost::chrono::hours(24 * 30)) {
-                clearOldEntries(LOG_FILE_HOUR, boost::chrono::system_clock::now() - boost::chrono::hours(24 * 30));
-                lastMonthlyUpdate = boost::chrono::system_clock::now();
-            }
+        size_t bytesRead;
+        {
+            TRACE_SPAN("serial.read");
+            bytesRead = port.read_some(buffer(data, 256));
+        }
+        cerr << "bytesRead: " << bytesRead << endl << "data: ";
+        cerr.write(data, bytesRead) << endl;
+
+        pending.append(data, bytesRead);
+        temperatures.clear();
+        parselib::BatchResult batch;
+        {
+            TRACE_SPAN("parse");
+            batch = parselib::parse_lines(pending.data(), pending.size(), temperatures);
+        }
+        pending.erase(0, batch.consumed);
+        if (batch.rejected > 0) {
+            cerr << "Rejected " << batch.rejected << " malformed samples" << endl;
+        }
+        if (pending.size() > sizeof(data)) {
+            cerr << "Dropping unterminated input" << endl;
+            pending.clear();
+        }
 
-            dailyTotalTemperature += temperature;
-            dailyTemperatureCount++;
-            if (boost::chrono::system_clock::now() - lastDailyUpdate > LOG_DAY) {
-                updateDailyLog();
-                lastDailyUpdate = boost::chrono::system_clock::now();
-            }
-            if (boost::chrono::system_clock::now() - lastYearUpdate > boost::chrono::hours(24 * 365)) {
-                clearOldEntries(LOG_FILE_HOUR, boost::chrono::system_clock::now() - boost::chrono::hours(24 * 365));
-                lastYearUpdate = boost::chrono::system_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(logMutex);
+            for (double temperature : temperatures) {
+                TRACE_SPAN("sample");
+                logTemperature(temperature, LOG_FILE_ALL);
+                hourlyTemperatures.push_back(temperature);
+                dailyTotalTemperature += temperature;
+                dailyTemperatureCount++;
             }
         }
 
@@ -9,12 +9,17 @@
 #include <cstring>
 #include <cstdlib>
 #include <iomanip>
+#include <string>
+#include "temperature_parser.hpp"
+#include "trace.hpp"
 
 #ifdef _WIN32
 #include <windows.h>
 #else
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
 #include <termios.h>
 #endif
 
@@ -56,7 +61,10 @@ double fetchTemperatureData(HANDLE serialHandle) {
     DWORD bytesRead;
     char buffer[256] = { 0 };
     if (ReadFile(serialHandle, buffer, sizeof(buffer) - 1, &bytesRead, NULL)) {
-        return std::strtod(buffer, nullptr);
+        const char *lineEnd = (const char *)std::memchr(buffer, '\n', bytesRead);
+        double value = 0.0;
+        parselib::parse_decimal(buffer, lineEnd != nullptr ? lineEnd : buffer + bytesRead, value);
+        return value;
     } else {
         std::cerr << "Ошибка чтения данных с порта." << std::endl;
         return 0.0;
@@ -80,14 +88,183 @@ int establishSerialLink(const std::string& portName) {
 }
 
 double retrieveTemperatureValue(int fd) {
+    TRACE_SPAN("serial.retrieve");
     char buffer[256];
     int readBytes = read(fd, buffer, sizeof(buffer) - 1);
     if (readBytes > 0) {
-        buffer[readBytes] = '\0'; 
-        return std::strtod(buffer, nullptr); 
+        const char *lineEnd = (const char *)std::memchr(buffer, '\n', readBytes);
+        double value = 0.0;
+        parselib::parse_decimal(buffer, lineEnd != nullptr ? lineEnd : buffer + readBytes, value);
+        return value;
     } else {
         std::cerr << "Ошибка чтения данных с порта." << std::endl;
         return 0.0;
     }
 }
-#endif
\ No newline at end of file
+#endif
+
+// Один отсчёт датчика и момент, когда его последний байт был прочитан из порта.
+struct SerialSample {
+    std::chrono::system_clock::time_point receivedAt;
+    double value;
+};
+
+// Event-driven reader for a line-oriented sensor: one reading per '\n'-terminated line.
+// Bytes are accumulated in a framing buffer, so a line split across reads is joined
+// and several lines arriving in one read are returned as separate samples. Lines that
+// parselib rejects are counted and skipped instead of turning into 0.0.
+class SerialReader {
+public:
+    static const size_t MAX_LINE_LENGTH = 256;
+
+    explicit SerialReader(const std::string &portName) {
+#ifdef _WIN32
+        handle = initializeSerialConnection(portName.c_str());
+#else
+        fd = open(portName.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+        if (fd == -1) {
+            std::cerr << "Ошибка при открытии порта: " << portName << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        // Raw mode: no line discipline editing or echo. With VMIN = 1 and VTIME = 0 the
+        // tty reports the descriptor readable as soon as one byte has arrived (a larger
+        // VMIN would delay poll until that many bytes are queued), so the time a line
+        // waits in the kernel is bounded by the poll wakeup, not by a read timer.
+        struct termios terminalOptions;
+        if (tcgetattr(fd, &terminalOptions) == 0) {
+            cfmakeraw(&terminalOptions);
+            cfsetispeed(&terminalOptions, B9600);
+            cfsetospeed(&terminalOptions, B9600);
+            terminalOptions.c_cflag |= CLOCAL | CREAD;
+            terminalOptions.c_iflag |= IGNPAR;
+            terminalOptions.c_cc[VMIN] = 1;
+            terminalOptions.c_cc[VTIME] = 0;
+            tcsetattr(fd, TCSANOW, &terminalOptions);
+        }
+#endif
+    }
+
+    ~SerialReader() {
+#ifdef _WIN32
+        CloseHandle(handle);
+#else
+        close(fd);
+#endif
+    }
+
+    SerialReader(const SerialReader &) = delete;
+    SerialReader &operator=(const SerialReader &) = delete;
+
+    // Waits up to timeoutMs (-1 waits indefinitely) for data, reads everything that is
+    // available and appends the complete lines to `samples`. Returns false once the port
+    // has failed or hung up.
+    bool readSamples(std::vector<SerialSample> &samples, int timeoutMs) {
+#ifdef _WIN32
+        COMMTIMEOUTS timeSettings = {0};
+        // MAXDWORD / MAXDWORD / constant: return as soon as any byte arrives, or after
+        // the constant timeout when nothing does.
+        timeSettings.ReadIntervalTimeout = MAXDWORD;
+        timeSettings.ReadTotalTimeoutMultiplier = MAXDWORD;
+        timeSettings.ReadTotalTimeoutConstant = timeoutMs < 0 ? MAXDWORD - 1 : (DWORD)timeoutMs;
+        SetCommTimeouts(handle, &timeSettings);
+
+        char buffer[4096];
+        DWORD bytesRead = 0;
+        TRACE_SPAN("serial.read");
+        if (!ReadFile(handle, buffer, sizeof(buffer), &bytesRead, NULL)) {
+            std::cerr << "Ошибка чтения данных с порта." << std::endl;
+            return false;
+        }
+        appendBytes(buffer, bytesRead, std::chrono::system_clock::now(), samples);
+        return true;
+#else
+        struct pollfd descriptor = {fd, POLLIN, 0};
+        int ready = poll(&descriptor, 1, timeoutMs);
+        if (ready < 0) {
+            return errno == EINTR;
+        }
+        if (ready == 0) {
+            return true;
+        }
+
+        TRACE_SPAN("serial.read");
+        char buffer[4096];
+        while (true) {
+            ssize_t readBytes = read(fd, buffer, sizeof(buffer));
+            if (readBytes > 0) {
+                appendBytes(buffer, (size_t)readBytes, std::chrono::system_clock::now(), samples);
+                continue;
+            }
+            if (readBytes < 0 && errno == EINTR) {
+                continue;
+            }
+            if (readBytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            std::cerr << "Ошибка чтения данных с порта." << std::endl;
+            return false;
+        }
+        return (descriptor.revents & (POLLERR | POLLNVAL)) == 0;
+#endif
+    }
+
+#ifdef _WIN32
+    HANDLE nativeHandle() const { return handle; }
+#else
+    int nativeHandle() const { return fd; }
+#endif
+    size_t malformedLines() const { return malformed; }
+
+private:
+    void appendBytes(const char *data, size_t size, std::chrono::system_clock::time_point receivedAt, std::vector<SerialSample> &samples) {
+        if (discarding) {
+            const char *newline = (const char *)std::memchr(data, '\n', size);
+            if (newline == nullptr) {
+                return;
+            }
+            size -= newline + 1 - data;
+            data = newline + 1;
+            discarding = false;
+        }
+
+        // Whole lines are parsed straight from the read buffer; only a trailing partial
+        // line is kept until the next read completes it.
+        const char *text = data;
+        size_t length = size;
+        if (!pending.empty()) {
+            pending.append(data, size);
+            text = pending.data();
+            length = pending.size();
+        }
+
+        TRACE_SPAN("serial.parse");
+        values.clear();
+        parselib::BatchResult batch = parselib::parse_lines(text, length, values);
+        malformed += batch.rejected;
+        for (double value : values) {
+            SerialSample sample = { receivedAt, value };
+            samples.push_back(sample);
+        }
+
+        if (text == pending.data()) {
+            pending.erase(0, batch.consumed);
+        } else {
+            pending.assign(data + batch.consumed, size - batch.consumed);
+        }
+        if (pending.size() > MAX_LINE_LENGTH) {
+            malformed++;
+            pending.clear();
+            discarding = true;
+        }
+    }
+
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    int fd;
+#endif
+    std::string pending;
+    std::vector<double> values;
+    bool discarding = false;
+    size_t malformed = 0;
+};
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <string>
+#include <cctype>
+#include <cstdlib>
+#include <zlib.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// Сжатие ответов server: выбор кодировки по Accept-Encoding и потоковый компрессор,
+// который можно кормить кусками и сразу отправлять выход (например, чанками HTTP/1.1).
+// gzip есть всегда (zlib), zstd — если сборка нашла libzstd (HAVE_ZSTD).
+
+enum ContentEncoding {
+    ENCODING_IDENTITY,
+    ENCODING_GZIP,
+    ENCODING_ZSTD,
+    ENCODING_COUNT
+};
+
+// Меньше этого сжимать невыгодно: заголовок gzip и лишняя работа съедят выигрыш.
+const size_t MIN_COMPRESSED_BODY_SIZE = 512;
+
+inline const char *encodingName(ContentEncoding encoding) {
+    switch (encoding) {
+    case ENCODING_GZIP: return "gzip";
+    case ENCODING_ZSTD: return "zstd";
+    default: return "identity";
+    }
+}
+
+inline bool isEncodingSupported(ContentEncoding encoding) {
+#ifdef HAVE_ZSTD
+    return true;
+#else
+    return encoding != ENCODING_ZSTD;
+#endif
+}
+
+// Разбирает "gzip;q=0.8, zstd, *;q=0" и выбирает поддерживаемую кодировку с наибольшим
+// q; при равных q zstd предпочтительнее gzip. Несжатый ответ — только если клиент не
+// принимает ни одну из них.
+inline ContentEncoding negotiateEncoding(const std::string &acceptEncoding) {
+    double quality[ENCODING_COUNT] = { 0.0, 0.0, 0.0 };
+    bool isListed[ENCODING_COUNT] = { false, false, false };
+    double wildcard = -1.0;
+    size_t begin = 0;
+    while (begin < acceptEncoding.size()) {
+        size_t end = acceptEncoding.find(',', begin);
+        if (end == std::string::npos) {
+            end = acceptEncoding.size();
+        }
+        std::string item = acceptEncoding.substr(begin, end - begin);
+        begin = end + 1;
+
+        double q = 1.0;
+        size_t parameters = item.find(';');
+        if (parameters != std::string::npos) {
+            size_t qPos = item.find("q=", parameters);
+            if (qPos != std::string::npos) {
+                q = std::atof(item.c_str() + qPos + 2);
+            }
+            item.erase(parameters);
+        }
+        size_t first = item.find_first_not_of(" \t");
+        size_t last = item.find_last_not_of(" \t");
+        if (first == std::string::npos) {
+            continue;
+        }
+        item = item.substr(first, last - first + 1);
+        for (char &c : item) {
+            c = (char)std::tolower((unsigned char)c);
+        }
+
+        ContentEncoding encoding;
+        if (item == "gzip" || item == "x-gzip") {
+            encoding = ENCODING_GZIP;
+        } else if (item == "zstd") {
+            encoding = ENCODING_ZSTD;
+        } else if (item == "identity") {
+            encoding = ENCODING_IDENTITY;
+        } else if (item == "*") {
+            wildcard = q;
+            continue;
+        } else {
+            continue;
+        }
+        quality[encoding] = q;
+        isListed[encoding] = true;
+    }
+    if (wildcard >= 0.0) {
+        for (int i = 0; i < ENCODING_COUNT; ++i) {
+            if (!isListed[i]) {
+                quality[i] = wildcard;
+            }
+        }
+    }
+
+    ContentEncoding best = ENCODING_IDENTITY;
+    const ContentEncoding preference[] = { ENCODING_ZSTD, ENCODING_GZIP };
+    for (ContentEncoding encoding : preference) {
+        if (isEncodingSupported(encoding) && quality[encoding] > 0.0 &&
+            (best == ENCODING_IDENTITY || quality[encoding] > quality[best])) {
+            best = encoding;
+        }
+    }
+    return best;
+}
+
+// Потоковый компрессор: write дописывает в `out` то, что уже готово, finish — остаток.
+class StreamCompressor {
+public:
+    // level: 1..9 для gzip, 1..19 для zstd.
+    StreamCompressor(ContentEncoding encoding, int level) : encoding(encoding) {
+        if (encoding == ENCODING_GZIP) {
+            deflateStream.zalloc = Z_NULL;
+            deflateStream.zfree = Z_NULL;
+            deflateStream.opaque = Z_NULL;
+            // 15 + 16: окно 32 КиБ и заголовок gzip вместо zlib.
+            deflateInit2(&deflateStream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+        }
+#ifdef HAVE_ZSTD
+        if (encoding == ENCODING_ZSTD) {
+            zstdStream = ZSTD_createCCtx();
+            ZSTD_CCtx_setParameter(zstdStream, ZSTD_c_compressionLevel, level);
+        }
+#endif
+    }
+
+    ~StreamCompressor() {
+        if (encoding == ENCODING_GZIP) {
+            deflateEnd(&deflateStream);
+        }
+#ifdef HAVE_ZSTD
+        if (encoding == ENCODING_ZSTD) {
+            ZSTD_freeCCtx(zstdStream);
+        }
+#endif
+    }
+
+    StreamCompressor(const StreamCompressor &) = delete;
+    StreamCompressor &operator=(const StreamCompressor &) = delete;
+
+    void write(const char *data, size_t size, std::string &out) {
+        compress(data, size, false, out);
+    }
+
+    void finish(std::string &out) {
+        compress(nullptr, 0, true, out);
+    }
+
+private:
+    void compress(const char *data, size_t size, bool isLast, std::string &out) {
+        char buffer[16384];
+        if (encoding == ENCODING_GZIP) {
+            deflateStream.next_in = (Bytef *)data;
+            deflateStream.avail_in = (uInt)size;
+            int status;
+            do {
+                deflateStream.next_out = (Bytef *)buffer;
+                deflateStream.avail_out = sizeof(buffer);
+                status = deflate(&deflateStream, isLast ? Z_FINISH : Z_NO_FLUSH);
+                out.append(buffer, sizeof(buffer) - deflateStream.avail_out);
+            } while (deflateStream.avail_out == 0 || (isLast && status == Z_OK));
+        }
+#ifdef HAVE_ZSTD
+        if (encoding == ENCODING_ZSTD) {
+            ZSTD_inBuffer input = { data, size, 0 };
+            size_t remaining;
+            do {
+                ZSTD_outBuffer output = { buffer, sizeof(buffer), 0 };
+                remaining = ZSTD_compressStream2(zstdStream, &output, &input, isLast ? ZSTD_e_end : ZSTD_e_continue);
+                out.append(buffer, output.pos);
+                if (ZSTD_isError(remaining)) {
+                    break;
+                }
+            } while (isLast ? remaining != 0 : input.pos < input.size);
+        }
+#endif
+        if (encoding == ENCODING_IDENTITY && data != nullptr) {
+            out.append(data, size);
+        }
+    }
+
+    ContentEncoding encoding;
+    z_stream deflateStream;
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx *zstdStream = nullptr;
+#endif
+};
+
+inline std::string compressBody(ContentEncoding encoding, int level, const std::string &body) {
+    std::string compressed;
+    compressed.reserve(body.size() / 4);
+    StreamCompressor compressor(encoding, level);
+    compressor.write(body.data(), body.size(), compressed);
+    compressor.finish(compressed);
+    return compressed;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include "temperature_parser.hpp"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+// main сообщает server о каждой записанной в базу строке одной UDP-датаграммой на
+// 127.0.0.1, чтобы server мог разослать её подписчикам /stream, не опрашивая базу.
+// Формат датаграммы: "<id>\t<timestamp>\t<temperature>" — те же значения, что в таблице
+// TemperatureLogs, температура в том же текстовом виде, что и в JSON ответах server.
+const int DEFAULT_INGEST_EVENT_PORT = 8081;
+const size_t MAX_INGEST_EVENT_SIZE = 256;
+
+struct IngestEvent {
+    long long id;
+    std::string timestamp;
+    std::string temperature;
+};
+
+// Разбирает датаграмму; температура должна быть обычным десятичным числом, поэтому её
+// текст можно вставлять в JSON без преобразования.
+inline bool parseIngestEvent(const char *data, size_t size, IngestEvent &event) {
+    const char *end = data + size;
+    const char *firstTab = (const char *)std::memchr(data, '\t', size);
+    if (firstTab == nullptr || firstTab == data) {
+        return false;
+    }
+    const char *secondTab = (const char *)std::memchr(firstTab + 1, '\t', end - firstTab - 1);
+    if (secondTab == nullptr || secondTab == firstTab + 1 || secondTab + 1 == end) {
+        return false;
+    }
+
+    long long id = 0;
+    for (const char *c = data; c < firstTab; ++c) {
+        if (*c < '0' || *c > '9') {
+            return false;
+        }
+        id = id * 10 + (*c - '0');
+    }
+    for (const char *c = firstTab + 1; c < secondTab; ++c) {
+        if (*c == '"' || *c == '\\' || (unsigned char)*c < 0x20) {
+            return false;
+        }
+    }
+    double value;
+    if (!parselib::parse_decimal(secondTab + 1, end, value)) {
+        return false;
+    }
+
+    event.id = id;
+    event.timestamp.assign(firstTab + 1, secondTab);
+    event.temperature.assign(secondTab + 1, end);
+    return true;
+}
+
+// Отправитель уведомлений на стороне main. Сокет неблокирующий и "подключён" к адресу
+// server, поэтому отправка — один send без ожидания; если server не запущен или не
+// успевает читать, уведомление просто теряется, на запись в базу это не влияет.
+class IngestEventSender {
+public:
+    explicit IngestEventSender(int port) {
+#ifdef _WIN32
+        WSADATA wsaData;
+        isStarted = WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+        sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (sock != INVALID_SOCKET) {
+            u_long nonBlocking = 1;
+            ioctlsocket(sock, FIONBIO, &nonBlocking);
+        }
+#else
+        sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+#endif
+        if (!isValid()) {
+            std::cerr << "Не удалось создать сокет уведомлений, /stream не будет получать данные" << std::endl;
+            return;
+        }
+        struct sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        connect(sock, (struct sockaddr *)&address, sizeof(address));
+    }
+
+    ~IngestEventSender() {
+#ifdef _WIN32
+        if (isValid()) {
+            closesocket(sock);
+        }
+        if (isStarted) {
+            WSACleanup();
+        }
+#else
+        if (isValid()) {
+            close(sock);
+        }
+#endif
+    }
+
+    IngestEventSender(const IngestEventSender &) = delete;
+    IngestEventSender &operator=(const IngestEventSender &) = delete;
+
+    void send(long long id, const std::string &timestamp, const std::string &temperature) {
+        if (!isValid()) {
+            return;
+        }
+        char datagram[MAX_INGEST_EVENT_SIZE];
+        int length = std::snprintf(datagram, sizeof(datagram), "%lld\t%s\t%s", id, timestamp.c_str(), temperature.c_str());
+        if (length <= 0 || (size_t)length >= sizeof(datagram)) {
+            return;
+        }
+#ifdef _WIN32
+        ::send(sock, datagram, length, 0);
+#else
+        ::send(sock, datagram, (size_t)length, MSG_NOSIGNAL);
+#endif
+    }
+
+private:
+#ifdef _WIN32
+    bool isValid() const { return sock != INVALID_SOCKET; }
+
+    SOCKET sock;
+    bool isStarted = false;
+#else
+    bool isValid() const { return sock >= 0; }
+
+    int sock;
+#endif
+};
@@ -0,0 +1,514 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include "temperature_parser.hpp"
+#include "storage_profile.hpp"
+#include "partitions.hpp"
+#include "sqlite3.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Импорт журналов lab4 ("[YYYY/MM/DD HH:MM:SS] 23.45 C", по строке на отсчёт) в базу lab5.
+//
+// Файл отображается в память и делится на куски по границам строк, каждый кусок разбирает
+// свой поток. Записи куска сортируются по времени, затем куски всех файлов одной серии
+// сливаются и вставляются через PartitionStore большими транзакциями. Писатель в SQLite
+// один, поэтому параллелен только разбор; загрузка идёт по возрастанию времени, так что
+// каждая партиция и её индекс заполняются дописыванием в конец.
+//
+// По умолчанию импорт идёт в отдельную базу temperature_import.db: партиции старше срока
+// хранения main удалит при первой же проверке, так что многолетней истории в рабочей базе
+// не место. Загрузка в рабочую базу (--db temperature_logs.db) — офлайн-операция: main в
+// это время должен быть остановлен, иначе его сквозные id сырых отсчётов разойдутся с
+// выданными импортом. Импортированные отсчёты получают id после уже имеющихся в базе.
+//
+// Повторный импорт того же файла ничего не добавляет: отсчёт пропускается, если в серии
+// уже есть строка с той же меткой времени, а пачки фиксируются только на смене метки.
+// Поэтому прерванный импорт можно просто запустить заново.
+
+const char *const IMPORT_DATABASE_PATH = "temperature_import.db";
+// Сколько уже имеющихся меток времени читается из базы за один запрос.
+const int EXISTING_TIMESTAMPS_PAGE = 65536;
+
+struct ImportOptions {
+    std::string databasePath = IMPORT_DATABASE_PATH;
+    unsigned threads = 0;
+    // -1 — по имени файла: *_hour.log — средние за час, *_day.log — за день, иначе сырые.
+    int series = -1;
+    long long batchRows = 1000000;
+    std::vector<std::string> files;
+};
+
+void printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [--db <path>] [--threads <n>] [--series raw|hour|day] [--batch <rows>] <log>...\n"
+              << "Imports lab4 logs into a lab5 database (default " << IMPORT_DATABASE_PATH << ").\n"
+              << "Rows whose timestamp is already stored are skipped, so a failed import can be rerun.\n"
+              << "main must not be running on the same database." << std::endl;
+}
+
+bool parseOptions(int argc, char **argv, ImportOptions &options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option.compare(0, 2, "--") != 0) {
+            options.files.push_back(option);
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const char *value = argv[++i];
+        if (option == "--db") {
+            options.databasePath = value;
+        } else if (option == "--threads") {
+            options.threads = (unsigned)std::max(1, std::atoi(value));
+        } else if (option == "--series") {
+            options.series = -1;
+            for (int series = 0; series < PARTITION_SERIES_COUNT; ++series) {
+                if (std::strcmp(value, PARTITION_SERIES_INFO[series].name) == 0) {
+                    options.series = series;
+                }
+            }
+            if (options.series < 0) {
+                return false;
+            }
+        } else if (option == "--batch") {
+            options.batchRows = std::max(1LL, std::atoll(value));
+        } else {
+            return false;
+        }
+    }
+    return !options.files.empty();
+}
+
+PartitionSeries seriesForFile(const std::string &path) {
+    std::string name = path.substr(path.find_last_of("/\\") + 1);
+    if (name.find("_hour") != std::string::npos) {
+        return PARTITION_HOURLY;
+    }
+    if (name.find("_day") != std::string::npos) {
+        return PARTITION_DAILY;
+    }
+    return PARTITION_RAW;
+}
+
+// Содержимое файла только для чтения: mmap в POSIX, чтение целиком в остальных системах.
+class MappedFile {
+public:
+    MappedFile() : mapped(nullptr), size(0) {}
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (mapped != nullptr) {
+            munmap(mapped, size);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::string &path) {
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            close(fd);
+            return false;
+        }
+        size = (size_t)info.st_size;
+        if (size != 0) {
+            mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                mapped = nullptr;
+                close(fd);
+                return false;
+            }
+            madvise(mapped, size, MADV_SEQUENTIAL);
+        }
+        close(fd);
+        return true;
+#else
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        size = contents.size();
+        return true;
+#endif
+    }
+
+    const char *data() const {
+#ifndef _WIN32
+        return (const char *)mapped;
+#else
+        return contents.data();
+#endif
+    }
+
+    size_t length() const { return size; }
+
+private:
+    void *mapped;
+    size_t size;
+#ifdef _WIN32
+    std::string contents;
+#endif
+};
+
+// Длина "YYYY-MM-DD HH:MM:SS".
+const size_t LOG_TIMESTAMP_LENGTH = 19;
+
+struct LogRecord {
+    char timestamp[LOG_TIMESTAMP_LENGTH];
+    double value;
+};
+
+bool isEarlier(const LogRecord &a, const LogRecord &b) {
+    return std::memcmp(a.timestamp, b.timestamp, LOG_TIMESTAMP_LENGTH) < 0;
+}
+
+// Разбирает строку без '\n'. Формат фиксированный, поэтому метка проверяется по позициям и
+// переписывается в формат столбца timestamp ('/' в дате меняется на '-').
+bool parseLogLine(const char *begin, const char *end, LogRecord &record) {
+    while (end > begin && parselib::detail::is_blank(end[-1])) {
+        --end;
+    }
+    // "[YYYY/MM/DD HH:MM:SS] " и хотя бы "0 C".
+    if (end - begin < 25 || begin[0] != '[' || begin[20] != ']' || begin[21] != ' ') {
+        return false;
+    }
+    static const char PATTERN[] = "dddd/dd/dd dd:dd:dd";
+    for (size_t i = 0; i < LOG_TIMESTAMP_LENGTH; ++i) {
+        char c = begin[i + 1];
+        if (PATTERN[i] == 'd' ? (c < '0' || c > '9') : c != PATTERN[i]) {
+            return false;
+        }
+    }
+    int month = (begin[6] - '0') * 10 + (begin[7] - '0');
+    int day = (begin[9] - '0') * 10 + (begin[10] - '0');
+    if (month < 1 || month > 12 || day < 1 || day > 31) {
+        return false;
+    }
+    std::memcpy(record.timestamp, begin + 1, LOG_TIMESTAMP_LENGTH);
+    record.timestamp[4] = '-';
+    record.timestamp[7] = '-';
+
+    if (end[-1] != 'C' || end[-2] != ' ') {
+        return false;
+    }
+    return parselib::parse_decimal(begin + 22, end - 2, record.value);
+}
+
+// Кусок файла от начала строки до начала строки и результат его разбора.
+struct ParseChunk {
+    const char *begin;
+    const char *end;
+    std::vector<LogRecord> records;
+    size_t lines = 0;
+    size_t rejected = 0;
+};
+
+void parseChunk(ParseChunk &chunk) {
+    // Строка журнала с типичной температурой — около 30 байт.
+    chunk.records.reserve((size_t)(chunk.end - chunk.begin) / 28);
+    const char *line = chunk.begin;
+    LogRecord record;
+    while (line < chunk.end) {
+        const char *newline = parselib::detail::find_newline(line, chunk.end);
+        if (newline != line) {
+            chunk.lines++;
+            if (parseLogLine(line, newline, record)) {
+                chunk.records.push_back(record);
+            } else {
+                chunk.rejected++;
+            }
+        }
+        line = newline + 1;
+    }
+    // Журнал дописывается по времени, так что обычно кусок уже упорядочен; назад время
+    // может уйти только при переводе часов. stable_sort оставляет одинаковые метки в
+    // порядке записи.
+    if (!std::is_sorted(chunk.records.begin(), chunk.records.end(), isEarlier)) {
+        std::stable_sort(chunk.records.begin(), chunk.records.end(), isEarlier);
+    }
+}
+
+// Делит [data, data + size) на `count` кусков примерно равной длины, сдвигая границы к
+// началу следующей строки.
+void splitChunks(const char *data, size_t size, unsigned count, std::vector<ParseChunk> &chunks) {
+    const char *end = data + size;
+    const char *begin = data;
+    for (unsigned i = 1; i <= count && begin < end; ++i) {
+        const char *boundary = i == count ? end : data + size / count * i;
+        if (boundary < begin) {
+            continue;
+        }
+        boundary = parselib::detail::find_newline(boundary, end);
+        boundary = boundary < end ? boundary + 1 : end;
+        ParseChunk chunk;
+        chunk.begin = begin;
+        chunk.end = boundary;
+        chunks.push_back(std::move(chunk));
+        begin = boundary;
+    }
+}
+
+struct ImportTotals {
+    size_t lines = 0;
+    size_t rejected = 0;
+    long long imported = 0;
+    long long skipped = 0;
+};
+
+// Метки времени, уже сохранённые в серии, по возрастанию. Читаются страницами, начиная
+// с запрошенной метки, так что в памяти не больше одной страницы.
+class ExistingTimestamps {
+public:
+    ExistingTimestamps(sqlite3 *db, const PartitionStore &partitions, PartitionSeries series)
+        : db(db), partitions(partitions), series(series), position(0), isExhausted(false) {
+    }
+
+    // Вызывается с неубывающими метками. Страница читается до вставки строк с меткой
+    // `timestamp`, поэтому вставленные импортом строки в неё не попадают.
+    bool contains(const std::string &timestamp, bool &isFound) {
+        while (true) {
+            while (position < page.size() && page[position] < timestamp) {
+                ++position;
+            }
+            if (position < page.size() || isExhausted) {
+                isFound = position < page.size() && page[position] == timestamp;
+                return true;
+            }
+            if (!loadPage(timestamp)) {
+                return false;
+            }
+        }
+    }
+
+private:
+    bool loadPage(const std::string &from) {
+        std::string query = "SELECT timestamp FROM (" + partitions.unionQuery(series, "timestamp", "timestamp >= ?1", from, "") +
+                            ") ORDER BY timestamp LIMIT " + std::to_string(EXISTING_TIMESTAMPS_PAGE) + ";";
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "Ошибка чтения имеющихся отсчётов: " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+        sqlite3_bind_text(stmt, 1, from.c_str(), (int)from.size(), SQLITE_TRANSIENT);
+        page.clear();
+        position = 0;
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            page.push_back(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)));
+        }
+        sqlite3_finalize(stmt);
+        if (rc != SQLITE_DONE) {
+            std::cerr << "Ошибка чтения имеющихся отсчётов: " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+        isExhausted = page.size() < (size_t)EXISTING_TIMESTAMPS_PAGE;
+        return true;
+    }
+
+    sqlite3 *db;
+    const PartitionStore &partitions;
+    PartitionSeries series;
+    std::vector<std::string> page;
+    size_t position;
+    bool isExhausted;
+};
+
+// Сливает упорядоченные куски и вставляет записи по возрастанию времени, пропуская метки,
+// которые уже есть в серии. Транзакция фиксируется примерно каждые batchRows строк, но
+// только между разными метками: все отсчёты одной секунды попадают в базу вместе, и
+// повторный импорт после сбоя не теряет часть из них.
+bool loadSeries(sqlite3 *db, PartitionStore &partitions, PartitionSeries series, std::vector<ParseChunk *> &chunks,
+                long long batchRows, ImportTotals &totals) {
+    std::vector<size_t> positions(chunks.size(), 0);
+    std::string timestamp(LOG_TIMESTAMP_LENGTH, ' ');
+    std::string lastTimestamp;
+    bool isLastSkipped = false;
+    ExistingTimestamps existing(db, partitions, series);
+    long long inBatch = 0;
+    bool isLoaded = true;
+    if (!execPragma(db, "BEGIN IMMEDIATE;")) {
+        return false;
+    }
+    while (isLoaded) {
+        // Кусков — несколько на файл, так что линейный поиск минимума дешевле кучи.
+        size_t next = chunks.size();
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            if (positions[i] < chunks[i]->records.size() &&
+                (next == chunks.size() || isEarlier(chunks[i]->records[positions[i]], chunks[next]->records[positions[next]]))) {
+                next = i;
+            }
+        }
+        if (next == chunks.size()) {
+            break;
+        }
+        const LogRecord &record = chunks[next]->records[positions[next]++];
+        timestamp.assign(record.timestamp, LOG_TIMESTAMP_LENGTH);
+        if (timestamp != lastTimestamp) {
+            if (inBatch >= batchRows) {
+                inBatch = 0;
+                if (!execPragma(db, "COMMIT;") || !execPragma(db, "BEGIN IMMEDIATE;")) {
+                    isLoaded = false;
+                    break;
+                }
+            }
+            // Отсчёты с той же меткой, что у предыдущего, решаются так же: строки, только
+            // что вставленные импортом, не должны считаться уже имевшимися.
+            if (!existing.contains(timestamp, isLastSkipped)) {
+                isLoaded = false;
+                break;
+            }
+            lastTimestamp = timestamp;
+        }
+        if (isLastSkipped) {
+            totals.skipped++;
+            continue;
+        }
+        if (!partitions.insert(series, timestamp, record.value)) {
+            isLoaded = false;
+            break;
+        }
+        totals.imported++;
+        inBatch++;
+    }
+    if (!isLoaded) {
+        execPragma(db, "ROLLBACK;");
+        return false;
+    }
+    return execPragma(db, "COMMIT;");
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Usage: log_import [--db <path>] [--threads <n>] [--series raw|hour|day] [--batch <rows>] <log>...
+// Настройки SQLite — как у main (LAB5_STORAGE). Синхронная запись отключается только для
+// новой базы: после сбоя её можно удалить и собрать заново. Существующая база, в том
+// числе рабочая, остаётся с настройкой профиля.
+int main(int argc, char **argv) {
+    ImportOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (options.threads == 0) {
+        options.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    auto parseStart = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<MappedFile>> files;
+    std::vector<std::unique_ptr<std::vector<ParseChunk>>> fileChunks;
+    std::vector<PartitionSeries> fileSeries;
+    size_t totalBytes = 0;
+    for (const std::string &path : options.files) {
+        std::unique_ptr<MappedFile> file(new MappedFile());
+        if (!file->open(path)) {
+            std::cerr << "Не удалось открыть " << path << ": " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::unique_ptr<std::vector<ParseChunk>> chunks(new std::vector<ParseChunk>());
+        // Маленький файл не стоит делить: один кусок на каждые 4 МиБ, но не больше потоков.
+        unsigned count = (unsigned)std::min<size_t>(options.threads, file->length() / (4 << 20) + 1);
+        splitChunks(file->data(), file->length(), count, *chunks);
+        totalBytes += file->length();
+        files.push_back(std::move(file));
+        fileChunks.push_back(std::move(chunks));
+        fileSeries.push_back(options.series >= 0 ? (PartitionSeries)options.series : seriesForFile(path));
+    }
+
+    // Куски всех файлов разбираются общим пулом потоков.
+    std::vector<ParseChunk *> pending;
+    for (auto &chunks : fileChunks) {
+        for (ParseChunk &chunk : *chunks) {
+            pending.push_back(&chunk);
+        }
+    }
+    std::atomic<size_t> nextChunk(0);
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < std::min<size_t>(options.threads, pending.size()); ++i) {
+        workers.push_back(std::thread([&pending, &nextChunk]() {
+            for (size_t index = nextChunk++; index < pending.size(); index = nextChunk++) {
+                parseChunk(*pending[index]);
+            }
+        }));
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    double parseSeconds = secondsSince(parseStart);
+
+    auto loadStart = std::chrono::steady_clock::now();
+    std::ifstream existingDatabase(options.databasePath.c_str());
+    bool isNewDatabase = !existingDatabase.is_open();
+    existingDatabase.close();
+    sqlite3 *db;
+    if (sqlite3_open(options.databasePath.c_str(), &db) != SQLITE_OK) {
+        std::cerr << "Ошибка при открытии базы данных: " << sqlite3_errmsg(db) << std::endl;
+        return EXIT_FAILURE;
+    }
+    applyStorageProfile(db, storageProfileFromEnvironment(), true);
+    if (isNewDatabase) {
+        execPragma(db, "PRAGMA synchronous = OFF;");
+    }
+    ImportTotals totals;
+    bool isImported;
+    {
+        PartitionStore partitions(db);
+        isImported = partitions.openForWriting();
+        for (int series = 0; series < PARTITION_SERIES_COUNT && isImported; ++series) {
+            std::vector<ParseChunk *> chunks;
+            for (size_t i = 0; i < fileChunks.size(); ++i) {
+                if (fileSeries[i] == series) {
+                    for (ParseChunk &chunk : *fileChunks[i]) {
+                        chunks.push_back(&chunk);
+                        totals.lines += chunk.lines;
+                        totals.rejected += chunk.rejected;
+                    }
+                }
+            }
+            if (!chunks.empty()) {
+                isImported = loadSeries(db, partitions, (PartitionSeries)series, chunks, options.batchRows, totals);
+            }
+        }
+    }
+    sqlite3_close(db);
+    double loadSeconds = secondsSince(loadStart);
+
+    std::cout << "Файлов: " << options.files.size() << ", " << totalBytes / (1024.0 * 1024.0) << " МиБ, строк: " << totals.lines
+              << ", пропущено неверных: " << totals.rejected << std::endl;
+    std::cout << "Разбор: " << parseSeconds << " с (" << options.threads << " потоков), загрузка: " << loadSeconds << " с, "
+              << totals.imported << " строк (" << (loadSeconds > 0 ? totals.imported / loadSeconds : 0) << " строк/с)";
+    if (totals.skipped > 0) {
+        std::cout << ", уже были в базе: " << totals.skipped;
+    }
+    std::cout << std::endl;
+    if (!isImported) {
+        std::cerr << "Импорт прерван: последняя незафиксированная пачка отменена" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
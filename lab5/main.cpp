@@ -6,7 +6,15 @@
 #include <cstring>
 #include <cstdlib>
 #include <iomanip>
+#include <algorithm>
+#include <mutex>
+#include "ingest_events.hpp"
 #include "com.hpp"
+#include "timestamp.hpp"
+#include "trace.hpp"
+#include "timer_wheel.hpp"
+#include "storage_profile.hpp"
+#include "partitions.hpp"
 #include "sqlite3.h"
 
 #ifdef _WIN32
@@ -23,130 +31,78 @@ struct TempRecord {
 };
 
 std::string formatTimestamp(const std::chrono::system_clock::time_point &logTime) {
-    auto timeT = std::chrono::system_clock::to_time_t(logTime);
-    std::tm tmStruct = *std::localtime(&timeT); 
-    std::ostringstream oss;
-    oss << std::put_time(&tmStruct, "%Y-%m-%d %H:%M:%S"); 
-    return oss.str();
+    return timelib::local_timestamp(logTime);
 }
 
-void setupDB(sqlite3 *&db) {
-    if (sqlite3_open("temperature_logs.db", &db)) {
+void setupDB(sqlite3 *&db, const StorageProfile &profile) {
+    if (sqlite3_open(DATABASE_PATH, &db)) {
         std::cerr << "Ошибка при открытии базы данных: " << sqlite3_errmsg(db) << std::endl;
         exit(EXIT_FAILURE);
     }
-    const char *createTableCmd = "CREATE TABLE IF NOT EXISTS TemperatureLogs ("
-                                 "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-                                 "timestamp TEXT NOT NULL,"
-                                 "temperature REAL NOT NULL);";
-    const char *createAvgHourTableCmd = "CREATE TABLE IF NOT EXISTS AvgHourTemp ("
-                                        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-                                        "timestamp TEXT NOT NULL,"
-                                        "avg_temp REAL NOT NULL);";
-    const char *createAvgDayTableCmd = "CREATE TABLE IF NOT EXISTS AvgDayTemp ("
-                                       "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-                                       "timestamp TEXT NOT NULL,"
-                                       "avg_temp REAL NOT NULL);";
-    char *errMsg = nullptr;
-    if (sqlite3_exec(db, createTableCmd, nullptr, nullptr, &errMsg) != SQLITE_OK) {
-        std::cerr << "Ошибка создания таблицы TemperatureLogs: " << errMsg << std::endl;
-        sqlite3_free(errMsg);
-        exit(EXIT_FAILURE);
-    }
-    if (sqlite3_exec(db, createAvgHourTableCmd, nullptr, nullptr, &errMsg) != SQLITE_OK) {
-        std::cerr << "Ошибка создания таблицы AvgHourTemp: " << errMsg << std::endl;
-        sqlite3_free(errMsg);
-        exit(EXIT_FAILURE);
-    }
-    if (sqlite3_exec(db, createAvgDayTableCmd, nullptr, nullptr, &errMsg) != SQLITE_OK) {
-        std::cerr << "Ошибка создания таблицы AvgDayTemp: " << errMsg << std::endl;
-        sqlite3_free(errMsg);
-        exit(EXIT_FAILURE);
-    }
-}
-
-void cleanupOldRecords(sqlite3* db, const std::string& tableName, std::chrono::hours maxAge) {
-    auto now = std::chrono::system_clock::now();
-    auto cutoffTime = now - maxAge;
-    std::string timestampStr = formatTimestamp(cutoffTime);
-    std::string deleteCmd = "DELETE FROM " + tableName + " WHERE timestamp < '" + timestampStr + "';";
-    char *errMsg = nullptr;
-    if (sqlite3_exec(db, deleteCmd.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK) {
-        std::cerr << "Ошибка удаления старых записей из таблицы " << tableName << ": " << errMsg << std::endl;
-        sqlite3_free(errMsg);
-    }
+    // До создания партиций, чтобы page_size успел подействовать на новую базу.
+    applyStorageProfile(db, profile, true);
 }
 
-void storeTemperatureInDB(sqlite3* db, const TempRecord &entry) {
-    cleanupOldRecords(db, "TemperatureLogs", std::chrono::hours(24));
+// После успешной записи уведомляет server, чтобы он разослал отсчёт подписчикам /stream.
+void storeTemperatureInDB(PartitionStore &partitions, const TempRecord &entry, IngestEventSender &events) {
+    TRACE_SPAN("db.store");
     std::string timestampStr = formatTimestamp(entry.logTime);
-    std::string insertCmd = "INSERT INTO TemperatureLogs (timestamp, temperature) VALUES ('" + timestampStr + "', " + std::to_string(entry.tempValue) + ");";
-    char *errMsg = nullptr;
-    if (sqlite3_exec(db, insertCmd.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK) {
-        std::cerr << "Ошибка записи в базу данных: " << errMsg << std::endl;
-        sqlite3_free(errMsg);
+    // В базу — то же округлённое значение, что уходит подписчикам /stream.
+    std::string temperatureStr = std::to_string(entry.tempValue);
+    long long id;
+    if (!partitions.insert(PARTITION_RAW, timestampStr, std::strtod(temperatureStr.c_str(), nullptr), &id)) {
+        return;
     }
+    TRACE_SPAN("notify");
+    events.send(id, timestampStr, temperatureStr);
 }
 
-void storeHourlyAverage(sqlite3* db, double avgTemp, const std::chrono::system_clock::time_point &logTime) {
-    cleanupOldRecords(db, "AvgHourTemp", std::chrono::hours(24 * 30));
-    std::string timestampStr = formatTimestamp(logTime);
-    std::string insertCmd = "INSERT INTO AvgHourTemp (timestamp, avg_temp) VALUES ('" + timestampStr + "', " + std::to_string(avgTemp) + ");";
-    char *errMsg = nullptr;
-    if (sqlite3_exec(db, insertCmd.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK) {
-        std::cerr << "Ошибка записи средней температуры за час в базу данных: " << errMsg << std::endl;
-        sqlite3_free(errMsg);
-    }
+void storeHourlyAverage(PartitionStore &partitions, double avgTemp, const std::chrono::system_clock::time_point &logTime) {
+    TRACE_SPAN("rollup.hour.store");
+    partitions.insert(PARTITION_HOURLY, formatTimestamp(logTime), avgTemp);
 }
 
-
-void storeDailyAverage(sqlite3* db, double avgTemp, const std::chrono::system_clock::time_point &logTime) {
-    cleanupOldRecords(db, "AvgDayTemp", std::chrono::hours(24 * 365));
-    std::string timestampStr = formatTimestamp(logTime);
-    std::string insertCmd = "INSERT INTO AvgDayTemp (timestamp, avg_temp) VALUES ('" + timestampStr + "', " + std::to_string(avgTemp) + ");";
-    char *errMsg = nullptr;
-    if (sqlite3_exec(db, insertCmd.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK) {
-        std::cerr << "Ошибка записи средней температуры за день в базу данных: " << errMsg << std::endl;
-        sqlite3_free(errMsg);
-    }
+void storeDailyAverage(PartitionStore &partitions, double avgTemp, const std::chrono::system_clock::time_point &logTime) {
+    TRACE_SPAN("rollup.day.store");
+    partitions.insert(PARTITION_DAILY, formatTimestamp(logTime), avgTemp);
 }
 
-double computeHourlyAverage(const std::vector<TempRecord> &entries) {
+// Средняя температура отсчётов из [from, to); false, если за период отсчётов не было.
+bool computeAverage(const std::vector<TempRecord> &entries, const std::chrono::system_clock::time_point &from,
+                    const std::chrono::system_clock::time_point &to, double &average) {
+    TRACE_SPAN("rollup.compute");
     double total = 0;
     int count = 0;
-    auto now = std::chrono::system_clock::now();
     for (const auto &entry : entries) {
-        auto elapsedHours = std::chrono::duration_cast<std::chrono::hours>(now - entry.logTime).count();
-        if (elapsedHours <= 1) {
+        if (entry.logTime >= from && entry.logTime < to) {
             total += entry.tempValue;
             count++;
         }
     }
-    return count > 0 ? total / count : 0;
-}
-
-//средняя температура за последний день
-double computeDailyAverage(const std::vector<TempRecord> &entries) {
-    double total = 0;
-    int count = 0;
-    auto now = std::chrono::system_clock::now();
-    for (const auto &entry : entries) {
-        auto elapsedHours = std::chrono::duration_cast<std::chrono::hours>(now - entry.logTime).count();
-        if (elapsedHours <= 24) {
-            total += entry.tempValue;
-            count++;
-        }
+    if (count == 0) {
+        return false;
     }
-    return count > 0 ? total / count : 0;
+    average = total / count;
+    return true;
 }
 
-int main() {
+// Usage: main [serial_port] [event_port]
+// LAB5_STORAGE переопределяет настройки SQLite (см. storage_profile.hpp).
+// LAB5_TRACE=1 (или путь к файлу) включает трассировку; kill -USR2 и выход из main
+// сохраняют её в trace.json (или в указанный файл) для chrome://tracing / Perfetto.
+int main(int argc, char **argv) {
+    if (tracelib::enable_from_env("LAB5_TRACE")) {
+        tracelib::set_thread_name("main");
+    }
+    StorageProfile storageProfile = storageProfileFromEnvironment();
     sqlite3* db;
-    setupDB(db);
-    if (sqlite3_open("temperature_logs.db", &db)) {
-        std::cerr << "Ошибка при открытии базы данных: " << sqlite3_errmsg(db) << std::endl;
+    setupDB(db, storageProfile);
+    PartitionStore partitions(db);
+    if (!partitions.openForWriting()) {
+        std::cerr << "Не удалось подготовить партиции базы данных" << std::endl;
         return EXIT_FAILURE;
     }
+    Checkpointer checkpointer(DATABASE_PATH, storageProfile);
     std::vector<TempRecord> tempEntries;
 #ifdef _WIN32
     const char* cmd_name = "cmd /c timeout /t 5 >nul 2>&1";
@@ -155,43 +111,81 @@ int main() {
     const char* cmd_name = "sleep 5";
 #endif
 #ifdef _WIN32
-    HANDLE serialPortFd = initializeSerialConnection("\\\\.\\COM6");
+    const char *portName = argc > 1 ? argv[1] : "\\\\.\\COM6";
 #else
-    int serialPortFd = establishSerialLink("/dev/ttyUSB0");
+    const char *portName = argc > 1 ? argv[1] : "/dev/ttyUSB0";
 #endif
-    auto lastReadTime = std::chrono::steady_clock::now();
-    long currentDay = 1;
+    SerialReader serialReader(portName);
+    IngestEventSender ingestEvents(argc > 2 ? std::atoi(argv[2]) : DEFAULT_INGEST_EVENT_PORT);
+
+    // Сводки и очистка выполняются в потоке планировщика по границам часов и суток
+    // местного времени. Соединение с базой и PartitionStore общие: dbMutex не даёт
+    // их записи вклиниться между выдачей id отсчёту и его INSERT.
+    std::mutex dbMutex;
+    std::mutex entriesMutex;
+    timerlib::Scheduler scheduler;
+    scheduler.every(std::chrono::hours(1), [&](std::chrono::system_clock::time_point due) {
+        double hourlyAvg;
+        bool hasSamples;
+        {
+            std::lock_guard<std::mutex> lock(entriesMutex);
+            hasSamples = computeAverage(tempEntries, due - std::chrono::hours(1), due, hourlyAvg);
+            // Старше суток отсчёты не нужны ни одной сводке.
+            auto cutoff = due - std::chrono::hours(24);
+            tempEntries.erase(std::remove_if(tempEntries.begin(), tempEntries.end(),
+                                             [cutoff](const TempRecord &entry) { return entry.logTime < cutoff; }),
+                              tempEntries.end());
+        }
+        if (hasSamples) {
+            std::lock_guard<std::mutex> lock(dbMutex);
+            storeHourlyAverage(partitions, hourlyAvg, due);
+        }
+    });
+    scheduler.every(std::chrono::hours(24), [&](std::chrono::system_clock::time_point due) {
+        double dailyAvg;
+        bool hasSamples;
+        {
+            std::lock_guard<std::mutex> lock(entriesMutex);
+            hasSamples = computeAverage(tempEntries, due - std::chrono::hours(24), due, dailyAvg);
+        }
+        if (hasSamples) {
+            std::lock_guard<std::mutex> lock(dbMutex);
+            storeDailyAverage(partitions, dailyAvg, due);
+        }
+    });
+    // Срок хранения: устаревшие партиции удаляются целиком. Проверка — по каталогу в
+    // памяти, так что раз в минуту она почти ничего не стоит.
+    scheduler.every(std::chrono::minutes(1), [&](std::chrono::system_clock::time_point) {
+        std::lock_guard<std::mutex> lock(dbMutex);
+        for (int series = 0; series < PARTITION_SERIES_COUNT; ++series) {
+            partitions.dropExpired((PartitionSeries)series, std::chrono::system_clock::now());
+        }
+    });
+
+    std::vector<SerialSample> samples;
     while (true) {
-        double temperature;
-        temperature = fetchTemperatureData(serialPortFd);
-        TempRecord entry = { std::chrono::system_clock::now(), temperature };
-        tempEntries.push_back(entry);
-        storeTemperatureInDB(db, entry);
-        // Каждые 60 минут записывать среднюю температуру за час
-        auto now = std::chrono::system_clock::now();
-        auto elapsedHours = std::chrono::duration_cast<std::chrono::hours>(now - entry.logTime).count();
-        if (elapsedHours != 0 && elapsedHours % 1 == 0) {  // Каждые 1 час
-            double hourlyAvg = computeHourlyAverage(tempEntries);
-            storeHourlyAverage(db, hourlyAvg, entry.logTime);
+        tracelib::dump_if_requested();
+        samples.clear();
+        if (!serialReader.readSamples(samples, 1000)) {
+            break;
         }
-        // Каждые 24 часа записывать среднюю температуру за день
-        auto elapsedDays = std::chrono::duration_cast<std::chrono::hours>(now - entry.logTime).count();
-        if (elapsedHours != 0 && elapsedHours % 24 == 0 && elapsedDays == currentDay) {  // Каждые 24 часа
-            currentDay++;
-            double dailyAvg = computeDailyAverage(tempEntries);
-            storeDailyAverage(db, dailyAvg, entry.logTime);
+        for (const SerialSample &sample : samples) {
+            TRACE_SPAN("sample");
+            TempRecord entry = { sample.receivedAt, sample.value };
+            {
+                std::lock_guard<std::mutex> lock(entriesMutex);
+                tempEntries.push_back(entry);
+            }
+            std::lock_guard<std::mutex> lock(dbMutex);
+            storeTemperatureInDB(partitions, entry, ingestEvents);
         }
-#ifdef _WIN32
-        Sleep(300);
-#else
-        sleep(1);
-#endif
     }
-#ifdef __linux__
-    close(serialPortFd);
-#elif _WIN32
-    CloseHandle(serialPortFd);
-#endif
-    sqlite3_close(db);
+    scheduler.stop();
+    // Подготовленные запросы PartitionStore ещё живы: close_v2 закроет соединение,
+    // когда их освободит деструктор.
+    sqlite3_close_v2(db);
+    if (tracelib::is_enabled() && !tracelib::write_chrome_json(tracelib::dump_path())) {
+        std::cerr << "Не удалось записать трассировку в " << tracelib::dump_path() << std::endl;
+    }
     return EXIT_SUCCESS;
 }
\ No newline at end of file
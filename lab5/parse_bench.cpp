@@ -0,0 +1,90 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "temperature_parser.hpp"
+
+// Сравнение разбора буфера строк "[-]dd.dddd\n" через strtod, std::from_chars и parselib.
+// Usage: parse_bench [lines] [repetitions]
+
+std::string makeSamples(size_t lines) {
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> temperature(-10.0f, 40.0f);
+    std::string text;
+    for (size_t i = 0; i < lines; ++i) {
+        text += std::to_string(temperature(generator));
+        text += '\n';
+    }
+    return text;
+}
+
+double parseWithStrtod(const std::string &text, std::vector<double> &values) {
+    const char *line = text.c_str();
+    while (*line != '\0') {
+        const char *newline = std::strchr(line, '\n');
+        values.push_back(std::strtod(line, nullptr));
+        line = newline + 1;
+    }
+    return values.back();
+}
+
+double parseWithFromChars(const std::string &text, std::vector<double> &values) {
+    const char *line = text.data();
+    const char *end = line + text.size();
+    while (line < end) {
+        const char *newline = (const char *)std::memchr(line, '\n', end - line);
+        double value = 0.0;
+        std::from_chars(line, newline, value);
+        values.push_back(value);
+        line = newline + 1;
+    }
+    return values.back();
+}
+
+double parseWithParselib(const std::string &text, std::vector<double> &values) {
+    parselib::parse_lines(text.data(), text.size(), values);
+    return values.back();
+}
+
+template <typename Parser>
+void runCase(const char *name, const std::string &text, size_t lines, int repetitions, Parser parser) {
+    std::vector<double> values;
+    values.reserve(lines);
+    double checksum = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; ++i) {
+        values.clear();
+        checksum += parser(text, values);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double totalLines = (double)lines * repetitions;
+    std::cout << std::left << std::setw(16) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(8) << totalLines / seconds / 1e6 << " M lines/s "
+              << std::setw(8) << text.size() * (double)repetitions / seconds / 1e6 << " MB/s"
+              << "  (checksum " << std::setprecision(3) << checksum << ")" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    size_t lines = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    int repetitions = argc > 2 ? std::atoi(argv[2]) : 10;
+    std::string text = makeSamples(lines);
+
+    std::vector<double> reference, fast;
+    parseWithStrtod(text, reference);
+    parseWithParselib(text, fast);
+    if (reference != fast) {
+        std::cerr << "parselib и strtod разошлись" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << lines << " lines, " << text.size() << " bytes, " << repetitions << " repetitions" << std::endl;
+    runCase("strtod", text, lines, repetitions, parseWithStrtod);
+    runCase("from_chars", text, lines, repetitions, parseWithFromChars);
+    runCase("parselib", text, lines, repetitions, parseWithParselib);
+    return EXIT_SUCCESS;
+}
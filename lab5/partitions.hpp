@@ -0,0 +1,491 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include "sqlite3.h"
+#include "timestamp.hpp"
+#include "trace.hpp"
+
+// Данные хранятся не в трёх таблицах, а в партициях по времени: сырые отсчёты —
+// по суткам (TemperatureLogs_20240131), средние за час и за день — по месяцам
+// (AvgHourTemp_202401, AvgDayTemp_202401). Каталог Partitions перечисляет партиции и их
+// диапазоны [range_start, range_end) в местном времени. Срок хранения соблюдается
+// удалением целых партиций (DROP TABLE) вместо DELETE по timestamp, поэтому отсчёт
+// виден, пока не устарела вся его партиция: сырые — от 24 до 48 часов.
+//
+// Запросы по периоду собираются из партиций, пересекающих период (unionQuery). Для
+// совместимости прежние имена TemperatureLogs, AvgHourTemp и AvgDayTemp — представления,
+// объединяющие все живые партиции. id сырых отсчётов сквозные по всем партициям и
+// по-прежнему только растут: на них держатся /stream и курсоры since_id.
+
+enum PartitionSeries {
+    PARTITION_RAW,
+    PARTITION_HOURLY,
+    PARTITION_DAILY,
+    PARTITION_SERIES_COUNT
+};
+
+struct PartitionSeriesInfo {
+    const char *name;
+    const char *baseTable;
+    const char *valueColumn;
+    bool isDaily;
+    int retentionHours;
+};
+
+const PartitionSeriesInfo PARTITION_SERIES_INFO[PARTITION_SERIES_COUNT] = {
+    { "raw", "TemperatureLogs", "temperature", true, 24 },
+    { "hour", "AvgHourTemp", "avg_temp", false, 24 * 30 },
+    { "day", "AvgDayTemp", "avg_temp", false, 24 * 365 },
+};
+
+struct Partition {
+    std::string name;
+    std::string rangeStart;
+    std::string rangeEnd;
+};
+
+// Ключ партиции по метке "YYYY-MM-DD HH:MM:SS": её имя и границы. false, если метка
+// не в этом формате (имя таблицы собирается из её цифр).
+inline bool partitionFor(PartitionSeries series, const std::string &timestamp, Partition &partition) {
+    const PartitionSeriesInfo &info = PARTITION_SERIES_INFO[series];
+    if (timestamp.size() < 10 || timestamp[4] != '-' || timestamp[7] != '-') {
+        return false;
+    }
+    for (size_t i = 0; i < 10; ++i) {
+        if (i != 4 && i != 7 && (timestamp[i] < '0' || timestamp[i] > '9')) {
+            return false;
+        }
+    }
+    int64_t year = std::atoi(timestamp.substr(0, 4).c_str());
+    unsigned month = (unsigned)std::atoi(timestamp.substr(5, 2).c_str());
+    unsigned day = info.isDaily ? (unsigned)std::atoi(timestamp.substr(8, 2).c_str()) : 1;
+    if (month < 1 || month > 12 || day < 1 || day > 31) {
+        return false;
+    }
+
+    int64_t startDays = timelib::detail::days_from_civil(year, month, day);
+    int64_t endDays = info.isDaily ? startDays + 1
+                                   : timelib::detail::days_from_civil(month == 12 ? year + 1 : year, month == 12 ? 1 : month + 1, 1);
+    char buffer[32];
+    int64_t endYear;
+    unsigned endMonth, endDay;
+    timelib::detail::civil_from_days(endDays, endYear, endMonth, endDay);
+
+    std::snprintf(buffer, sizeof(buffer), "%04d-%02u-%02u 00:00:00", (int)year, month, day);
+    partition.rangeStart = buffer;
+    std::snprintf(buffer, sizeof(buffer), "%04d-%02u-%02u 00:00:00", (int)endYear, endMonth, endDay);
+    partition.rangeEnd = buffer;
+    if (info.isDaily) {
+        std::snprintf(buffer, sizeof(buffer), "_%04d%02u%02u", (int)year, month, day);
+    } else {
+        std::snprintf(buffer, sizeof(buffer), "_%04d%02u", (int)year, month);
+    }
+    partition.name = std::string(info.baseTable) + buffer;
+    return true;
+}
+
+// Каталог партиций на одном соединении. Писатель (main) создаёт партиции при вставке и
+// удаляет устаревшие; читатель (server) перечитывает каталог, когда меняется схема базы.
+class PartitionStore {
+public:
+    explicit PartitionStore(sqlite3 *db) : db(db), schemaVersion(-1), nextRawId(1) {
+        for (int series = 0; series < PARTITION_SERIES_COUNT; ++series) {
+            insertStatements[series] = nullptr;
+        }
+    }
+
+    ~PartitionStore() {
+        resetInsertStatements();
+    }
+
+    PartitionStore(const PartitionStore &) = delete;
+    PartitionStore &operator=(const PartitionStore &) = delete;
+
+    // Для писателя: создаёт каталог и переносит в партиции данные из прежних таблиц.
+    bool openForWriting() {
+        const char *createCatalogCmd = "CREATE TABLE IF NOT EXISTS Partitions ("
+                                       "name TEXT PRIMARY KEY,"
+                                       "series TEXT NOT NULL,"
+                                       "range_start TEXT NOT NULL,"
+                                       "range_end TEXT NOT NULL,"
+                                       "first_id INTEGER NOT NULL,"
+                                       "is_dropped INTEGER NOT NULL DEFAULT 0);";
+        if (!exec(createCatalogCmd)) {
+            return false;
+        }
+        if (!refresh(true)) {
+            return false;
+        }
+        for (int series = 0; series < PARTITION_SERIES_COUNT; ++series) {
+            if (!migrateLegacyTable((PartitionSeries)series)) {
+                return false;
+            }
+        }
+        for (int series = 0; series < PARTITION_SERIES_COUNT; ++series) {
+            if (!rebuildView((PartitionSeries)series)) {
+                return false;
+            }
+        }
+        return refresh(true) && loadNextRawId();
+    }
+
+    // Перечитывает каталог, если после прошлого вызова менялась схема (партиции создаются
+    // и удаляются только вместе с ней). Читателю достаточно вызывать перед запросами.
+    bool refresh(bool isForced = false) {
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db, "PRAGMA schema_version;", -1, &stmt, nullptr) != SQLITE_OK) {
+            return false;
+        }
+        long long version = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : -1;
+        sqlite3_finalize(stmt);
+        if (!isForced && version == schemaVersion) {
+            return true;
+        }
+        schemaVersion = version;
+
+        for (int series = 0; series < PARTITION_SERIES_COUNT; ++series) {
+            live[series].clear();
+        }
+        const char *query = "SELECT name, series, range_start, range_end FROM Partitions WHERE is_dropped = 0 ORDER BY range_start;";
+        if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) {
+            // Каталога ещё нет: main с партициями ни разу не запускался.
+            return true;
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            std::string seriesName = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+            for (int series = 0; series < PARTITION_SERIES_COUNT; ++series) {
+                if (seriesName == PARTITION_SERIES_INFO[series].name) {
+                    Partition partition;
+                    partition.name = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+                    partition.rangeStart = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2));
+                    partition.rangeEnd = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 3));
+                    live[series].push_back(partition);
+                }
+            }
+        }
+        sqlite3_finalize(stmt);
+        return true;
+    }
+
+    // Вставляет строку в партицию её метки времени, при необходимости создавая партицию.
+    // Для сырых отсчётов `id` — выданный сквозной id. Можно вызывать внутри транзакции.
+    // Метка внутри диапазона партиции предыдущей вставки заново не разбирается: подряд идущие
+    // отсчёты почти всегда попадают в одну партицию.
+    bool insert(PartitionSeries series, const std::string &timestamp, double value, long long *id = nullptr) {
+        TRACE_SPAN("partition.insert");
+        const Partition &current = insertPartitions[series];
+        if (insertStatements[series] == nullptr || timestamp < current.rangeStart || timestamp >= current.rangeEnd) {
+            Partition partition;
+            if (!partitionFor(series, timestamp, partition)) {
+                std::cerr << "Метка времени вне формата партиций: " << timestamp << std::endl;
+                return false;
+            }
+            if (!findPartition(series, partition.name) && !createPartition(series, partition)) {
+                return false;
+            }
+            sqlite3_finalize(insertStatements[series]);
+            insertStatements[series] = nullptr;
+            std::string insertCmd = "INSERT INTO " + partition.name + " (id, timestamp, " + PARTITION_SERIES_INFO[series].valueColumn +
+                                    ") VALUES (?, ?, ?);";
+            if (sqlite3_prepare_v2(db, insertCmd.c_str(), -1, &insertStatements[series], nullptr) != SQLITE_OK) {
+                std::cerr << "Ошибка подготовки вставки в " << partition.name << ": " << sqlite3_errmsg(db) << std::endl;
+                sqlite3_finalize(insertStatements[series]);
+                insertStatements[series] = nullptr;
+                return false;
+            }
+            insertPartitions[series] = partition;
+        }
+
+        sqlite3_stmt *stmt = insertStatements[series];
+        if (series == PARTITION_RAW) {
+            sqlite3_bind_int64(stmt, 1, nextRawId);
+        } else {
+            sqlite3_bind_null(stmt, 1);
+        }
+        sqlite3_bind_text(stmt, 2, timestamp.c_str(), (int)timestamp.size(), SQLITE_STATIC);
+        sqlite3_bind_double(stmt, 3, value);
+        int status = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (status != SQLITE_DONE) {
+            std::cerr << "Ошибка записи в " << current.name << ": " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+        if (series == PARTITION_RAW) {
+            if (id != nullptr) {
+                *id = nextRawId;
+            }
+            nextRawId++;
+        }
+        return true;
+    }
+
+    // Удаляет партиции, все строки которых старше срока хранения серии. Возвращает число
+    // удалённых партиций.
+    int dropExpired(PartitionSeries series, std::chrono::system_clock::time_point now) {
+        std::string cutoff = timelib::local_timestamp(now - std::chrono::hours(PARTITION_SERIES_INFO[series].retentionHours));
+        std::vector<Partition> expired;
+        for (const Partition &partition : live[series]) {
+            if (partition.rangeEnd <= cutoff) {
+                expired.push_back(partition);
+            }
+        }
+        if (expired.empty()) {
+            return 0;
+        }
+        TRACE_SPAN("partition.drop");
+        resetInsertStatements();
+        if (!exec("SAVEPOINT drop_partitions;")) {
+            return 0;
+        }
+        bool isDropped = true;
+        for (const Partition &partition : expired) {
+            // Удалённая сырая партиция хранит в first_id следующий после своих строк id,
+            // чтобы id не выдавались повторно, даже если удалены все партиции.
+            if (series == PARTITION_RAW) {
+                isDropped = isDropped && exec("UPDATE Partitions SET first_id = MAX(first_id, IFNULL((SELECT MAX(id) FROM " +
+                                              partition.name + "), 0) + 1) WHERE name = '" + partition.name + "';");
+            }
+            isDropped = isDropped && exec("DROP TABLE IF EXISTS " + partition.name + ";") &&
+                        exec("UPDATE Partitions SET is_dropped = 1 WHERE name = '" + partition.name + "';");
+        }
+        if (!isDropped) {
+            exec("ROLLBACK TO drop_partitions;");
+            exec("RELEASE drop_partitions;");
+            return 0;
+        }
+        live[series].erase(live[series].begin(), live[series].begin() + (long)expired.size());
+        if (!rebuildView(series) || !exec("RELEASE drop_partitions;")) {
+            refresh(true);
+            return 0;
+        }
+        refresh(true);
+        return (int)expired.size();
+    }
+
+    // SELECT `columns` из каждой живой партиции серии, пересекающей [rangeStart, rangeEnd],
+    // через UNION ALL; `where` добавляется к каждой части и может ссылаться на параметры
+    // ?NNN — они общие для всех частей. Если подходящих партиций нет, возвращает запрос с
+    // теми же параметрами и столбцами, но без строк. Пустая граница — без ограничения.
+    std::string unionQuery(PartitionSeries series, const std::string &columns, const std::string &where,
+                           const std::string &rangeStart, const std::string &rangeEnd) const {
+        std::string query;
+        for (const Partition &partition : live[series]) {
+            if ((!rangeEnd.empty() && partition.rangeStart > rangeEnd) || (!rangeStart.empty() && partition.rangeEnd <= rangeStart)) {
+                continue;
+            }
+            if (!query.empty()) {
+                query += " UNION ALL ";
+            }
+            query += "SELECT " + columns + " FROM " + partition.name + " WHERE " + where;
+        }
+        if (query.empty()) {
+            // Через каталог, а не через SELECT без FROM: запрос без таблиц не проверяет
+            // версию схемы, и подготовленный по пустому представлению так и остался бы пустым.
+            query = "SELECT " + columns + " FROM (SELECT NULL AS id, NULL AS timestamp, NULL AS " +
+                    PARTITION_SERIES_INFO[series].valueColumn + " FROM Partitions WHERE 0) WHERE " + where;
+        }
+        return query;
+    }
+
+    // Живые партиции серии от старых к новым.
+    const std::vector<Partition> &partitions(PartitionSeries series) const {
+        return live[series];
+    }
+
+    long long nextId() const { return nextRawId; }
+
+private:
+    bool exec(const std::string &sql) {
+        char *errMsg = nullptr;
+        if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK) {
+            std::cerr << "Ошибка " << sql.substr(0, 80) << ": " << errMsg << std::endl;
+            sqlite3_free(errMsg);
+            return false;
+        }
+        return true;
+    }
+
+    void resetInsertStatements() {
+        for (int series = 0; series < PARTITION_SERIES_COUNT; ++series) {
+            sqlite3_finalize(insertStatements[series]);
+            insertStatements[series] = nullptr;
+            insertPartitions[series] = Partition();
+        }
+    }
+
+    bool findPartition(PartitionSeries series, const std::string &name) const {
+        for (const Partition &partition : live[series]) {
+            if (partition.name == name) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool createPartitionTable(PartitionSeries series, const Partition &partition, long long firstId) {
+        const PartitionSeriesInfo &info = PARTITION_SERIES_INFO[series];
+        std::string createCmd = "CREATE TABLE IF NOT EXISTS " + partition.name + " (" +
+                                "id INTEGER PRIMARY KEY," +
+                                "timestamp TEXT NOT NULL," + info.valueColumn + " REAL NOT NULL);";
+        std::string indexCmd = "CREATE INDEX IF NOT EXISTS " + partition.name + "_timestamp ON " + partition.name + " (timestamp);";
+        std::string catalogCmd = "INSERT OR REPLACE INTO Partitions (name, series, range_start, range_end, first_id, is_dropped) VALUES ('" +
+                                 partition.name + "', '" + info.name + "', '" + partition.rangeStart + "', '" + partition.rangeEnd +
+                                 "', " + std::to_string(firstId) + ", 0);";
+        if (!exec(createCmd) || !exec(indexCmd) || !exec(catalogCmd)) {
+            return false;
+        }
+        live[series].push_back(partition);
+        std::sort(live[series].begin(), live[series].end(),
+                  [](const Partition &a, const Partition &b) { return a.rangeStart < b.rangeStart; });
+        return true;
+    }
+
+    bool createPartition(PartitionSeries series, const Partition &partition) {
+        TRACE_SPAN("partition.create");
+        if (!exec("SAVEPOINT create_partition;")) {
+            return false;
+        }
+        if (!createPartitionTable(series, partition, series == PARTITION_RAW ? nextRawId : 0) || !rebuildView(series)) {
+            exec("ROLLBACK TO create_partition;");
+            exec("RELEASE create_partition;");
+            refresh(true);
+            return false;
+        }
+        return exec("RELEASE create_partition;");
+    }
+
+    // Представление с прежним именем таблицы поверх всех живых партиций.
+    bool rebuildView(PartitionSeries series) {
+        const PartitionSeriesInfo &info = PARTITION_SERIES_INFO[series];
+        std::string columns = std::string("id, timestamp, ") + info.valueColumn;
+        return exec(std::string("DROP VIEW IF EXISTS ") + info.baseTable + ";") &&
+               exec(std::string("CREATE VIEW ") + info.baseTable + " AS " + unionQuery(series, columns, "1", "", "") + ";");
+    }
+
+    // Прежняя таблица (до партиций) переносится в партиции целиком одной транзакцией.
+    bool migrateLegacyTable(PartitionSeries series) {
+        const PartitionSeriesInfo &info = PARTITION_SERIES_INFO[series];
+        std::string table = info.baseTable;
+        sqlite3_stmt *stmt;
+        std::string findCmd = "SELECT count(*) FROM sqlite_master WHERE type = 'table' AND name = '" + table + "';";
+        if (sqlite3_prepare_v2(db, findCmd.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+            return false;
+        }
+        bool hasLegacy = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) > 0;
+        sqlite3_finalize(stmt);
+        if (!hasLegacy) {
+            return true;
+        }
+
+        std::cout << "Перенос " << table << " в партиции..." << std::endl;
+        if (!exec("BEGIN IMMEDIATE;")) {
+            return false;
+        }
+        std::vector<std::string> keys;
+        std::string keysCmd = "SELECT DISTINCT substr(timestamp, 1, " + std::string(info.isDaily ? "10" : "7") + ") FROM " + table + ";";
+        if (sqlite3_prepare_v2(db, keysCmd.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                const unsigned char *key = sqlite3_column_text(stmt, 0);
+                keys.push_back(key != nullptr ? reinterpret_cast<const char *>(key) : "");
+            }
+        }
+        sqlite3_finalize(stmt);
+
+        long long total = 0;
+        std::string countCmd = "SELECT count(*) FROM " + table + ";";
+        if (sqlite3_prepare_v2(db, countCmd.c_str(), -1, &stmt, nullptr) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+            total = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+
+        bool isMigrated = true;
+        long long migrated = 0;
+        for (const std::string &key : keys) {
+            Partition partition;
+            if (!partitionFor(series, info.isDaily ? key : key + "-01", partition)) {
+                continue;
+            }
+            std::string range = " WHERE timestamp >= '" + partition.rangeStart + "' AND timestamp < '" + partition.rangeEnd + "'";
+            long long firstId = 0;
+            if (series == PARTITION_RAW) {
+                std::string firstIdCmd = "SELECT IFNULL(MIN(id), 0) FROM " + table + range + ";";
+                if (sqlite3_prepare_v2(db, firstIdCmd.c_str(), -1, &stmt, nullptr) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+                    firstId = sqlite3_column_int64(stmt, 0);
+                }
+                sqlite3_finalize(stmt);
+            }
+            if (!findPartition(series, partition.name) && !createPartitionTable(series, partition, firstId)) {
+                isMigrated = false;
+                break;
+            }
+            std::string copyCmd = "INSERT INTO " + partition.name + " (id, timestamp, " + info.valueColumn + ") SELECT id, timestamp, " +
+                                  info.valueColumn + " FROM " + table + range + ";";
+            if (!exec(copyCmd)) {
+                isMigrated = false;
+                break;
+            }
+            migrated += sqlite3_changes(db);
+        }
+        if (isMigrated && series == PARTITION_RAW) {
+            // AUTOINCREMENT не выдавал id повторно, даже удалённые: сохранить это.
+            long long lastId = 0;
+            std::string lastIdCmd = "SELECT MAX(IFNULL((SELECT seq FROM sqlite_sequence WHERE name = '" + table + "'), 0), "
+                                    "IFNULL((SELECT MAX(id) FROM " + table + "), 0));";
+            if (sqlite3_prepare_v2(db, lastIdCmd.c_str(), -1, &stmt, nullptr) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+                lastId = sqlite3_column_int64(stmt, 0);
+            }
+            sqlite3_finalize(stmt);
+            isMigrated = exec("INSERT OR REPLACE INTO Partitions (name, series, range_start, range_end, first_id, is_dropped) "
+                              "VALUES ('" + table + "', 'legacy', '', '', " + std::to_string(lastId + 1) + ", 1);");
+        }
+        isMigrated = isMigrated && exec("DROP TABLE " + table + ";");
+        if (!isMigrated) {
+            exec("ROLLBACK;");
+            refresh(true);
+            return false;
+        }
+        if (!exec("COMMIT;")) {
+            exec("ROLLBACK;");
+            refresh(true);
+            return false;
+        }
+        std::cout << "Перенесено строк: " << migrated;
+        if (migrated != total) {
+            std::cout << ", пропущено с неверной меткой времени: " << total - migrated;
+        }
+        std::cout << std::endl;
+        return true;
+    }
+
+    // Следующий сквозной id: больше всех выданных, включая строки удалённых партиций
+    // (их first_id при удалении поднимается за последнюю строку).
+    bool loadNextRawId() {
+        std::string lastIds = unionQuery(PARTITION_RAW, "MAX(id) AS lastId", "1", "", "");
+        std::string query = "SELECT MAX(IFNULL((SELECT MAX(first_id) FROM Partitions), 1), "
+                            "IFNULL((SELECT MAX(lastId) FROM (" + lastIds + ")), 0) + 1);";
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << "Ошибка чтения последнего id: " << sqlite3_errmsg(db) << std::endl;
+            return false;
+        }
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            nextRawId = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+        return true;
+    }
+
+    sqlite3 *db;
+    long long schemaVersion;
+    long long nextRawId;
+    std::vector<Partition> live[PARTITION_SERIES_COUNT];
+    sqlite3_stmt *insertStatements[PARTITION_SERIES_COUNT];
+    Partition insertPartitions[PARTITION_SERIES_COUNT];
+};
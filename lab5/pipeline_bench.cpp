@@ -0,0 +1,575 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <random>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include "sqlite3.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <poll.h>
+#include <spawn.h>
+#include <termios.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+extern char **environ;
+
+// Сквозной бенчмарк конвейера lab5: simulator -> pty -> main -> SQLite <- server <- HTTP.
+//
+// Бенчмарк создаёт pty и запускает main на её ведомой стороне, а simulator пишет с
+// заданной частотой в FIFO, который бенчмарк пересылает в pty. Между строками
+// симулятора вставляются пробные отсчёты с уникальными значениями; время от их записи в
+// pty до появления в базе — это свежесть данных. Одновременно несколько клиентов
+// нагружают server запросами /temperature, /stats и /history с разными диапазонами.
+// Итог печатается в stdout одним JSON-объектом для сравнения между версиями.
+
+struct BenchOptions {
+    std::string binDir;
+    double rate = 1000.0;
+    int sensors = 8;
+    double malformedShare = 0.0;
+    double durationSeconds = 10.0;
+    int clients = 4;
+    int httpPort = 18080;
+    double probeIntervalSeconds = 0.1;
+    bool keepWorkDir = false;
+};
+
+void printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [--bin-dir <dir>] [--rate <lines/s>] [--sensors <n>] [--malformed <share>]\n"
+              << "       [--duration <s>] [--clients <n>] [--http-port <port>] [--probe-interval <s>] [--keep]\n"
+              << "Prints a JSON report to stdout. --keep leaves the work directory with the database and logs." << std::endl;
+}
+
+bool parseOptions(int argc, char **argv, BenchOptions &options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--keep") {
+            options.keepWorkDir = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const char *value = argv[++i];
+        if (option == "--bin-dir") {
+            options.binDir = value;
+        } else if (option == "--rate") {
+            options.rate = std::atof(value);
+        } else if (option == "--sensors") {
+            options.sensors = std::atoi(value);
+        } else if (option == "--malformed") {
+            options.malformedShare = std::atof(value);
+        } else if (option == "--duration") {
+            options.durationSeconds = std::atof(value);
+        } else if (option == "--clients") {
+            options.clients = std::max(1, std::atoi(value));
+        } else if (option == "--http-port") {
+            options.httpPort = std::atoi(value);
+        } else if (option == "--probe-interval") {
+            options.probeIntervalSeconds = std::atof(value);
+        } else {
+            return false;
+        }
+    }
+    return options.durationSeconds > 0 && options.probeIntervalSeconds > 0;
+}
+
+std::string executableDirectory() {
+    char path[4096];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length <= 0) {
+        return ".";
+    }
+    std::string directory(path, length);
+    return directory.substr(0, directory.find_last_of('/'));
+}
+
+static int removeEntry(const char *path, const struct stat *, int, struct FTW *) {
+    return remove(path);
+}
+
+// Удаляет рабочий каталог прогона при выходе из main, если не задан --keep.
+struct WorkDirCleanup {
+    std::string path;
+    bool keep;
+
+    ~WorkDirCleanup() {
+        if (keep) {
+            std::cerr << "Рабочий каталог сохранён: " << path << std::endl;
+        } else if (nftw(path.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS) != 0) {
+            std::cerr << "Не удалось удалить рабочий каталог " << path << ": " << strerror(errno) << std::endl;
+        }
+    }
+};
+
+// Запускает программу с stdout/stderr в файл `logPath`.
+pid_t spawnProcess(const std::vector<std::string> &arguments, const std::string &logPath) {
+    std::vector<char *> argv;
+    for (const auto &argument : arguments) {
+        argv.push_back(const_cast<char *>(argument.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, logPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+    pid_t pid = -1;
+    int status = posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (status != 0) {
+        std::cerr << "Не удалось запустить " << arguments[0] << ": " << strerror(status) << std::endl;
+        return -1;
+    }
+    return pid;
+}
+
+void stopProcess(pid_t pid) {
+    if (pid > 0) {
+        kill(pid, SIGTERM);
+        waitpid(pid, nullptr, 0);
+    }
+}
+
+struct LatencySummary {
+    size_t count = 0;
+    double p50 = 0, p99 = 0, p999 = 0, max = 0, mean = 0;
+};
+
+// Перцентили по отсортированной копии, в миллисекундах.
+LatencySummary summarize(std::vector<double> values) {
+    LatencySummary summary;
+    summary.count = values.size();
+    if (values.empty()) {
+        return summary;
+    }
+    std::sort(values.begin(), values.end());
+    auto at = [&values](double q) {
+        size_t index = (size_t)(q * (values.size() - 1) + 0.5);
+        return values[std::min(index, values.size() - 1)];
+    };
+    summary.p50 = at(0.5);
+    summary.p99 = at(0.99);
+    summary.p999 = at(0.999);
+    summary.max = values.back();
+    double total = 0;
+    for (double value : values) {
+        total += value;
+    }
+    summary.mean = total / values.size();
+    return summary;
+}
+
+void writeSummary(std::ostream &out, const LatencySummary &summary) {
+    out << "{\"count\": " << summary.count << std::fixed << std::setprecision(3)
+        << ", \"mean_ms\": " << summary.mean << ", \"p50_ms\": " << summary.p50
+        << ", \"p99_ms\": " << summary.p99 << ", \"p999_ms\": " << summary.p999
+        << ", \"max_ms\": " << summary.max << "}";
+}
+
+// ---- HTTP-нагрузка -------------------------------------------------------------
+
+struct EndpointStats {
+    std::vector<double> latenciesMs;
+    size_t errors = 0;
+    size_t bytes = 0;
+};
+
+// Один запрос на отдельном соединении, как его делает дашборд: сервер отвечает и
+// закрывает соединение. Возвращает HTTP-код или -1 при сетевой ошибке.
+int httpGet(int port, const std::string &path, size_t &bytes) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    timeval timeout = {5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+    if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != (ssize_t)request.size()) {
+        close(fd);
+        return -1;
+    }
+
+    std::string response;
+    char buffer[16384];
+    ssize_t received;
+    while ((received = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        response.append(buffer, received);
+    }
+    close(fd);
+    bytes = response.size();
+    if (received < 0 || response.compare(0, 9, "HTTP/1.1 ") != 0) {
+        return -1;
+    }
+    return std::atoi(response.c_str() + 9);
+}
+
+std::string minuteStamp(std::chrono::system_clock::time_point time) {
+    std::time_t seconds = std::chrono::system_clock::to_time_t(time);
+    std::tm local{};
+    localtime_r(&seconds, &local);
+    char text[32];
+    std::strftime(text, sizeof(text), "%Y-%m-%dT%H%%3A%M", &local);
+    return text;
+}
+
+// Смесь запросов: половина /temperature, четверть /stats, четверть /history с окном от
+// минуты до суток.
+std::string pickRequest(std::mt19937 &generator, std::string &endpoint) {
+    unsigned choice = generator() % 4;
+    if (choice < 2) {
+        endpoint = "/temperature";
+        return endpoint;
+    }
+    if (choice == 2) {
+        endpoint = "/stats";
+        return endpoint;
+    }
+    static const int windowsMinutes[] = {1, 10, 60, 24 * 60};
+    int window = windowsMinutes[generator() % 4];
+    auto now = std::chrono::system_clock::now();
+    endpoint = "/history";
+    return "/history?start_datetime=" + minuteStamp(now - std::chrono::minutes(window)) +
+           "&end_datetime=" + minuteStamp(now + std::chrono::minutes(1));
+}
+
+void loadClient(int port, unsigned seed, const std::atomic_bool &isRunning, std::map<std::string, EndpointStats> &stats) {
+    std::mt19937 generator(seed);
+    std::string endpoint;
+    while (isRunning) {
+        std::string path = pickRequest(generator, endpoint);
+        size_t bytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        int status = httpGet(port, path, bytes);
+        double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        EndpointStats &endpointStats = stats[endpoint];
+        if (status == 200) {
+            endpointStats.latenciesMs.push_back(elapsedMs);
+            endpointStats.bytes += bytes;
+        } else {
+            endpointStats.errors++;
+        }
+    }
+}
+
+// ---- Подача данных и свежесть --------------------------------------------------
+
+struct Probe {
+    double value;
+    std::chrono::steady_clock::time_point sentAt;
+};
+
+struct FeedState {
+    std::mutex mutex;
+    std::map<int, Probe> pendingProbes;
+    std::vector<double> freshnessMs;
+    std::atomic<unsigned long long> linesForwarded{0};
+    std::atomic<unsigned long long> probesSent{0};
+};
+
+bool writeAll(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+// Пересылает строки симулятора из FIFO в pty и на границах строк вставляет пробы
+// "-99.NNNN" — значение, которого симулятор никогда не выдаёт.
+void forwardFeed(int fifoFd, int ptyFd, double probeIntervalSeconds, FeedState &state) {
+    std::string carry;
+    char buffer[65536];
+    int nextProbeId = 0;
+    auto probeInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(probeIntervalSeconds));
+    auto nextProbe = std::chrono::steady_clock::now() + probeInterval;
+
+    while (true) {
+        ssize_t received = read(fifoFd, buffer, sizeof(buffer));
+        if (received <= 0) {
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        carry.append(buffer, received);
+        size_t lastNewline = carry.find_last_of('\n');
+        if (lastNewline == std::string::npos) {
+            continue;
+        }
+        if (!writeAll(ptyFd, carry.data(), lastNewline + 1)) {
+            break;
+        }
+        state.linesForwarded += std::count(carry.begin(), carry.begin() + lastNewline + 1, '\n');
+        carry.erase(0, lastNewline + 1);
+
+        auto now = std::chrono::steady_clock::now();
+        if (now >= nextProbe) {
+            int probeId = nextProbeId++ % 10000;
+            char line[32];
+            int length = std::snprintf(line, sizeof(line), "-99.%04d\n", probeId);
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                state.pendingProbes[probeId] = Probe{std::strtod(line, nullptr), std::chrono::steady_clock::now()};
+            }
+            if (!writeAll(ptyFd, line, length)) {
+                break;
+            }
+            state.probesSent++;
+            nextProbe = now + probeInterval;
+        }
+    }
+}
+
+// Опрашивает базу тем же способом, что и server, и отмечает, когда проба стала видна.
+void watchFreshness(const std::string &databasePath, const std::atomic_bool &isRunning, FeedState &state) {
+    sqlite3 *db = nullptr;
+    while (isRunning && sqlite3_open_v2(databasePath.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+        sqlite3_close(db);
+        db = nullptr;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (db == nullptr) {
+        return;
+    }
+    sqlite3_busy_timeout(db, 100);
+
+    sqlite3_stmt *stmt = nullptr;
+    sqlite3_int64 lastId = 0;
+    while (isRunning) {
+        if (stmt == nullptr &&
+            sqlite3_prepare_v2(db, "SELECT id, temperature FROM TemperatureLogs WHERE id > ? AND temperature <= -99.0 AND temperature > -100.0 ORDER BY id;",
+                               -1, &stmt, nullptr) != SQLITE_OK) {
+            sqlite3_finalize(stmt);
+            stmt = nullptr;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        sqlite3_bind_int64(stmt, 1, lastId);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            lastId = sqlite3_column_int64(stmt, 0);
+            double value = sqlite3_column_double(stmt, 1);
+            auto seenAt = std::chrono::steady_clock::now();
+            std::lock_guard<std::mutex> lock(state.mutex);
+            for (auto it = state.pendingProbes.begin(); it != state.pendingProbes.end(); ++it) {
+                if (it->second.value == value) {
+                    state.freshnessMs.push_back(std::chrono::duration<double, std::milli>(seenAt - it->second.sentAt).count());
+                    state.pendingProbes.erase(it);
+                    break;
+                }
+            }
+        }
+        sqlite3_reset(stmt);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+}
+
+long long countRows(const std::string &databasePath, const char *query) {
+    sqlite3 *db = nullptr;
+    long long rows = -1;
+    if (sqlite3_open_v2(databasePath.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK) {
+        sqlite3_stmt *stmt = nullptr;
+        if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+            rows = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return rows;
+}
+
+int main(int argc, char **argv) {
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (options.binDir.empty()) {
+        options.binDir = executableDirectory();
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    // main и server работают с temperature_logs.db в текущем каталоге, поэтому каждый
+    // прогон идёт в своём временном каталоге.
+    char workDirTemplate[] = "/tmp/pipeline_bench.XXXXXX";
+    if (mkdtemp(workDirTemplate) == nullptr || chdir(workDirTemplate) != 0) {
+        perror("Не удалось создать рабочий каталог");
+        return EXIT_FAILURE;
+    }
+    std::string workDir = workDirTemplate;
+    WorkDirCleanup cleanup = {workDir, options.keepWorkDir};
+    std::string databasePath = workDir + "/temperature_logs.db";
+    std::cerr << "Рабочий каталог: " << workDir << std::endl;
+
+    int ptyFd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (ptyFd == -1 || grantpt(ptyFd) != 0 || unlockpt(ptyFd) != 0) {
+        perror("Ошибка создания pty");
+        return EXIT_FAILURE;
+    }
+    std::string slaveName = ptsname(ptyFd);
+    // Ведомая сторона держится открытой в raw-режиме, пока main не подключится.
+    int slaveFd = open(slaveName.c_str(), O_RDWR | O_NOCTTY);
+    termios terminalOptions;
+    if (slaveFd != -1 && tcgetattr(slaveFd, &terminalOptions) == 0) {
+        cfmakeraw(&terminalOptions);
+        tcsetattr(slaveFd, TCSANOW, &terminalOptions);
+    }
+
+    std::string fifoPath = workDir + "/feed";
+    if (mkfifo(fifoPath.c_str(), 0600) != 0) {
+        perror("Ошибка создания FIFO");
+        return EXIT_FAILURE;
+    }
+
+    // Порт уведомлений /stream — следующий за HTTP, чтобы не пересекаться с запущенным server.
+    std::string eventPort = std::to_string(options.httpPort + 1);
+    pid_t mainPid = spawnProcess({options.binDir + "/main", slaveName, eventPort}, workDir + "/main.log");
+    pid_t serverPid = spawnProcess({options.binDir + "/server", std::to_string(options.httpPort), eventPort}, workDir + "/server.log");
+    if (mainPid <= 0 || serverPid <= 0) {
+        stopProcess(mainPid);
+        stopProcess(serverPid);
+        return EXIT_FAILURE;
+    }
+    // Дать main создать таблицы, а server — начать слушать порт.
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    std::ostringstream rate, sensors, malformed, duration;
+    rate << options.rate;
+    sensors << options.sensors;
+    malformed << options.malformedShare;
+    duration << options.durationSeconds;
+    pid_t simulatorPid = spawnProcess({options.binDir + "/simulator", "--fifo", fifoPath, "--rate", rate.str(),
+                                       "--sensors", sensors.str(), "--malformed", malformed.str(),
+                                       "--duration", duration.str()},
+                                      workDir + "/simulator.log");
+    int fifoFd = open(fifoPath.c_str(), O_RDONLY);
+    if (simulatorPid <= 0 || fifoFd == -1) {
+        stopProcess(simulatorPid);
+        stopProcess(mainPid);
+        stopProcess(serverPid);
+        return EXIT_FAILURE;
+    }
+
+    FeedState feed;
+    std::atomic_bool isRunning(true);
+    auto start = std::chrono::steady_clock::now();
+    std::thread forwarder(forwardFeed, fifoFd, ptyFd, options.probeIntervalSeconds, std::ref(feed));
+    std::thread freshness(watchFreshness, databasePath, std::cref(isRunning), std::ref(feed));
+
+    std::vector<std::map<std::string, EndpointStats>> clientStats(options.clients);
+    std::vector<std::thread> clients;
+    for (int i = 0; i < options.clients; ++i) {
+        clients.emplace_back(loadClient, options.httpPort, 1000u + i, std::cref(isRunning), std::ref(clientStats[i]));
+    }
+
+    // Симулятор сам завершается по --duration, после чего FIFO закрывается и пересылка
+    // останавливается.
+    waitpid(simulatorPid, nullptr, 0);
+    forwarder.join();
+    double feedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Дать последним пробам дойти до базы.
+    for (int i = 0; i < 200; ++i) {
+        {
+            std::lock_guard<std::mutex> lock(feed.mutex);
+            if (feed.pendingProbes.empty()) {
+                break;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    isRunning = false;
+    for (auto &client : clients) {
+        client.join();
+    }
+    double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    freshness.join();
+
+    stopProcess(mainPid);
+    stopProcess(serverPid);
+    close(fifoFd);
+    close(ptyFd);
+    if (slaveFd != -1) {
+        close(slaveFd);
+    }
+
+    long long rowsStored = countRows(databasePath, "SELECT COUNT(*) FROM TemperatureLogs;");
+    std::map<std::string, EndpointStats> endpoints;
+    EndpointStats total;
+    for (const auto &stats : clientStats) {
+        for (const auto &entry : stats) {
+            EndpointStats &merged = endpoints[entry.first];
+            merged.latenciesMs.insert(merged.latenciesMs.end(), entry.second.latenciesMs.begin(), entry.second.latenciesMs.end());
+            merged.errors += entry.second.errors;
+            merged.bytes += entry.second.bytes;
+            total.latenciesMs.insert(total.latenciesMs.end(), entry.second.latenciesMs.begin(), entry.second.latenciesMs.end());
+            total.errors += entry.second.errors;
+            total.bytes += entry.second.bytes;
+        }
+    }
+
+    std::ostream &out = std::cout;
+    out << std::fixed << std::setprecision(3);
+    out << "{\n  \"config\": {\"rate\": " << options.rate << ", \"sensors\": " << options.sensors
+        << ", \"malformed\": " << options.malformedShare << ", \"duration_s\": " << options.durationSeconds
+        << ", \"clients\": " << options.clients << ", \"probe_interval_s\": " << options.probeIntervalSeconds << "},\n";
+    out << "  \"ingest\": {\"lines_forwarded\": " << feed.linesForwarded.load() << ", \"probes_sent\": " << feed.probesSent.load()
+        << ", \"rows_stored\": " << rowsStored << ", \"feed_seconds\": " << feedSeconds
+        << ", \"forwarded_lines_per_s\": " << feed.linesForwarded.load() / feedSeconds
+        << ", \"stored_rows_per_s\": " << rowsStored / feedSeconds << "},\n";
+    {
+        std::lock_guard<std::mutex> lock(feed.mutex);
+        out << "  \"freshness\": ";
+        writeSummary(out, summarize(feed.freshnessMs));
+        out << ",\n  \"probes_lost\": " << feed.pendingProbes.size() << ",\n";
+    }
+    out << "  \"http\": {\n    \"total\": {\"requests\": " << total.latenciesMs.size() << ", \"errors\": " << total.errors
+        << ", \"requests_per_s\": " << total.latenciesMs.size() / loadSeconds << ", \"latency\": ";
+    writeSummary(out, summarize(total.latenciesMs));
+    out << "}";
+    for (const auto &entry : endpoints) {
+        out << ",\n    \"" << entry.first << "\": {\"requests\": " << entry.second.latenciesMs.size()
+            << ", \"errors\": " << entry.second.errors << ", \"bytes\": " << entry.second.bytes << ", \"latency\": ";
+        writeSummary(out, summarize(entry.second.latenciesMs));
+        out << "}";
+    }
+    out << "\n  }\n}" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -6,7 +6,20 @@
 #include <chrono>
 #include <fstream>
 #include <ctime>
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <iterator>
+#include "ingest_events.hpp"
 #include "com.hpp"
+#include "compression.hpp"
+#include "server_metrics.hpp"
+#include "timestamp.hpp"
+#include "trace.hpp"
+#include "storage_profile.hpp"
+#include "partitions.hpp"
 #include "sqlite3.h"
 
 #ifdef _WIN32
@@ -15,16 +28,14 @@
 #pragma comment(lib, "ws2_32.lib")
 #else
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <poll.h>
+#include <signal.h>
 #endif
 
-struct TempLogEntry {
-    std::chrono::system_clock::time_point logTime;
-    double tempValue;
-};
-
 void setupNetwork() {
 #ifdef _WIN32
     WSADATA wsaData;
@@ -50,136 +61,1160 @@ void closeConnection(int socketId) {
 #endif
 }
 
-std::string formatTimestamp(const std::chrono::system_clock::time_point &logTime) {
-    auto timeT = std::chrono::system_clock::to_time_t(logTime);
-    std::tm tmStruct = *std::localtime(&timeT);
-    std::ostringstream oss;
-    oss << std::put_time(&tmStruct, "%Y-%m-%d %H:%M:%S");
-    return oss.str();
+#ifdef _WIN32
+int pollSockets(std::vector<pollfd> &descriptors, int timeoutMs) {
+    return WSAPoll(descriptors.data(), (ULONG)descriptors.size(), timeoutMs);
 }
 
-void storeTemperature(sqlite3 *db, const TempLogEntry &entry) {
-    const char *insertCmd = "INSERT INTO TemperatureLogs (timestamp, temperature) VALUES (?, ?);";
-    sqlite3_stmt *stmt;
-    if (sqlite3_prepare_v2(db, insertCmd, -1, &stmt, nullptr) != SQLITE_OK) {
-        std::cerr << "Ошибка подготовки команды: " << sqlite3_errmsg(db) << std::endl;
-        return;
+void setNonBlocking(int socketId) {
+    u_long nonBlocking = 1;
+    ioctlsocket(socketId, FIONBIO, &nonBlocking);
+}
+
+bool wouldBlock() {
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+}
+#else
+int pollSockets(std::vector<pollfd> &descriptors, int timeoutMs) {
+    return poll(descriptors.data(), descriptors.size(), timeoutMs);
+}
+
+void setNonBlocking(int socketId) {
+    fcntl(socketId, F_SETFL, fcntl(socketId, F_GETFL) | O_NONBLOCK);
+}
+
+bool wouldBlock() {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+#endif
+
+// Отправляет два буфера одним системным вызовом (writev / WSASend). Возвращает число
+// отправленных байт, 0 если буфер сокета полон, -1 если соединение разорвано.
+long sendBuffers(int socketId, const std::string &first, const std::string &second) {
+#ifdef _WIN32
+    WSABUF buffers[2];
+    buffers[0].buf = const_cast<char *>(first.data());
+    buffers[0].len = (ULONG)first.size();
+    buffers[1].buf = const_cast<char *>(second.data());
+    buffers[1].len = (ULONG)second.size();
+    DWORD sent = 0;
+    if (WSASend(socketId, first.empty() ? buffers + 1 : buffers, first.empty() ? 1 : 2, &sent, 0, NULL, NULL) == SOCKET_ERROR) {
+        return wouldBlock() ? 0 : -1;
     }
-    std::string timestampStr = formatTimestamp(entry.logTime);
-    sqlite3_bind_text(stmt, 1, timestampStr.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_double(stmt, 2, entry.tempValue);
-    if (sqlite3_step(stmt) != SQLITE_DONE) {
-        std::cerr << "Ошибка выполнения команды: " << sqlite3_errmsg(db) << std::endl;
+    return (long)sent;
+#else
+    struct iovec buffers[2];
+    buffers[0].iov_base = const_cast<char *>(first.data());
+    buffers[0].iov_len = first.size();
+    buffers[1].iov_base = const_cast<char *>(second.data());
+    buffers[1].iov_len = second.size();
+    ssize_t sent = writev(socketId, first.empty() ? buffers + 1 : buffers, first.empty() ? 1 : 2);
+    if (sent < 0) {
+        return wouldBlock() ? 0 : -1;
+    }
+    return (long)sent;
+#endif
+}
+
+const size_t MAX_STREAM_BACKLOG = 64 * 1024;
+const int STREAM_HEARTBEAT_INTERVAL_MS = 15000;
+
+// Подписчики /stream (Server-Sent Events). Каждое событие сериализуется один раз в общий
+// буфер, и каждому подписчику он уходит одним writev вместе с тем, что тот не успел
+// дочитать раньше, — без запросов к базе. Подписчик, у которого недоставленных данных
+// накопилось больше MAX_STREAM_BACKLOG, отключается, чтобы медленный клиент не держал память.
+class LiveStream {
+public:
+    // Отвечает на GET /stream и оставляет соединение открытым. Новый подписчик сразу
+    // получает последнее событие, чтобы не ждать следующего отсчёта.
+    void subscribe(int socketId) {
+        setNonBlocking(socketId);
+        Subscriber subscriber = { socketId, std::string() };
+        std::string greeting =
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: text/event-stream\r\n"
+            "Cache-Control: no-cache\r\n"
+            "Connection: keep-alive\r\n"
+            "Access-Control-Allow-Origin: *\r\n"
+            "\r\n"
+            "retry: 3000\n\n";
+        if (deliver(subscriber, greeting, lastEvent)) {
+            subscribers.push_back(subscriber);
+            adjustGauge(METRIC_STREAM_SUBSCRIBERS, 1);
+        } else {
+            closeConnection(socketId);
+            adjustGauge(METRIC_ACTIVE_CONNECTIONS, -1);
+        }
+    }
+
+    // Рассылает пачку событий, пришедших за одну итерацию цикла, одним буфером.
+    void publish(const std::vector<IngestEvent> &events) {
+        if (events.empty()) {
+            return;
+        }
+        TRACE_SPAN("stream.publish");
+        message.clear();
+        for (const IngestEvent &event : events) {
+            std::string id = std::to_string(event.id);
+            lastEvent = "id: " + id + "\ndata: {\"id\": " + id + ", \"timestamp\": \"" + event.timestamp +
+                        "\", \"temperature\": " + event.temperature + "}\n\n";
+            message += lastEvent;
+        }
+        countMetric(METRIC_STREAM_EVENTS, events.size());
+        broadcast(message);
+    }
+
+    // SSE-комментарий раз в STREAM_HEARTBEAT_INTERVAL_MS не даёт прокси закрыть простаивающее
+    // соединение и выявляет клиентов, которые ушли без FIN.
+    void heartbeat() {
+        static const std::string comment = ":\n\n";
+        broadcast(comment);
+    }
+
+    // Дескрипторы подписчиков для poll: чтение ловит закрытие соединения клиентом,
+    // запись нужна только тем, у кого остались недоставленные данные.
+    void appendPollDescriptors(std::vector<pollfd> &descriptors) const {
+        for (const Subscriber &subscriber : subscribers) {
+            pollfd descriptor;
+            descriptor.fd = subscriber.socketId;
+            descriptor.events = POLLIN | (subscriber.backlog.empty() ? 0 : POLLOUT);
+            descriptor.revents = 0;
+            descriptors.push_back(descriptor);
+        }
+    }
+
+    // `descriptors` — результат poll для дескрипторов из appendPollDescriptors, в том же порядке.
+    void handlePollResult(const pollfd *descriptors) {
+        static const std::string nothing;
+        for (size_t i = 0; i < subscribers.size(); ++i) {
+            Subscriber &subscriber = subscribers[i];
+            short revents = descriptors[i].revents;
+            if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                drop(subscriber);
+            } else if (revents & POLLIN) {
+                // Клиент SSE ничего не присылает, так что чтение означает закрытие или мусор.
+                char buffer[256];
+                if (recv(subscriber.socketId, buffer, sizeof(buffer), 0) <= 0) {
+                    drop(subscriber);
+                }
+            }
+            if (subscriber.socketId >= 0 && (revents & POLLOUT) && !deliver(subscriber, subscriber.backlog, nothing)) {
+                drop(subscriber);
+            }
+        }
+        removeDropped();
+    }
+
+    size_t size() const { return subscribers.size(); }
+
+private:
+    struct Subscriber {
+        int socketId;
+        std::string backlog;
+    };
+
+    void broadcast(const std::string &data) {
+        for (Subscriber &subscriber : subscribers) {
+            if (!deliver(subscriber, subscriber.backlog, data)) {
+                drop(subscriber);
+            }
+        }
+        removeDropped();
+    }
+
+    // Отправляет `head` и `tail` одним вызовом; неотправленный остаток становится новым
+    // backlog. `head` может быть самим subscriber.backlog.
+    bool deliver(Subscriber &subscriber, const std::string &head, const std::string &tail) {
+        if (head.empty() && tail.empty()) {
+            return true;
+        }
+        long sent = sendBuffers(subscriber.socketId, head, tail);
+        if (sent < 0) {
+            return false;
+        }
+        size_t total = head.size() + tail.size();
+        if (total - (size_t)sent > MAX_STREAM_BACKLOG) {
+            return false;
+        }
+        std::string rest;
+        if ((size_t)sent < head.size()) {
+            rest.assign(head, (size_t)sent, std::string::npos);
+            rest += tail;
+        } else {
+            rest.assign(tail, (size_t)sent - head.size(), std::string::npos);
+        }
+        subscriber.backlog.swap(rest);
+        return true;
+    }
+
+    void drop(Subscriber &subscriber) {
+        if (subscriber.socketId >= 0) {
+            closeConnection(subscriber.socketId);
+            subscriber.socketId = -1;
+            countMetric(METRIC_STREAM_DROPPED);
+            adjustGauge(METRIC_STREAM_SUBSCRIBERS, -1);
+            adjustGauge(METRIC_ACTIVE_CONNECTIONS, -1);
+        }
+    }
+
+    void removeDropped() {
+        subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(),
+                                         [](const Subscriber &subscriber) { return subscriber.socketId < 0; }),
+                          subscribers.end());
+    }
+
+    std::vector<Subscriber> subscribers;
+    std::string lastEvent;
+    std::string message;
+};
+
+// Читает все накопившиеся уведомления main, не блокируясь.
+void receiveIngestEvents(int eventSocket, std::vector<IngestEvent> &events) {
+    char datagram[MAX_INGEST_EVENT_SIZE];
+    while (true) {
+        long received = recv(eventSocket, datagram, sizeof(datagram), 0);
+        if (received < 0) {
+            return;
+        }
+        IngestEvent event;
+        if (parseIngestEvent(datagram, (size_t)received, event)) {
+            events.push_back(event);
+        }
+    }
+}
+
+int openEventSocket(int port) {
+#ifdef _WIN32
+    int eventSocket = (int)socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (eventSocket == (int)INVALID_SOCKET) {
+        return -1;
+    }
+#else
+    int eventSocket = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (eventSocket < 0) {
+        return -1;
+    }
+#endif
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (bind(eventSocket, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        closeConnection(eventSocket);
+        return -1;
+    }
+    setNonBlocking(eventSocket);
+    return eventSocket;
+}
+
+// Ответ до сериализации: кэш хранит его отдельно от заголовков, которые зависят от запроса.
+struct HttpResponse {
+    int status;
+    std::string contentType;
+    std::string body;
+};
+
+HttpResponse jsonResponse(const std::string &body) {
+    HttpResponse response = { 200, "application/json", body };
+    return response;
+}
+
+HttpResponse textResponse(int status, const std::string &body) {
+    HttpResponse response = { status, "text/plain", body };
+    return response;
+}
+
+const char *statusText(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    default: return "Internal Server Error";
     }
-    sqlite3_finalize(stmt);
 }
 
-std::string fetchHistoryEndpoint(sqlite3 *db, const std::string &startTime, const std::string &endTime) {
-    std::string query = "SELECT timestamp, temperature FROM TemperatureLogs WHERE timestamp BETWEEN ? AND ? ORDER BY id DESC;";
+// Заголовки ответа. contentLength < 0 — тело уходит чанками (Transfer-Encoding: chunked).
+// `etag` пустой — ответ без ETag; ETag и Vary ставятся только ответам с данными.
+std::string serializeHead(const HttpResponse &response, long long contentLength, ContentEncoding encoding, const std::string &etag) {
+    std::string head = "HTTP/1.1 " + std::to_string(response.status) + " " + statusText(response.status) + "\r\n";
+    if (response.status != 304) {
+        head += "Content-Type: " + response.contentType + "\r\n";
+        if (contentLength >= 0) {
+            head += "Content-Length: " + std::to_string(contentLength) + "\r\n";
+        } else {
+            head += "Transfer-Encoding: chunked\r\n";
+        }
+        if (encoding != ENCODING_IDENTITY) {
+            head += std::string("Content-Encoding: ") + encodingName(encoding) + "\r\n";
+        }
+    }
+    if (!etag.empty()) {
+        // no-cache: браузер хранит ответ, но каждый раз перепроверяет его через If-None-Match.
+        head += "ETag: " + etag + "\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\n";
+    }
+    head += "\r\n";
+    return head;
+}
+
+// Обычный (не /stream) запрос клиента: сокет и то, что нужно для метрик и журнала.
+struct ClientRequest {
+    int socketId;
+    std::chrono::steady_clock::time_point acceptedAt;
+    int status;
+    size_t bytesOut;
+    // Часть ответа, которую сокет не принял сразу; её досылает HttpConnections.
+    std::string pending;
+};
+
+// Отправляет в неблокирующий сокет сколько тот примет. Возвращает число байт или -1,
+// если клиент отключился. Первый отправленный байт отмечает время ответа для
+// server_first_byte_seconds.
+long sendAvailable(ClientRequest &client, const char *data, size_t size) {
+    size_t total = 0;
+    while (total < size) {
+        long sent = send(client.socketId, data + total, (int)std::min<size_t>(size - total, 1 << 30), 0);
+        if (sent < 0 && wouldBlock()) {
+            break;
+        }
+        if (sent <= 0) {
+            return -1;
+        }
+        if (client.bytesOut == 0) {
+            recordMetric(METRIC_FIRST_BYTE_NS, elapsedNs(client.acceptedAt));
+        }
+        client.bytesOut += (size_t)sent;
+        total += (size_t)sent;
+    }
+    return (long)total;
+}
+
+// Ставит данные в очередь ответа: что не уходит сразу, копится в client.pending и
+// досылается из цикла poll, так что медленный читатель не останавливает сервер.
+// false — клиент отключился.
+bool sendAll(ClientRequest &client, const char *data, size_t size) {
+    if (client.pending.empty()) {
+        long sent = sendAvailable(client, data, size);
+        if (sent < 0) {
+            return false;
+        }
+        data += sent;
+        size -= (size_t)sent;
+    }
+    client.pending.append(data, size);
+    return true;
+}
+
+// Сильный ETag: 64-битный FNV-1a от тела ответа.
+std::string computeETag(const std::string &body) {
+    unsigned long long hash = 14695981039346656037ULL;
+    for (unsigned char c : body) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    char etag[24];
+    std::snprintf(etag, sizeof(etag), "\"%016llx\"", hash);
+    return etag;
+}
+
+// Сжатые представления — другие байты, поэтому у них свой сильный ETag.
+std::string representationETag(const std::string &etag, ContentEncoding encoding) {
+    if (encoding == ENCODING_IDENTITY) {
+        return etag;
+    }
+    return etag.substr(0, etag.size() - 1) + "-" + encodingName(encoding) + "\"";
+}
+
+// Закэшированный ответ сжимается один раз и лучше, чем поток, который сжимается на
+// лету для каждого запроса.
+int compressionLevel(ContentEncoding encoding, bool isCached) {
+    if (encoding == ENCODING_ZSTD) {
+        return isCached ? 9 : 1;
+    }
+    return isCached ? 6 : 1;
+}
+
+const size_t STREAM_CHUNK_SIZE = 64 * 1024;
+
+// sqlite3_prepare_v2 с замером для server_sql_prepare_seconds.
+int prepareStatement(sqlite3 *db, const char *sql, sqlite3_stmt **stmt) {
+    TRACE_SPAN("sql.prepare");
+    auto start = std::chrono::steady_clock::now();
+    int status = sqlite3_prepare_v2(db, sql, -1, stmt, nullptr);
+    recordMetric(METRIC_SQL_PREPARE_NS, elapsedNs(start));
+    return status;
+}
+
+// Время выполнения одного запроса от первого шага до конца сборки ответа: сумма
+// sqlite3_step идёт в server_sql_step_seconds, остальное — в server_serialize_seconds.
+class StatementTimer {
+public:
+    StatementTimer() : startedAt(std::chrono::steady_clock::now()), stepNs(0) {}
+
+    ~StatementTimer() {
+        uint64_t totalNs = elapsedNs(startedAt);
+        recordMetric(METRIC_SQL_STEP_NS, stepNs);
+        recordMetric(METRIC_SERIALIZE_NS, totalNs > stepNs ? totalNs - stepNs : 0);
+    }
+
+    int step(sqlite3_stmt *stmt) {
+        auto start = std::chrono::steady_clock::now();
+        int status = sqlite3_step(stmt);
+        stepNs += elapsedNs(start);
+        return status;
+    }
+
+private:
+    std::chrono::steady_clock::time_point startedAt;
+    uint64_t stepNs;
+};
+
+HttpResponse fetchHistoryEndpoint(sqlite3 *db, const PartitionStore &partitions, const std::string &startTime, const std::string &endTime) {
+    TRACE_SPAN("query.history");
+    std::string query = "SELECT timestamp, temperature FROM (" +
+                        partitions.unionQuery(PARTITION_RAW, "id, timestamp, temperature", "timestamp BETWEEN ?1 AND ?2", startTime, endTime) +
+                        ") ORDER BY id DESC;";
     sqlite3_stmt *stmt;
-    if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
-        return "HTTP/1.1 500 Internal Server Error\r\nContent-Type: text/plain\r\n\r\nDatabase error.";
+    if (prepareStatement(db, query.c_str(), &stmt) != SQLITE_OK) {
+        return textResponse(500, "Database error.");
     }
+    StatementTimer timer;
     sqlite3_bind_text(stmt, 1, startTime.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 2, endTime.c_str(), -1, SQLITE_STATIC);
-    std::string response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n[";
+    std::string body = "[";
     bool isFirst = true;
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
+    while (timer.step(stmt) == SQLITE_ROW) {
         if (!isFirst) {
-            response += ",";
+            body += ",";
         }
         isFirst = false;
-        response += "{";
-        response += "\"timestamp\": \"" + std::string(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0))) + "\",";
-        response += "\"temperature\": " + std::to_string(sqlite3_column_double(stmt, 1));
-        response += "}";
+        body += "{";
+        body += "\"timestamp\": \"" + std::string(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0))) + "\",";
+        body += "\"temperature\": " + std::to_string(sqlite3_column_double(stmt, 1));
+        body += "}";
     }
-    response += "]";
+    body += "]";
     sqlite3_finalize(stmt);
-    return response;
+    return jsonResponse(body);
+}
+
+const long long DEFAULT_HISTORY_PAGE = 1000;
+const long long MAX_HISTORY_PAGE = 10000;
+
+// Инкрементальная выборка для /history с since_id / since_ts / limit: строки с id больше
+// sinceId (и временем позже sinceTs, если задано) в порядке возрастания, не больше limit.
+// next_since_id — курсор для следующего запроса: при has_more это id последней строки,
+// иначе наибольший id в таблице на момент запроса, чтобы повторный опрос без новых
+// данных ничего не сканировал заново. Стоимость запроса пропорциональна новым строкам.
+HttpResponse fetchHistorySinceEndpoint(sqlite3 *db, const PartitionStore &partitions, const std::string &startTime,
+                                       const std::string &endTime, long long sinceId, const std::string &sinceTs, long long limit) {
+    TRACE_SPAN("query.history_since");
+    long long maxId = 0;
+    sqlite3_stmt *stmt;
+    std::string maxIdQuery = "SELECT IFNULL(MAX(lastId), 0) FROM (" + partitions.unionQuery(PARTITION_RAW, "MAX(id) AS lastId", "1", "", "") + ");";
+    if (prepareStatement(db, maxIdQuery.c_str(), &stmt) != SQLITE_OK) {
+        return textResponse(500, "Database error.");
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        maxId = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+
+    // Партиции целиком раньше since_ts или start_datetime в запрос не попадают.
+    std::string query = "SELECT id, timestamp, temperature FROM (" +
+                        partitions.unionQuery(PARTITION_RAW, "id, timestamp, temperature",
+                                              "id > ?1 AND id <= ?2 AND timestamp > ?3 AND timestamp BETWEEN ?4 AND ?5",
+                                              std::max(startTime, sinceTs), endTime) +
+                        ") ORDER BY id ASC LIMIT ?6;";
+    if (prepareStatement(db, query.c_str(), &stmt) != SQLITE_OK) {
+        return textResponse(500, "Database error.");
+    }
+    StatementTimer timer;
+    sqlite3_bind_int64(stmt, 1, sinceId);
+    sqlite3_bind_int64(stmt, 2, maxId);
+    sqlite3_bind_text(stmt, 3, sinceTs.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, startTime.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 5, endTime.c_str(), -1, SQLITE_STATIC);
+    // Лишняя строка только показывает, что за страницей есть продолжение.
+    sqlite3_bind_int64(stmt, 6, limit + 1);
+
+    std::string body = "{\"rows\": [";
+    long long count = 0;
+    long long lastId = sinceId;
+    bool hasMore = false;
+    while (timer.step(stmt) == SQLITE_ROW) {
+        if (count == limit) {
+            hasMore = true;
+            break;
+        }
+        if (count != 0) {
+            body += ",";
+        }
+        count++;
+        lastId = sqlite3_column_int64(stmt, 0);
+        body += "{";
+        body += "\"id\": " + std::to_string(lastId) + ",";
+        body += "\"timestamp\": \"" + std::string(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1))) + "\",";
+        body += "\"temperature\": " + std::to_string(sqlite3_column_double(stmt, 2));
+        body += "}";
+    }
+    sqlite3_finalize(stmt);
+
+    long long nextSinceId = hasMore ? lastId : std::max(sinceId, maxId);
+    body += "], \"next_since_id\": " + std::to_string(nextSinceId);
+    body += ", \"has_more\": " + std::string(hasMore ? "true" : "false") + "}";
+    return jsonResponse(body);
 }
 
+// Раскодирует %XX и '+' из строки запроса и приводит "YYYY-MM-DDTHH:MM" из
+// <input type="datetime-local"> к формату столбца timestamp.
 std::string decodeAndFormatDate(const std::string& input) {
-    std::string decoded = input;
-    
-    size_t pos = decoded.find("%3A");
-    while (pos != std::string::npos) {
-        decoded.replace(pos, 3, ":");
-        pos = decoded.find("%3A", pos + 1);
-    }
-    pos = decoded.find("T");
+    std::string decoded;
+    decoded.reserve(input.size());
+    for (size_t i = 0; i < input.size(); ++i) {
+        if (input[i] == '%' && i + 2 < input.size() && std::isxdigit((unsigned char)input[i + 1]) && std::isxdigit((unsigned char)input[i + 2])) {
+            decoded += (char)std::strtol(input.substr(i + 1, 2).c_str(), nullptr, 16);
+            i += 2;
+        } else if (input[i] == '+') {
+            decoded += ' ';
+        } else {
+            decoded += input[i];
+        }
+    }
+    size_t pos = decoded.find("T");
     if (pos != std::string::npos) {
         decoded.replace(pos, 1, " ");
     }
     return decoded;
 }
 
-std::string getCurrentTempEndpoint(sqlite3 *db) {
-    const char *query = "SELECT timestamp, temperature FROM TemperatureLogs ORDER BY id DESC LIMIT 1;";
+// Значение параметра `name` из строки запроса первой строки HTTP-запроса (ещё не
+// раскодированное); `found` сообщает, был ли параметр.
+std::string queryParameter(const std::string &request, const std::string &name, bool *found = nullptr) {
+    size_t lineEnd = request.find_first_of("\r\n");
+    std::string line = request.substr(0, lineEnd);
+    size_t targetEnd = line.rfind(" HTTP/");
+    size_t query = line.find('?');
+    if (found != nullptr) {
+        *found = false;
+    }
+    if (query == std::string::npos || (targetEnd != std::string::npos && query > targetEnd)) {
+        return std::string();
+    }
+    std::string parameters = line.substr(query + 1, targetEnd == std::string::npos ? std::string::npos : targetEnd - query - 1);
+    size_t begin = 0;
+    while (begin <= parameters.size()) {
+        size_t end = parameters.find('&', begin);
+        if (end == std::string::npos) {
+            end = parameters.size();
+        }
+        if (parameters.compare(begin, name.size(), name) == 0 && begin + name.size() < end && parameters[begin + name.size()] == '=') {
+            if (found != nullptr) {
+                *found = true;
+            }
+            return parameters.substr(begin + name.size() + 1, end - begin - name.size() - 1);
+        }
+        begin = end + 1;
+    }
+    return std::string();
+}
+
+bool parseUnsigned(const std::string &text, long long &value) {
+    if (text.empty() || text.size() > 18) {
+        return false;
+    }
+    value = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        value = value * 10 + (c - '0');
+    }
+    return true;
+}
+
+// Последний отсчёт — в самой новой партиции; партиции создаются только вставкой, так что
+// пустой она не бывает.
+HttpResponse getCurrentTempEndpoint(sqlite3 *db, const PartitionStore &partitions) {
+    TRACE_SPAN("query.temperature");
+    const std::vector<Partition> &live = partitions.partitions(PARTITION_RAW);
+    std::string body = "{";
+    if (live.empty()) {
+        body += "\"error\": \"No data available\"}";
+        return jsonResponse(body);
+    }
+    std::string query = "SELECT timestamp, temperature FROM " + live.back().name + " ORDER BY id DESC LIMIT 1;";
     sqlite3_stmt *stmt;
-    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) {
-        return "HTTP/1.1 500 Internal Server Error\r\nContent-Type: text/plain\r\n\r\nDatabase error.";
+    if (prepareStatement(db, query.c_str(), &stmt) != SQLITE_OK) {
+        return textResponse(500, "Database error.");
     }
-    std::string response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n{";
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        response += "\"timestamp\": \"" + std::string(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0))) + "\",";
-        response += "\"temperature\": " + std::to_string(sqlite3_column_double(stmt, 1));
+    StatementTimer timer;
+    if (timer.step(stmt) == SQLITE_ROW) {
+        body += "\"timestamp\": \"" + std::string(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0))) + "\",";
+        body += "\"temperature\": " + std::to_string(sqlite3_column_double(stmt, 1));
     } else {
-        response += "\"error\": \"No data available\"";
+        body += "\"error\": \"No data available\"";
     }
-    response += "}";
+    body += "}";
     sqlite3_finalize(stmt);
-    return response;
+    return jsonResponse(body);
 }
 
-std::string getStatsEndpoint(sqlite3 *db) {
-    const char *query = "SELECT AVG(temperature) FROM TemperatureLogs WHERE timestamp >= datetime('now', '-1 day');";
+// Среднее за последние сутки. Метки в местном времени, поэтому и граница считается в
+// местном, а не через datetime('now') в UTC.
+HttpResponse getStatsEndpoint(sqlite3 *db, const PartitionStore &partitions) {
+    TRACE_SPAN("query.stats");
+    std::string cutoff = timelib::local_timestamp(std::chrono::system_clock::now() - std::chrono::hours(24));
+    std::string query = "SELECT AVG(temperature) FROM (" +
+                        partitions.unionQuery(PARTITION_RAW, "temperature", "timestamp >= ?1", cutoff, "") + ");";
     sqlite3_stmt *stmt;
-    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) {
-        return "HTTP/1.1 500 Internal Server Error\r\nContent-Type: text/plain\r\n\r\nDatabase error.";
+    if (prepareStatement(db, query.c_str(), &stmt) != SQLITE_OK) {
+        return textResponse(500, "Database error.");
     }
-    std::string response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n{";
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        response += "\"average_temperature\": " + std::to_string(sqlite3_column_double(stmt, 0));
+    StatementTimer timer;
+    sqlite3_bind_text(stmt, 1, cutoff.c_str(), -1, SQLITE_STATIC);
+    std::string body = "{";
+    if (timer.step(stmt) == SQLITE_ROW) {
+        body += "\"average_temperature\": " + std::to_string(sqlite3_column_double(stmt, 0));
     } else {
-        response += "\"error\": \"No data available\"";
+        body += "\"error\": \"No data available\"";
     }
-    response += "}";
+    body += "}";
     sqlite3_finalize(stmt);
-    return response;
+    return jsonResponse(body);
+}
+
+// Значение заголовка `name` (без учёта регистра имени) или пустая строка.
+std::string headerValue(const std::string &request, const std::string &name) {
+    size_t lineStart = request.find("\r\n");
+    while (lineStart != std::string::npos) {
+        lineStart += 2;
+        size_t lineEnd = request.find("\r\n", lineStart);
+        if (lineEnd == std::string::npos) {
+            lineEnd = request.size();
+        }
+        if (lineEnd - lineStart > name.size() && request[lineStart + name.size()] == ':') {
+            bool isMatch = true;
+            for (size_t i = 0; i < name.size() && isMatch; ++i) {
+                isMatch = std::tolower((unsigned char)request[lineStart + i]) == std::tolower((unsigned char)name[i]);
+            }
+            if (isMatch) {
+                size_t valueStart = request.find_first_not_of(" \t", lineStart + name.size() + 1);
+                return valueStart < lineEnd ? request.substr(valueStart, lineEnd - valueStart) : std::string();
+            }
+        }
+        lineStart = lineEnd < request.size() ? lineEnd : std::string::npos;
+    }
+    return std::string();
 }
 
-std::string processRequest(const std::string &request, sqlite3 *db) {
+bool etagMatches(const std::string &ifNoneMatch, const std::string &etag) {
+    return ifNoneMatch == "*" || (!ifNoneMatch.empty() && ifNoneMatch.find(etag) != std::string::npos);
+}
+
+const size_t RESPONSE_CACHE_MAX_ENTRIES = 256;
+const size_t RESPONSE_CACHE_MAX_BYTES = 32 * 1024 * 1024;
+// Живые записи сбрасываются уведомлениями main; TTL страхует от потерянных датаграмм
+// и от сдвига окна /stats, когда новых отсчётов нет.
+const int LIVE_CACHE_TTL_MS = 5000;
+// Срок хранения сырых отсчётов в main. Партиции удаляются целиком, так что строки живут
+// от 24 до 48 часов; ответы, начинающиеся раньше этой границы, считаются живыми.
+const int RAW_RETENTION_HOURS = PARTITION_SERIES_INFO[PARTITION_RAW].retentionHours;
+
+struct CachedResponse {
+    HttpResponse response;
+    // Сжатые копии тела, по индексу ContentEncoding; создаются при первом запросе.
+    std::string encodedBodies[ENCODING_COUNT];
+    std::string etag;
+    std::string rangeStart;
+    std::string rangeEnd;
+    // Диапазон включает текущий момент или край хранения: ответ меняется с новыми отсчётами.
+    bool isLive;
+    std::chrono::steady_clock::time_point storedAt;
+};
+
+// Ограниченный LRU-кэш готовых ответов по нормализованному запросу. Ответ за прошедший
+// период, целиком лежащий внутри срока хранения, не меняется, пока main не удалит его
+// строки, поэтому хранится до вытеснения; остальные сбрасываются при каждом новом отсчёте.
+// Сжатые представления хранятся в той же записи и учитываются в её размере.
+class ResponseCache {
+public:
+    CachedResponse *find(const std::string &key) {
+        auto found = index.find(key);
+        if (found == index.end()) {
+            return nullptr;
+        }
+        CachedResponse &entry = found->second->second;
+        if (entry.isLive && std::chrono::steady_clock::now() - entry.storedAt > std::chrono::milliseconds(LIVE_CACHE_TTL_MS)) {
+            erase(found->second);
+            return nullptr;
+        }
+        entries.splice(entries.begin(), entries, found->second);
+        return &entry;
+    }
+
+    // `rangeEnd` пустой — ответ всегда зависит от последних данных (/temperature, /stats).
+    // Возвращает nullptr, если ответ слишком велик для кэша.
+    CachedResponse *store(const std::string &key, const HttpResponse &response,
+                          const std::string &rangeStart, const std::string &rangeEnd) {
+        if (response.body.size() > RESPONSE_CACHE_MAX_BYTES / 4) {
+            return nullptr;
+        }
+        auto found = index.find(key);
+        if (found != index.end()) {
+            erase(found->second);
+        }
+
+        auto now = std::chrono::system_clock::now();
+        CachedResponse entry;
+        entry.response = response;
+        entry.etag = computeETag(response.body);
+        entry.rangeStart = rangeStart;
+        entry.rangeEnd = rangeEnd;
+        entry.isLive = rangeEnd.empty() || rangeEnd >= timelib::local_timestamp(now) ||
+                       rangeStart < timelib::local_timestamp(now - std::chrono::hours(RAW_RETENTION_HOURS));
+        entry.storedAt = std::chrono::steady_clock::now();
+        entries.push_front(std::make_pair(key, entry));
+        index[key] = entries.begin();
+        totalBytes += key.size() + response.body.size();
+        trim();
+        return &entries.front().second;
+    }
+
+    // Тело записи в нужной кодировке; `entry` должна быть только что получена из find
+    // или store (она первая в списке и не будет вытеснена).
+    const std::string &encodedBody(CachedResponse &entry, ContentEncoding encoding) {
+        if (encoding == ENCODING_IDENTITY) {
+            return entry.response.body;
+        }
+        std::string &encoded = entry.encodedBodies[encoding];
+        if (encoded.empty()) {
+            TRACE_SPAN("cache.compress");
+            auto start = std::chrono::steady_clock::now();
+            encoded = compressBody(encoding, compressionLevel(encoding, true), entry.response.body);
+            recordMetric(METRIC_COMPRESS_NS, elapsedNs(start));
+            totalBytes += encoded.size();
+            trim();
+        }
+        return encoded;
+    }
+
+    // Вызывается для каждой пачки уведомлений main; latestTimestamp — время самого нового
+    // отсчёта. Новая строка меняет ответы, чей диапазон её включает, а удаление старых
+    // строк main — ответы, начинающиеся раньше края хранения.
+    void invalidate(const std::string &latestTimestamp) {
+        TRACE_SPAN("cache.invalidate");
+        std::string cutoff = timelib::local_timestamp(std::chrono::system_clock::now() - std::chrono::hours(RAW_RETENTION_HOURS));
+        for (auto it = entries.begin(); it != entries.end();) {
+            const CachedResponse &entry = it->second;
+            auto next = std::next(it);
+            if (entry.isLive || entry.rangeEnd >= latestTimestamp || entry.rangeStart < cutoff) {
+                erase(it);
+            }
+            it = next;
+        }
+    }
+
+private:
+    typedef std::list<std::pair<std::string, CachedResponse>> EntryList;
+
+    // Самую свежую запись не вытесняет: её тело может сейчас отправляться.
+    void trim() {
+        while (entries.size() > 1 && (entries.size() > RESPONSE_CACHE_MAX_ENTRIES || totalBytes > RESPONSE_CACHE_MAX_BYTES)) {
+            erase(std::prev(entries.end()));
+        }
+    }
+
+    void erase(EntryList::iterator it) {
+        totalBytes -= it->first.size() + it->second.response.body.size();
+        for (const std::string &encoded : it->second.encodedBodies) {
+            totalBytes -= encoded.size();
+        }
+        index.erase(it->first);
+        entries.erase(it);
+    }
+
+    // Сначала самые недавно использованные.
+    EntryList entries;
+    std::unordered_map<std::string, EntryList::iterator> index;
+    size_t totalBytes = 0;
+};
+
+// Разобранный запрос к данным: нормализованный ключ кэша (раскодированные параметры со
+// значениями по умолчанию), период, от которого зависит ответ, и сам запрос к базе.
+struct DataQuery {
+    std::string cacheKey;
+    std::string rangeStart;
+    std::string rangeEnd;
+    std::function<HttpResponse(sqlite3 *, const PartitionStore &)> run;
+};
+
+// Возвращает false и заполняет `error` для неизвестного пути или неверных параметров.
+bool parseDataQuery(const std::string &request, DataQuery &query, HttpResponse &error) {
     if (request.find("GET /temperature") == 0) {
-        return getCurrentTempEndpoint(db);
+        query.cacheKey = "/temperature";
+        query.run = getCurrentTempEndpoint;
+        return true;
     } else if (request.find("GET /stats") == 0) {
-        return getStatsEndpoint(db);
+        query.cacheKey = "/stats";
+        query.run = getStatsEndpoint;
+        return true;
     } else if (request.find("GET /history") == 0) {
-        auto start_pos = request.find("start_datetime=");
-        auto end_pos = request.find("end_datetime=");
-        std::string start_datetime = "1970-01-01T00:00"; 
-        std::string end_datetime = "2100-01-01T00:00"; 
-        if (start_pos != std::string::npos) {
-            size_t start_datetime_end_pos = request.find("&", start_pos);  
-            if (start_datetime_end_pos == std::string::npos) {
-                start_datetime_end_pos = request.length(); 
-            }
-            start_datetime = request.substr(start_pos + 15, start_datetime_end_pos - (start_pos + 15)); 
+        bool hasStart, hasEnd, hasSinceId, hasSinceTs, hasLimit;
+        std::string start_datetime = queryParameter(request, "start_datetime", &hasStart);
+        std::string end_datetime = queryParameter(request, "end_datetime", &hasEnd);
+        std::string sinceIdText = queryParameter(request, "since_id", &hasSinceId);
+        std::string sinceTsText = queryParameter(request, "since_ts", &hasSinceTs);
+        std::string limitText = queryParameter(request, "limit", &hasLimit);
+        std::string startTime = decodeAndFormatDate(hasStart ? start_datetime : "1970-01-01T00:00");
+        std::string endTime = decodeAndFormatDate(hasEnd ? end_datetime : "2100-01-01T00:00");
+        query.rangeStart = startTime;
+        query.rangeEnd = endTime;
+        if (!hasSinceId && !hasSinceTs && !hasLimit) {
+            // Без курсора — прежний ответ: массив за период, новые записи первыми.
+            query.cacheKey = "/history?start=" + startTime + "&end=" + endTime;
+            query.run = [startTime, endTime](sqlite3 *db, const PartitionStore &partitions) {
+                return fetchHistoryEndpoint(db, partitions, startTime, endTime);
+            };
+            return true;
+        }
+        long long sinceId = 0;
+        long long limit = DEFAULT_HISTORY_PAGE;
+        if ((hasSinceId && !parseUnsigned(sinceIdText, sinceId)) || (hasLimit && (!parseUnsigned(limitText, limit) || limit == 0))) {
+            error = textResponse(400, "since_id and limit must be positive integers.");
+            return false;
+        }
+        limit = std::min(limit, MAX_HISTORY_PAGE);
+        std::string sinceTs = hasSinceTs ? decodeAndFormatDate(sinceTsText) : std::string();
+        query.cacheKey = "/history?start=" + startTime + "&end=" + endTime + "&since_id=" + std::to_string(sinceId) +
+                         "&since_ts=" + sinceTs + "&limit=" + std::to_string(limit);
+        query.run = [startTime, endTime, sinceId, sinceTs, limit](sqlite3 *db, const PartitionStore &partitions) {
+            return fetchHistorySinceEndpoint(db, partitions, startTime, endTime, sinceId, sinceTs, limit);
+        };
+        return true;
+    }
+    error = textResponse(404, "Not Found");
+    return false;
+}
+
+void sendResponse(ClientRequest &client, int status, const std::string &head, const std::string &body) {
+    TRACE_SPAN("send");
+    client.status = status;
+    if (sendAll(client, head.data(), head.size())) {
+        sendAll(client, body.data(), body.size());
+    }
+}
+
+// Ответ, не попавший в кэш, сжимается на лету кусками по STREAM_CHUNK_SIZE, и каждый
+// готовый кусок сразу уходит чанком, не дожидаясь сжатия всего тела.
+void sendStreamed(ClientRequest &client, const HttpResponse &response, ContentEncoding encoding, const std::string &etag) {
+    TRACE_SPAN("send.streamed");
+    client.status = response.status;
+    std::string head = serializeHead(response, -1, encoding, etag);
+    if (!sendAll(client, head.data(), head.size())) {
+        return;
+    }
+    uint64_t compressNs = 0;
+    StreamCompressor compressor(encoding, compressionLevel(encoding, false));
+    std::string output;
+    char chunkHeader[24];
+    size_t offset = 0;
+    bool isFinished = false;
+    while (!isFinished) {
+        output.clear();
+        auto compressStart = std::chrono::steady_clock::now();
+        if (offset < response.body.size()) {
+            size_t length = std::min(STREAM_CHUNK_SIZE, response.body.size() - offset);
+            compressor.write(response.body.data() + offset, length, output);
+            offset += length;
+        } else {
+            compressor.finish(output);
+            isFinished = true;
+        }
+        compressNs += elapsedNs(compressStart);
+        if (output.empty()) {
+            continue;
+        }
+        int headerLength = std::snprintf(chunkHeader, sizeof(chunkHeader), "%zx\r\n", output.size());
+        output += "\r\n";
+        if (!sendAll(client, chunkHeader, (size_t)headerLength) || !sendAll(client, output.data(), output.size())) {
+            break;
+        }
+    }
+    recordMetric(METRIC_COMPRESS_NS, compressNs);
+    if (isFinished) {
+        sendAll(client, "0\r\n\r\n", 5);
+    }
+}
+
+// GET /trace отдаёт накопленные спаны в формате Chrome trace (chrome://tracing, Perfetto);
+// /trace?enable=1 и /trace?enable=0 включают и выключают запись без перезапуска.
+HttpResponse traceEndpoint(const std::string &request) {
+    bool hasEnable;
+    std::string enable = queryParameter(request, "enable", &hasEnable);
+    if (hasEnable) {
+        if (enable == "1") {
+            tracelib::enable();
+        } else if (enable == "0") {
+            tracelib::disable();
+        } else {
+            return textResponse(400, "enable must be 0 or 1.");
+        }
+    }
+    return jsonResponse(tracelib::export_chrome_json());
+}
+
+void processRequest(ClientRequest &client, const std::string &request, sqlite3 *db, PartitionStore &partitions, ResponseCache &cache) {
+    TRACE_SPAN("request");
+    if (request.find("GET /metrics") == 0) {
+        HttpResponse metrics = { 200, "text/plain; version=0.0.4", MetricsRegistry::instance().render() };
+        sendResponse(client, 200, serializeHead(metrics, (long long)metrics.body.size(), ENCODING_IDENTITY, std::string()), metrics.body);
+        return;
+    }
+    if (request.find("GET /trace") == 0) {
+        HttpResponse trace = traceEndpoint(request);
+        sendResponse(client, trace.status, serializeHead(trace, (long long)trace.body.size(), ENCODING_IDENTITY, std::string()), trace.body);
+        return;
+    }
+    DataQuery query;
+    HttpResponse error;
+    if (!parseDataQuery(request, query, error)) {
+        sendResponse(client, error.status, serializeHead(error, (long long)error.body.size(), ENCODING_IDENTITY, std::string()), error.body);
+        return;
+    }
+    ContentEncoding encoding = negotiateEncoding(headerValue(request, "Accept-Encoding"));
+
+    CachedResponse *cached = cache.find(query.cacheKey);
+    countMetric(cached != nullptr ? METRIC_CACHE_HITS : METRIC_CACHE_MISSES);
+    if (cached == nullptr) {
+        // Каталог перечитывается, только если main создал или удалил партицию.
+        partitions.refresh();
+        HttpResponse response = query.run(db, partitions);
+        if (response.status == 200) {
+            cached = cache.store(query.cacheKey, response, query.rangeStart, query.rangeEnd);
         }
-        if (end_pos != std::string::npos) {
-            size_t end_datetime_end_pos = request.find("&", end_pos);  
-            if (end_datetime_end_pos == std::string::npos) {
-                end_datetime_end_pos = request.length(); 
+        if (cached == nullptr) {
+            if (response.status != 200 || response.body.size() < MIN_COMPRESSED_BODY_SIZE) {
+                encoding = ENCODING_IDENTITY;
             }
-            end_datetime = request.substr(end_pos + 13, end_datetime_end_pos - (end_pos + 14)); 
+            std::string etag = response.status == 200 ? representationETag(computeETag(response.body), encoding) : std::string();
+            if (encoding != ENCODING_IDENTITY) {
+                sendStreamed(client, response, encoding, etag);
+                return;
+            }
+            sendResponse(client, response.status, serializeHead(response, (long long)response.body.size(), encoding, etag), response.body);
+            return;
         }
-        return fetchHistoryEndpoint(db, decodeAndFormatDate(start_datetime), decodeAndFormatDate(end_datetime));
-    } else {
-        return "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\n\r\nNot Found";
     }
+
+    if (cached->response.body.size() < MIN_COMPRESSED_BODY_SIZE) {
+        encoding = ENCODING_IDENTITY;
+    }
+    std::string etag = representationETag(cached->etag, encoding);
+    if (etagMatches(headerValue(request, "If-None-Match"), etag)) {
+        HttpResponse notModified = { 304, std::string(), std::string() };
+        countMetric(METRIC_NOT_MODIFIED);
+        sendResponse(client, 304, serializeHead(notModified, 0, encoding, etag), std::string());
+        return;
+    }
+    const std::string &body = cache.encodedBody(*cached, encoding);
+    sendResponse(client, 200, serializeHead(cached->response, (long long)body.size(), encoding, etag), body);
 }
 
-int main() {
+const size_t MAX_REQUEST_SIZE = 8192;
+const int CONNECTION_IDLE_TIMEOUT_MS = 5000;
+
+// Соединения обычных запросов. Сокеты неблокирующие и стоят в общем poll сначала до
+// конца заголовков запроса, потом до отправки всего ответа, так что клиент, который
+// молчит или медленно читает, не задерживает остальные запросы и рассылку /stream.
+// Соединение, на котором CONNECTION_IDLE_TIMEOUT_MS ничего не происходит, закрывается.
+class HttpConnections {
+public:
+    using Dispatcher = std::function<void(ClientRequest &, const std::string &)>;
+
+    HttpConnections(LiveStream &liveStream, SampledLogger &requestLog, Dispatcher dispatch)
+        : liveStream(liveStream), requestLog(requestLog), dispatch(std::move(dispatch)) {}
+
+    ~HttpConnections() {
+        for (Connection &connection : connections) {
+            close(connection);
+        }
+    }
+
+    void accept(int socketId) {
+        setNonBlocking(socketId);
+        Connection connection;
+        connection.client = { socketId, std::chrono::steady_clock::now(), 0, 0, std::string() };
+        connection.isWriting = false;
+        connection.deadline = connection.client.acceptedAt + std::chrono::milliseconds(CONNECTION_IDLE_TIMEOUT_MS);
+        connections.push_back(std::move(connection));
+        // Запрос обычно приходит сразу за соединением, так что его можно прочитать, не дожидаясь poll.
+        receive(connections.back());
+        removeClosed();
+    }
+
+    void appendPollDescriptors(std::vector<pollfd> &descriptors) const {
+        for (const Connection &connection : connections) {
+            pollfd descriptor;
+            descriptor.fd = connection.client.socketId;
+            descriptor.events = connection.isWriting ? POLLOUT : POLLIN;
+            descriptor.revents = 0;
+            descriptors.push_back(descriptor);
+        }
+    }
+
+    // `descriptors` — результат poll для дескрипторов из appendPollDescriptors, в том же порядке.
+    void handlePollResult(const pollfd *descriptors) {
+        for (size_t i = 0; i < connections.size(); ++i) {
+            Connection &connection = connections[i];
+            short revents = descriptors[i].revents;
+            if (revents & (POLLERR | POLLNVAL)) {
+                abandon(connection);
+            } else if (connection.isWriting && (revents & (POLLOUT | POLLHUP))) {
+                flush(connection);
+            } else if (!connection.isWriting && (revents & (POLLIN | POLLHUP))) {
+                receive(connection);
+            }
+        }
+        removeClosed();
+    }
+
+    // Закрывает простаивающие соединения; возвращает, сколько миллисекунд ждать до
+    // ближайшего таймаута (-1, если соединений нет).
+    long long expire() {
+        auto now = std::chrono::steady_clock::now();
+        long long wait = -1;
+        for (Connection &connection : connections) {
+            if (connection.deadline <= now) {
+                abandon(connection);
+                continue;
+            }
+            long long left = std::chrono::duration_cast<std::chrono::milliseconds>(connection.deadline - now).count() + 1;
+            wait = wait < 0 ? left : std::min(wait, left);
+        }
+        removeClosed();
+        return wait;
+    }
+
+private:
+    struct Connection {
+        ClientRequest client;
+        std::string request;
+        bool isWriting;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    void receive(Connection &connection) {
+        char buffer[4096];
+        bool isClosed = false;
+        while (connection.request.size() < MAX_REQUEST_SIZE) {
+            long received = recv(connection.client.socketId, buffer, sizeof(buffer), 0);
+            if (received < 0 && wouldBlock()) {
+                break;
+            }
+            if (received <= 0) {
+                isClosed = true;
+                break;
+            }
+            connection.request.append(buffer, (size_t)received);
+            connection.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(CONNECTION_IDLE_TIMEOUT_MS);
+        }
+        // Запрос обрабатывается, когда пришли все заголовки. Если их больше
+        // MAX_REQUEST_SIZE или клиент закрыл передачу раньше, хватает строки запроса.
+        bool hasHeaders = connection.request.find("\r\n\r\n") != std::string::npos ||
+                          connection.request.find("\n\n") != std::string::npos;
+        bool isTruncated = isClosed || connection.request.size() >= MAX_REQUEST_SIZE;
+        if (hasHeaders || (isTruncated && connection.request.find('\n') != std::string::npos)) {
+            start(connection);
+        } else if (isTruncated) {
+            close(connection);
+        }
+    }
+
+    void start(Connection &connection) {
+        countMetric(METRIC_REQUESTS);
+        if (connection.request.find("GET /stream") == 0) {
+            // Сокет переходит к LiveStream вместе со счётчиком активных соединений.
+            liveStream.subscribe(connection.client.socketId);
+            connection.client.socketId = -1;
+            return;
+        }
+        dispatch(connection.client, connection.request);
+        connection.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(CONNECTION_IDLE_TIMEOUT_MS);
+        connection.isWriting = true;
+        if (connection.client.pending.empty()) {
+            finish(connection);
+        }
+    }
+
+    void flush(Connection &connection) {
+        std::string &pending = connection.client.pending;
+        long sent = sendAvailable(connection.client, pending.data(), pending.size());
+        if (sent < 0) {
+            finish(connection);
+            return;
+        }
+        if (sent > 0) {
+            pending.erase(0, (size_t)sent);
+            connection.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(CONNECTION_IDLE_TIMEOUT_MS);
+        }
+        if (pending.empty()) {
+            finish(connection);
+        }
+    }
+
+    // Ответ ушёл (или клиент пропал): метрики и журнал считаются по фактически отправленному.
+    void finish(Connection &connection) {
+        ClientRequest &client = connection.client;
+        countMetric(METRIC_BYTES_OUT, client.bytesOut);
+        recordMetric(METRIC_RESPONSE_BYTES, client.bytesOut);
+        if (requestLog.shouldLog(client.status >= 500)) {
+            char summary[64];
+            std::snprintf(summary, sizeof(summary), " %d %zuB %.3fms ", client.status, client.bytesOut,
+                          elapsedNs(client.acceptedAt) / 1e6);
+            requestLog.log(timelib::local_timestamp_now(true) + summary + connection.request.substr(0, connection.request.find("\r\n")));
+        }
+        close(connection);
+    }
+
+    // Запрос, который уже обработан, попадает в метрики и журнал и при обрыве.
+    void abandon(Connection &connection) {
+        if (connection.isWriting) {
+            finish(connection);
+        } else {
+            close(connection);
+        }
+    }
+
+    void close(Connection &connection) {
+        if (connection.client.socketId >= 0) {
+            closeConnection(connection.client.socketId);
+            connection.client.socketId = -1;
+            adjustGauge(METRIC_ACTIVE_CONNECTIONS, -1);
+        }
+    }
+
+    void removeClosed() {
+        connections.erase(std::remove_if(connections.begin(), connections.end(),
+                                         [](const Connection &connection) { return connection.client.socketId < 0; }),
+                          connections.end());
+    }
+
+    LiveStream &liveStream;
+    SampledLogger &requestLog;
+    Dispatcher dispatch;
+    std::vector<Connection> connections;
+};
+
+// Usage: server [http_port] [event_port] [log_every]
+// log_every: в журнал попадает каждый N-й запрос (0 — только ошибки сервера), по умолчанию 100.
+// LAB5_TRACE=1 (или путь к файлу) включает трассировку с запуска; её можно забрать через
+// GET /trace или сохранить в файл сигналом USR2.
+int main(int argc, char **argv) {
+    if (tracelib::enable_from_env("LAB5_TRACE")) {
+        tracelib::set_thread_name("server");
+    }
 #ifdef _WIN32
     const char* cmd_name = "cmd /c timeout /t 5 >nul 2>&1";
     SetConsoleOutputCP(CP_UTF8);
@@ -188,14 +1223,22 @@ int main() {
 #endif
     setupNetwork();
     sqlite3 *db;
-    if (sqlite3_open("temperature_logs.db", &db)) {
+    if (sqlite3_open(DATABASE_PATH, &db)) {
         std::cerr << "Ошибка открытия базы данных: " << sqlite3_errmsg(db) << std::endl;
         return EXIT_FAILURE;
     }
+    applyStorageProfile(db, storageProfileFromEnvironment(), false);
+    PartitionStore partitions(db);
     int server_fd;
     struct sockaddr_in address;
     int opt = 1;
-    const int PORT = 8080;
+    const int PORT = argc > 1 ? std::atoi(argv[1]) : 8080;
+    const int EVENT_PORT = argc > 2 ? std::atoi(argv[2]) : DEFAULT_INGEST_EVENT_PORT;
+    const unsigned LOG_SAMPLE_EVERY = argc > 3 ? (unsigned)std::atoi(argv[3]) : 100;
+#ifndef _WIN32
+    // Подписчик /stream может отключиться между poll и writev.
+    signal(SIGPIPE, SIG_IGN);
+#endif
 #ifdef _WIN32
     server_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
     if (server_fd == INVALID_SOCKET) {
@@ -248,43 +1291,105 @@ int main() {
         cleanupNetwork();
         return -1;
     }
+    int eventSocket = openEventSocket(EVENT_PORT);
+    if (eventSocket < 0) {
+        std::cerr << "Не удалось открыть порт уведомлений " << EVENT_PORT << ", /stream не будет получать данные" << std::endl;
+    }
     std::cout << "Сервер запущен на порту " << PORT << std::endl;
+
+    // Один поток обслуживает всё через poll: новые соединения, уведомления main,
+    // подписчиков /stream и соединения обычных запросов. Сами запросы по-прежнему
+    // обрабатываются по одному, но только когда запрос пришёл целиком.
+    LiveStream liveStream;
+    ResponseCache responseCache;
+    SampledLogger requestLog(std::cout, LOG_SAMPLE_EVERY);
+    HttpConnections connections(liveStream, requestLog, [&](ClientRequest &client, const std::string &request) {
+        processRequest(client, request, db, partitions, responseCache);
+    });
+    setNonBlocking(server_fd);
+    std::vector<pollfd> descriptors;
+    std::vector<IngestEvent> events;
+    auto nextHeartbeat = std::chrono::steady_clock::now() + std::chrono::milliseconds(STREAM_HEARTBEAT_INTERVAL_MS);
     while (true) {
-        int addrlen = sizeof(address);
-        int clientConn;
+        tracelib::dump_if_requested();
+        descriptors.assign(2, pollfd());
+        descriptors[0].fd = server_fd;
+        descriptors[0].events = POLLIN;
+        // poll пропускает отрицательные дескрипторы, но WSAPoll их не принимает.
+        descriptors[1].fd = eventSocket >= 0 ? eventSocket : server_fd;
+        descriptors[1].events = eventSocket >= 0 ? POLLIN : 0;
+        liveStream.appendPollDescriptors(descriptors);
+        size_t connectionDescriptors = descriptors.size();
+        connections.appendPollDescriptors(descriptors);
+
+        auto untilHeartbeat = std::chrono::duration_cast<std::chrono::milliseconds>(nextHeartbeat - std::chrono::steady_clock::now()).count();
+        long long untilExpiry = connections.expire();
+        long long timeout = untilExpiry >= 0 ? std::min<long long>(untilHeartbeat, untilExpiry) : untilHeartbeat;
+        int ready = pollSockets(descriptors, (int)std::max<long long>(0, timeout));
+        if (ready < 0) {
+            if (wouldBlock()) {
+                continue;
+            }
 #ifdef _WIN32
-        clientConn = accept(server_fd, (struct sockaddr *)&address, &addrlen);
-        if (clientConn == INVALID_SOCKET) {
-            std::cerr << "Ошибка принятия соединения: " << WSAGetLastError() << std::endl;
+            std::cerr << "Ошибка ожидания событий: " << WSAGetLastError() << std::endl;
 #else
-        clientConn = accept(server_fd, (struct sockaddr *)&address, (socklen_t *)&addrlen);
-        if (clientConn < 0) {
-            perror("Ошибка принятия соединения");
+            perror("Ошибка ожидания событий");
 #endif
-            closeConnection(server_fd);
-            cleanupNetwork();
-            sqlite3_close(db);
-            return -1;
+            break;
         }
-        std::cout << "Принято новое соединение" << std::endl;
-        char buffer[1024] = {0};
-        ssize_t bytesRead;
-#ifdef _WIN32
-        bytesRead = recv(clientConn, buffer, sizeof(buffer), 0);
-#else
-        bytesRead = read(clientConn, buffer, sizeof(buffer));
-#endif
-        if (bytesRead > 0) {
-            std::string request(buffer, bytesRead);
-            std::cout << "Получен запрос:\n" << request << std::endl;
-            std::string response = processRequest(request, db);
+
+        liveStream.handlePollResult(descriptors.data() + 2);
+        connections.handlePollResult(descriptors.data() + connectionDescriptors);
+
+        if (descriptors[1].revents & POLLIN) {
+            TRACE_SPAN("events");
+            events.clear();
+            receiveIngestEvents(eventSocket, events);
+            liveStream.publish(events);
+            if (!events.empty()) {
+                responseCache.invalidate(events.back().timestamp);
+            }
+        }
+
+        if (std::chrono::steady_clock::now() >= nextHeartbeat) {
+            liveStream.heartbeat();
+            nextHeartbeat = std::chrono::steady_clock::now() + std::chrono::milliseconds(STREAM_HEARTBEAT_INTERVAL_MS);
+        }
+
+        if (!(descriptors[0].revents & POLLIN)) {
+            continue;
+        }
+        // Слушающий сокет неблокирующий: принимаем всё, что накопилось в очереди.
+        while (true) {
+            int addrlen = sizeof(address);
+            int clientConn;
 #ifdef _WIN32
-            send(clientConn, response.c_str(), response.length(), 0);
+            clientConn = accept(server_fd, (struct sockaddr *)&address, &addrlen);
+            if (clientConn == INVALID_SOCKET && wouldBlock()) {
+                break;
+            }
+            if (clientConn == INVALID_SOCKET) {
+                std::cerr << "Ошибка принятия соединения: " << WSAGetLastError() << std::endl;
 #else
-            send(clientConn, response.c_str(), response.length(), 0);
+            clientConn = accept(server_fd, (struct sockaddr *)&address, (socklen_t *)&addrlen);
+            if (clientConn < 0 && wouldBlock()) {
+                break;
+            }
+            if (clientConn < 0) {
+                perror("Ошибка принятия соединения");
 #endif
+                closeConnection(server_fd);
+                cleanupNetwork();
+                sqlite3_close(db);
+                return -1;
+            }
+            countMetric(METRIC_CONNECTIONS_ACCEPTED);
+            adjustGauge(METRIC_ACTIVE_CONNECTIONS, 1);
+            connections.accept(clientConn);
         }
-        closeConnection(clientConn);
+    }
+    if (eventSocket >= 0) {
+        closeConnection(eventSocket);
     }
     closeConnection(server_fd);
     cleanupNetwork();
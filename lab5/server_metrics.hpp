@@ -0,0 +1,334 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Метрики server для /metrics в текстовом формате Prometheus. Каждый поток пишет только в
+// свой шард (одна запись без блокировок и без гонок за кэш-линию), а шарды складываются
+// лишь тогда, когда кто-то запрашивает /metrics.
+
+enum MetricCounter {
+    METRIC_CONNECTIONS_ACCEPTED,
+    METRIC_REQUESTS,
+    METRIC_CACHE_HITS,
+    METRIC_CACHE_MISSES,
+    METRIC_NOT_MODIFIED,
+    METRIC_BYTES_OUT,
+    METRIC_STREAM_EVENTS,
+    METRIC_STREAM_DROPPED,
+    METRIC_LOG_LINES_DROPPED,
+    METRIC_COUNTER_COUNT
+};
+
+enum MetricGauge {
+    METRIC_ACTIVE_CONNECTIONS,
+    METRIC_STREAM_SUBSCRIBERS,
+    METRIC_GAUGE_COUNT
+};
+
+enum MetricHistogram {
+    METRIC_FIRST_BYTE_NS,
+    METRIC_SQL_PREPARE_NS,
+    METRIC_SQL_STEP_NS,
+    METRIC_SERIALIZE_NS,
+    METRIC_COMPRESS_NS,
+    METRIC_RESPONSE_BYTES,
+    METRIC_HISTOGRAM_COUNT
+};
+
+struct MetricInfo {
+    const char *name;
+    const char *help;
+};
+
+static const MetricInfo COUNTER_INFO[METRIC_COUNTER_COUNT] = {
+    { "server_connections_accepted_total", "Accepted TCP connections." },
+    { "server_requests_total", "HTTP requests read from clients." },
+    { "server_cache_hits_total", "Responses served from the response cache." },
+    { "server_cache_misses_total", "Responses that had to query the database." },
+    { "server_not_modified_total", "Conditional requests answered with 304." },
+    { "server_bytes_out_total", "Bytes written to HTTP clients, headers included." },
+    { "server_stream_events_total", "Samples published to /stream subscribers." },
+    { "server_stream_dropped_total", "/stream subscribers disconnected as slow or gone." },
+    { "server_log_lines_dropped_total", "Sampled log lines dropped because the log queue was full." },
+};
+
+static const MetricInfo GAUGE_INFO[METRIC_GAUGE_COUNT] = {
+    { "server_active_connections", "Open client connections, /stream subscribers included." },
+    { "server_stream_subscribers", "Open /stream subscriptions." },
+};
+
+// Гистограммы времени хранят наносекунды, а в выдаче переводятся в секунды.
+struct HistogramInfo {
+    const char *name;
+    const char *help;
+    double scale;
+};
+
+static const HistogramInfo HISTOGRAM_INFO[METRIC_HISTOGRAM_COUNT] = {
+    { "server_first_byte_seconds", "Time from accept to the first response byte.", 1e-9 },
+    { "server_sql_prepare_seconds", "sqlite3_prepare_v2 time per statement.", 1e-9 },
+    { "server_sql_step_seconds", "Total sqlite3_step time per statement.", 1e-9 },
+    { "server_serialize_seconds", "JSON serialization time per response.", 1e-9 },
+    { "server_compress_seconds", "gzip/zstd compression time per response body.", 1e-9 },
+    { "server_response_bytes", "Response size on the wire, headers included.", 1.0 },
+};
+
+// Логарифмически-линейные корзины как в HdrHistogram: значения меньше 32 точные, дальше
+// каждая степень двойки делится на 32 равные корзины (погрешность не больше ~3%).
+// Значения обрезаются до 2^40 - 1 (для наносекунд это около 18 минут).
+const int HISTOGRAM_SUB_BUCKET_BITS = 5;
+const int HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BUCKET_BITS;
+const int HISTOGRAM_MAX_BITS = 40;
+const int HISTOGRAM_BUCKETS = HISTOGRAM_SUB_BUCKETS * (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1);
+
+inline int histogramIndex(uint64_t value) {
+    if (value >= (1ULL << HISTOGRAM_MAX_BITS)) {
+        value = (1ULL << HISTOGRAM_MAX_BITS) - 1;
+    }
+    if (value < (uint64_t)HISTOGRAM_SUB_BUCKETS) {
+        return (int)value;
+    }
+    int topBit = 63;
+    while ((value >> topBit) == 0) {
+        topBit--;
+    }
+    int shift = topBit - HISTOGRAM_SUB_BUCKET_BITS;
+    return HISTOGRAM_SUB_BUCKETS * (shift + 1) + (int)((value >> shift) - HISTOGRAM_SUB_BUCKETS);
+}
+
+// Наибольшее значение, попадающее в корзину `index`.
+inline uint64_t histogramBucketMax(int index) {
+    if (index < HISTOGRAM_SUB_BUCKETS) {
+        return (uint64_t)index;
+    }
+    int shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t base = (uint64_t)(HISTOGRAM_SUB_BUCKETS + index % HISTOGRAM_SUB_BUCKETS) << shift;
+    return base + (1ULL << shift) - 1;
+}
+
+// Шард одного потока. Пишет в него только владелец, поэтому вместо fetch_add достаточно
+// relaxed load + store; атомики нужны лишь для того, чтобы сборщик читал без гонок.
+struct MetricsShard {
+    std::atomic<uint64_t> counters[METRIC_COUNTER_COUNT];
+    std::atomic<int64_t> gauges[METRIC_GAUGE_COUNT];
+    std::atomic<uint64_t> buckets[METRIC_HISTOGRAM_COUNT][HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> sums[METRIC_HISTOGRAM_COUNT];
+
+    MetricsShard() {
+        for (auto &counter : counters) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+        for (auto &gauge : gauges) {
+            gauge.store(0, std::memory_order_relaxed);
+        }
+        for (auto &histogram : buckets) {
+            for (auto &bucket : histogram) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+        for (auto &sum : sums) {
+            sum.store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+class MetricsRegistry {
+public:
+    static MetricsRegistry &instance() {
+        static MetricsRegistry registry;
+        return registry;
+    }
+
+    // Шарды не удаляются и после завершения потока: их значения остаются в сумме.
+    MetricsShard &localShard() {
+        thread_local MetricsShard *shard = nullptr;
+        if (shard == nullptr) {
+            std::unique_ptr<MetricsShard> created(new MetricsShard());
+            shard = created.get();
+            std::lock_guard<std::mutex> lock(mutex);
+            shards.push_back(std::move(created));
+        }
+        return *shard;
+    }
+
+    // Текстовый формат Prometheus 0.0.4. Корзины гистограмм выводятся по степеням двойки:
+    // их границы совпадают с границами внутренних корзин, так что счётчики точные.
+    std::string render() {
+        uint64_t counters[METRIC_COUNTER_COUNT] = {};
+        int64_t gauges[METRIC_GAUGE_COUNT] = {};
+        std::vector<uint64_t> buckets(METRIC_HISTOGRAM_COUNT * HISTOGRAM_BUCKETS, 0);
+        uint64_t sums[METRIC_HISTOGRAM_COUNT] = {};
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto &shard : shards) {
+                for (int i = 0; i < METRIC_COUNTER_COUNT; ++i) {
+                    counters[i] += shard->counters[i].load(std::memory_order_relaxed);
+                }
+                for (int i = 0; i < METRIC_GAUGE_COUNT; ++i) {
+                    gauges[i] += shard->gauges[i].load(std::memory_order_relaxed);
+                }
+                for (int h = 0; h < METRIC_HISTOGRAM_COUNT; ++h) {
+                    for (int b = 0; b < HISTOGRAM_BUCKETS; ++b) {
+                        buckets[h * HISTOGRAM_BUCKETS + b] += shard->buckets[h][b].load(std::memory_order_relaxed);
+                    }
+                    sums[h] += shard->sums[h].load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        std::string text;
+        char line[256];
+        for (int i = 0; i < METRIC_COUNTER_COUNT; ++i) {
+            std::snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", COUNTER_INFO[i].name,
+                          COUNTER_INFO[i].help, COUNTER_INFO[i].name, COUNTER_INFO[i].name, (unsigned long long)counters[i]);
+            text += line;
+        }
+        for (int i = 0; i < METRIC_GAUGE_COUNT; ++i) {
+            std::snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s gauge\n%s %lld\n", GAUGE_INFO[i].name,
+                          GAUGE_INFO[i].help, GAUGE_INFO[i].name, GAUGE_INFO[i].name, (long long)gauges[i]);
+            text += line;
+        }
+        for (int h = 0; h < METRIC_HISTOGRAM_COUNT; ++h) {
+            const HistogramInfo &info = HISTOGRAM_INFO[h];
+            std::snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s histogram\n", info.name, info.help, info.name);
+            text += line;
+            const uint64_t *counts = &buckets[h * HISTOGRAM_BUCKETS];
+            uint64_t cumulative = 0;
+            int index = 0;
+            // Границы совпадают с краями корзин: le включительно (как требует Prometheus),
+            // поэтому граница — 2^k - 1, наибольшее значение перед корзиной, начинающейся
+            // с 2^k. Нижние границы без данных не выводятся, чтобы не раздувать ответ.
+            for (int bit = HISTOGRAM_SUB_BUCKET_BITS; bit <= HISTOGRAM_MAX_BITS; ++bit) {
+                uint64_t bound = (1ULL << bit) - 1;
+                while (index < HISTOGRAM_BUCKETS && histogramBucketMax(index) <= bound) {
+                    cumulative += counts[index++];
+                }
+                if (cumulative == 0 && bit < HISTOGRAM_MAX_BITS) {
+                    continue;
+                }
+                std::snprintf(line, sizeof(line), "%s_bucket{le=\"%.9g\"} %llu\n", info.name, bound * info.scale,
+                              (unsigned long long)cumulative);
+                text += line;
+            }
+            while (index < HISTOGRAM_BUCKETS) {
+                cumulative += counts[index++];
+            }
+            std::snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.9g\n%s_count %llu\n", info.name,
+                          (unsigned long long)cumulative, info.name, sums[h] * info.scale, info.name,
+                          (unsigned long long)cumulative);
+            text += line;
+        }
+        return text;
+    }
+
+private:
+    MetricsRegistry() {}
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<MetricsShard>> shards;
+};
+
+inline void countMetric(MetricCounter counter, uint64_t amount = 1) {
+    std::atomic<uint64_t> &value = MetricsRegistry::instance().localShard().counters[counter];
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+inline void adjustGauge(MetricGauge gauge, int64_t delta) {
+    std::atomic<int64_t> &value = MetricsRegistry::instance().localShard().gauges[gauge];
+    value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+inline void recordMetric(MetricHistogram histogram, uint64_t value) {
+    MetricsShard &shard = MetricsRegistry::instance().localShard();
+    std::atomic<uint64_t> &bucket = shard.buckets[histogram][histogramIndex(value)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic<uint64_t> &sum = shard.sums[histogram];
+    sum.store(sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+inline uint64_t elapsedNs(std::chrono::steady_clock::time_point since) {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+// Журнал запросов: пишется каждая sampleEvery-я строка (и все, что помечены как важные),
+// а вывод в поток делает отдельный поток, так что обработка запроса не ждёт консоль.
+// Если очередь переполнена, строка отбрасывается и учитывается в метриках.
+class SampledLogger {
+public:
+    SampledLogger(std::ostream &out, unsigned sampleEvery, size_t capacity = 4096)
+        : out(out), sampleEvery(sampleEvery), capacity(capacity), writer(&SampledLogger::run, this) {}
+
+    ~SampledLogger() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            isStopping = true;
+        }
+        ready.notify_one();
+        writer.join();
+    }
+
+    SampledLogger(const SampledLogger &) = delete;
+    SampledLogger &operator=(const SampledLogger &) = delete;
+
+    // Проверяется до того, как строка будет собрана, чтобы пропущенные запросы не
+    // тратили время на форматирование. sampleEvery == 0 выключает выборочный журнал.
+    bool shouldLog(bool isImportant) {
+        if (isImportant) {
+            return true;
+        }
+        return sampleEvery != 0 && ++seen % sampleEvery == 0;
+    }
+
+    void log(std::string line) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (lines.size() >= capacity) {
+                countMetric(METRIC_LOG_LINES_DROPPED);
+                return;
+            }
+            lines.push_back(std::move(line));
+        }
+        ready.notify_one();
+    }
+
+private:
+    void run() {
+        std::deque<std::string> batch;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            ready.wait(lock, [this] { return isStopping || !lines.empty(); });
+            if (lines.empty() && isStopping) {
+                return;
+            }
+            batch.swap(lines);
+            lock.unlock();
+            for (const std::string &line : batch) {
+                out << line << '\n';
+            }
+            out.flush();
+            batch.clear();
+            lock.lock();
+        }
+    }
+
+    std::ostream &out;
+    unsigned sampleEvery;
+    size_t capacity;
+    unsigned long long seen = 0;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::string> lines;
+    bool isStopping = false;
+    std::thread writer;
+};
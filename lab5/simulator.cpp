@@ -11,10 +11,282 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <algorithm>
 #include <cstring>
+#include <cmath>
+#include <csignal>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
 #endif
 
-int main() {
+#ifndef _WIN32
+// Режим нагрузочного генератора: много датчиков, заданная частота, всплески и битые
+// строки в pty, FIFO или готовый порт, чтобы гонять main.cpp и thermo_logger на одной машине.
+struct LoadOptions {
+    std::string fifoPath;
+    std::string portPath;
+    bool usePty = false;
+    // Строк в секунду; 0 — без ограничения (для pty и FIFO упирается в читателя).
+    double rate = 1000.0;
+    // Ограничение скорости линии в бодах (10 бит на байт); 0 — без ограничения.
+    long baud = 0;
+    int sensors = 1;
+    double durationSeconds = 0.0;
+    double burstEverySeconds = 0.0;
+    int burstLines = 0;
+    double malformedShare = 0.0;
+    unsigned seed = 0;
+};
+
+void printLoadUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [--pty | --fifo <path> | --port <path>] [--rate <lines/s, 0 = unbounded>]\n"
+              << "       [--baud <bps>] [--sensors <n>] [--duration <s>] [--burst-every <s> --burst-lines <n>]\n"
+              << "       [--malformed <share 0..1>] [--seed <n>]\n"
+              << "Without arguments the simulator writes one sample per second to /dev/ttyUSB0." << std::endl;
+}
+
+bool parseLoadOptions(int argc, char **argv, LoadOptions &options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (option == "--pty") {
+            options.usePty = true;
+        } else if (option == "--fifo" && hasValue) {
+            options.fifoPath = argv[++i];
+        } else if (option == "--port" && hasValue) {
+            options.portPath = argv[++i];
+        } else if (option == "--rate" && hasValue) {
+            options.rate = std::atof(argv[++i]);
+        } else if (option == "--baud" && hasValue) {
+            options.baud = std::atol(argv[++i]);
+        } else if (option == "--sensors" && hasValue) {
+            options.sensors = std::max(1, std::atoi(argv[++i]));
+        } else if (option == "--duration" && hasValue) {
+            options.durationSeconds = std::atof(argv[++i]);
+        } else if (option == "--burst-every" && hasValue) {
+            options.burstEverySeconds = std::atof(argv[++i]);
+        } else if (option == "--burst-lines" && hasValue) {
+            options.burstLines = std::atoi(argv[++i]);
+        } else if (option == "--malformed" && hasValue) {
+            options.malformedShare = std::atof(argv[++i]);
+        } else if (option == "--seed" && hasValue) {
+            options.seed = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            return false;
+        }
+    }
+    int targets = options.usePty + !options.fifoPath.empty() + !options.portPath.empty();
+    return targets == 1 && options.rate >= 0;
+}
+
+// Открывает цель записи. Для pty ведомая сторона держится открытой в raw-режиме, чтобы
+// запись не упиралась в эхо и не получала EIO, пока читатель ещё не подключился.
+int openLoadTarget(const LoadOptions &options, int &slaveFd) {
+    slaveFd = -1;
+    if (options.usePty) {
+        int masterFd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (masterFd == -1 || grantpt(masterFd) != 0 || unlockpt(masterFd) != 0) {
+            perror("Ошибка создания pty");
+            return -1;
+        }
+        const char *slaveName = ptsname(masterFd);
+        slaveFd = open(slaveName, O_RDWR | O_NOCTTY);
+        struct termios terminalOptions;
+        if (slaveFd != -1 && tcgetattr(slaveFd, &terminalOptions) == 0) {
+            cfmakeraw(&terminalOptions);
+            tcsetattr(slaveFd, TCSANOW, &terminalOptions);
+        }
+        std::cout << "pty: " << slaveName << std::endl;
+        return masterFd;
+    }
+    if (!options.fifoPath.empty()) {
+        if (mkfifo(options.fifoPath.c_str(), 0644) != 0 && errno != EEXIST) {
+            perror("Ошибка создания FIFO");
+            return -1;
+        }
+        std::cout << "fifo: " << options.fifoPath << " (ожидание читателя)" << std::endl;
+        int fd = open(options.fifoPath.c_str(), O_WRONLY);
+        if (fd == -1) {
+            perror("Ошибка открытия FIFO");
+        }
+        return fd;
+    }
+    return establishSerialLink(options.portPath);
+}
+
+// Датчик: суточный синус, медленный дрейф с возвратом к среднему (процесс
+// Орнштейна-Уленбека) и измерительный шум.
+class SensorModel {
+public:
+    SensorModel(double baseTemperature, std::mt19937 &generator)
+        : base(baseTemperature), phase(std::uniform_real_distribution<double>(0.0, 6.283185307)(generator)) {}
+
+    double next(double elapsedSeconds, std::mt19937 &generator) {
+        double step = elapsedSeconds - lastSeconds;
+        lastSeconds = elapsedSeconds;
+        drift += -0.01 * drift * step + 0.05 * std::sqrt(std::max(step, 0.0)) * gaussian(generator);
+        double daily = 5.0 * std::sin(phase + elapsedSeconds * 6.283185307 / 86400.0);
+        return base + daily + drift + 0.05 * gaussian(generator);
+    }
+
+private:
+    double base;
+    double phase;
+    double drift = 0.0;
+    double lastSeconds = 0.0;
+    std::normal_distribution<double> gaussian{0.0, 1.0};
+};
+
+void appendMalformedLine(std::string &batch, std::mt19937 &generator) {
+    static const char *const lines[] = {
+        "ERR\n", "12.3.4\n", "--5.0\n", "1e5\n", "23.4567891234567891\n", "\x01\x02\x7f\n", "25,5\n"
+    };
+    batch += lines[generator() % (sizeof(lines) / sizeof(lines[0]))];
+}
+
+volatile std::sig_atomic_t loadStopRequested = 0;
+
+void requestLoadStop(int) {
+    loadStopRequested = 1;
+}
+
+// Пишет пакет целиком. Дескриптор неблокирующий, так что остановка и конец --duration
+// срабатывают и тогда, когда читатель отстал или ушёл. Возвращает число записанных байт
+// (меньше размера пакета, если запись прервана) или -1 при ошибке.
+ssize_t writeAll(int fd, const std::string &batch, std::chrono::steady_clock::time_point deadline) {
+    size_t written = 0;
+    while (written < batch.size() && !loadStopRequested && std::chrono::steady_clock::now() < deadline) {
+        ssize_t result = write(fd, batch.data() + written, batch.size() - written);
+        if (result > 0) {
+            written += (size_t)result;
+        } else if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd descriptor = {fd, POLLOUT, 0};
+            poll(&descriptor, 1, 100);
+        } else if (result < 0 && errno != EINTR) {
+            return -1;
+        }
+    }
+    return (ssize_t)written;
+}
+
+int runLoadGenerator(const LoadOptions &options) {
+    int slaveFd = -1;
+    int fd = openLoadTarget(options, slaveFd);
+    if (fd == -1) {
+        return EXIT_FAILURE;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, requestLoadStop);
+    signal(SIGTERM, requestLoadStop);
+
+    std::mt19937 generator(options.seed != 0 ? options.seed : (unsigned)std::time(nullptr));
+    std::vector<SensorModel> sensors;
+    for (int i = 0; i < options.sensors; ++i) {
+        sensors.emplace_back(15.0 + (i % 10), generator);
+    }
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+    const size_t maxBatchLines = 4096;
+    unsigned long long lines = 0, malformedLines = 0, burstLinesSent = 0, bytes = 0;
+    unsigned long long reportLines = 0, reportBytes = 0;
+    size_t nextSensor = 0;
+    std::string batch;
+    std::vector<size_t> malformedEnds;
+    char sample[32];
+
+    auto start = std::chrono::steady_clock::now();
+    auto lastReport = start;
+    auto deadline = options.durationSeconds > 0
+        ? start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options.durationSeconds))
+        : std::chrono::steady_clock::time_point::max();
+    double nextBurst = options.burstEverySeconds;
+    bool failed = false;
+
+    while (!loadStopRequested) {
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - start).count();
+        if (options.durationSeconds > 0 && elapsed >= options.durationSeconds) {
+            break;
+        }
+
+        // Сколько строк уже положено отправить к этому моменту по частоте и по скорости линии.
+        unsigned long long due = options.rate > 0 ? (unsigned long long)(elapsed * options.rate) + 1 : lines + maxBatchLines;
+        size_t count = due > lines - burstLinesSent ? (size_t)std::min<unsigned long long>(due - (lines - burstLinesSent), maxBatchLines) : 0;
+        if (options.baud > 0) {
+            double allowedBytes = elapsed * options.baud / 10.0 + 64;
+            count = bytes >= allowedBytes ? 0 : std::min(count, (size_t)((allowedBytes - bytes) / 8) + 1);
+        }
+        size_t burst = 0;
+        if (options.burstEverySeconds > 0 && elapsed >= nextBurst) {
+            burst = (size_t)options.burstLines;
+            nextBurst += options.burstEverySeconds;
+        }
+
+        if (count + burst == 0) {
+            double wait = options.rate > 0 ? (lines - burstLinesSent + 1) / options.rate - elapsed : 0.001;
+            std::this_thread::sleep_for(std::chrono::duration<double>(std::min(std::max(wait, 0.0001), 0.1)));
+            continue;
+        }
+
+        batch.clear();
+        malformedEnds.clear();
+        for (size_t i = 0; i < count + burst; ++i) {
+            if (options.malformedShare > 0 && unit(generator) < options.malformedShare) {
+                appendMalformedLine(batch, generator);
+                malformedEnds.push_back(batch.size());
+            } else {
+                double value = sensors[nextSensor].next(elapsed, generator);
+                nextSensor = (nextSensor + 1) % sensors.size();
+                int length = std::snprintf(sample, sizeof(sample), "%.4f\n", value);
+                batch.append(sample, length);
+            }
+        }
+        ssize_t written = writeAll(fd, batch, deadline);
+        if (written < 0) {
+            perror("Ошибка записи");
+            failed = true;
+            break;
+        }
+        // При остановке посреди пакета в счёт идут только строки, ушедшие целиком,
+        // иначе достигнутая частота завышается как раз тогда, когда читатель не успевает.
+        size_t sentLines = (size_t)std::count(batch.begin(), batch.begin() + written, '\n');
+        for (size_t end : malformedEnds) {
+            malformedLines += end <= (size_t)written ? 1 : 0;
+        }
+        lines += sentLines;
+        burstLinesSent += sentLines > count ? sentLines - count : 0;
+        bytes += (size_t)written;
+
+        if (now - lastReport >= std::chrono::seconds(1)) {
+            double seconds = std::chrono::duration<double>(now - lastReport).count();
+            std::cerr << std::fixed << std::setprecision(0) << "[" << elapsed << " s] "
+                      << (lines - reportLines) / seconds << " lines/s, "
+                      << std::setprecision(2) << (bytes - reportBytes) / seconds / 1e6 << " MB/s" << std::endl;
+            lastReport = now;
+            reportLines = lines;
+            reportBytes = bytes;
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::fixed << std::setprecision(2)
+              << "sent " << lines << " lines (" << malformedLines << " malformed, " << burstLinesSent << " in bursts), "
+              << bytes << " bytes in " << seconds << " s: "
+              << lines / seconds << " lines/s, " << bytes / seconds / 1e6 << " MB/s" << std::endl;
+
+    close(fd);
+    if (slaveFd != -1) {
+        close(slaveFd);
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif
+
+int main(int argc, char **argv) {
     std::srand(static_cast<unsigned>(std::time(nullptr)));
 #ifdef _WIN32
     HANDLE serialPortHandle = initializeSerialConnection("\\\\.\\COM5");
@@ -31,6 +303,15 @@ int main() {
     // Закрытие COM-порта
     CloseHandle(serialPortHandle);
 #else
+    if (argc > 1) {
+        LoadOptions options;
+        if (!parseLoadOptions(argc, argv, options)) {
+            printLoadUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        return runLoadGenerator(options);
+    }
+
     int portFd = establishSerialLink("/dev/ttyUSB0");
     while (true) {
         float tempValue = -10.0f + static_cast<float>(std::rand()) / (static_cast<float>(RAND_MAX / 50.0f));
@@ -44,4 +325,4 @@ int main() {
     close(portFd);
 #endif
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
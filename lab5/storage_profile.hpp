@@ -0,0 +1,164 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include "sqlite3.h"
+#include "timer_wheel.hpp"
+#include "trace.hpp"
+
+// Настройки SQLite, общие для main (пишет) и server (читает). По умолчанию база работает
+// в WAL: читатели не ждут писателя и наоборот, а с synchronous=NORMAL коммит не делает
+// fsync — данные сбрасываются на диск при контрольной точке. Сбой питания может
+// потерять последние коммиты, но не повредить базу. Контрольные точки делает
+// Checkpointer в своём потоке, чтобы INSERT отсчёта не платил за перенос WAL в базу.
+const char *const DATABASE_PATH = "temperature_logs.db";
+
+struct StorageProfile {
+    std::string journalMode = "WAL";
+    std::string synchronous = "NORMAL";
+    long long mmapSize = 256LL * 1024 * 1024;
+    // Действует только для новой базы: размер страницы базы в WAL уже не меняется.
+    int pageSize = 4096;
+    int cacheSizeKiB = 16 * 1024;
+    int busyTimeoutMs = 5000;
+    // Страховка на случай, если Checkpointer не запущен или не успевает: писатель сам
+    // сделает контрольную точку, когда WAL вырастет до стольких страниц (0 — никогда).
+    int walAutocheckpointPages = 10000;
+    // Период PASSIVE-контрольных точек Checkpointer; 0 — не запускать его.
+    int checkpointIntervalSeconds = 5;
+};
+
+// Разбирает переопределения вида "journal_mode=WAL,synchronous=FULL,mmap_size=0" поверх
+// значений по умолчанию (пустая строка — только значения по умолчанию).
+inline bool parseStorageProfile(const std::string &spec, StorageProfile &profile, std::string &error) {
+    size_t begin = 0;
+    while (begin < spec.size()) {
+        size_t end = spec.find(',', begin);
+        if (end == std::string::npos) {
+            end = spec.size();
+        }
+        std::string item = spec.substr(begin, end - begin);
+        begin = end + 1;
+        if (item.empty()) {
+            continue;
+        }
+        size_t equals = item.find('=');
+        if (equals == std::string::npos) {
+            error = "ожидается ключ=значение: " + item;
+            return false;
+        }
+        std::string key = item.substr(0, equals);
+        std::string value = item.substr(equals + 1);
+        char *valueEnd = nullptr;
+        long long number = std::strtoll(value.c_str(), &valueEnd, 10);
+        bool isNumber = !value.empty() && *valueEnd == '\0' && number >= 0;
+        if (key == "journal_mode") {
+            profile.journalMode = value;
+        } else if (key == "synchronous") {
+            profile.synchronous = value;
+        } else if (key == "mmap_size" && isNumber) {
+            profile.mmapSize = number;
+        } else if (key == "page_size" && isNumber) {
+            profile.pageSize = (int)number;
+        } else if (key == "cache_size_kib" && isNumber) {
+            profile.cacheSizeKiB = (int)number;
+        } else if (key == "busy_timeout_ms" && isNumber) {
+            profile.busyTimeoutMs = (int)number;
+        } else if (key == "wal_autocheckpoint" && isNumber) {
+            profile.walAutocheckpointPages = (int)number;
+        } else if (key == "checkpoint_interval_s" && isNumber) {
+            profile.checkpointIntervalSeconds = (int)number;
+        } else {
+            error = "неизвестный параметр или неверное значение: " + item;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Профиль из переменной окружения LAB5_STORAGE; при ошибке — значения по умолчанию.
+inline StorageProfile storageProfileFromEnvironment() {
+    StorageProfile profile;
+    const char *spec = std::getenv("LAB5_STORAGE");
+    std::string error;
+    if (spec != nullptr && !parseStorageProfile(spec, profile, error)) {
+        std::cerr << "LAB5_STORAGE: " << error << ", используются настройки по умолчанию" << std::endl;
+        profile = StorageProfile();
+    }
+    return profile;
+}
+
+inline bool execPragma(sqlite3 *db, const std::string &pragma) {
+    char *errMsg = nullptr;
+    if (sqlite3_exec(db, pragma.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        std::cerr << "Ошибка " << pragma << ": " << errMsg << std::endl;
+        sqlite3_free(errMsg);
+        return false;
+    }
+    return true;
+}
+
+// Применяет профиль к открытому соединению. Режим журнала хранится в самой базе, поэтому
+// его (и размер страницы) устанавливает только писатель; остальное — настройки соединения.
+inline bool applyStorageProfile(sqlite3 *db, const StorageProfile &profile, bool isWriter) {
+    sqlite3_busy_timeout(db, profile.busyTimeoutMs);
+    bool isApplied = true;
+    if (isWriter) {
+        isApplied = execPragma(db, "PRAGMA page_size = " + std::to_string(profile.pageSize) + ";") && isApplied;
+        isApplied = execPragma(db, "PRAGMA journal_mode = " + profile.journalMode + ";") && isApplied;
+        isApplied = execPragma(db, "PRAGMA synchronous = " + profile.synchronous + ";") && isApplied;
+        isApplied = execPragma(db, "PRAGMA wal_autocheckpoint = " + std::to_string(profile.walAutocheckpointPages) + ";") && isApplied;
+    }
+    isApplied = execPragma(db, "PRAGMA mmap_size = " + std::to_string(profile.mmapSize) + ";") && isApplied;
+    isApplied = execPragma(db, "PRAGMA cache_size = -" + std::to_string(profile.cacheSizeKiB) + ";") && isApplied;
+    return isApplied;
+}
+
+// Фоновые контрольные точки WAL через отдельное соединение. PASSIVE не ждёт читателей и
+// писателя: переносит в базу то, что можно перенести сейчас, остальное — в следующий раз.
+class Checkpointer {
+public:
+    Checkpointer(const char *path, const StorageProfile &profile) : db(nullptr) {
+        if (profile.checkpointIntervalSeconds <= 0 || profile.journalMode != "WAL") {
+            return;
+        }
+        if (sqlite3_open(path, &db) != SQLITE_OK) {
+            std::cerr << "Checkpointer: не удалось открыть базу: " << sqlite3_errmsg(db) << std::endl;
+            sqlite3_close(db);
+            db = nullptr;
+            return;
+        }
+        sqlite3_busy_timeout(db, profile.busyTimeoutMs);
+        // Пока соединение ничего не прочитало, оно не знает, что база в WAL, и
+        // sqlite3_wal_checkpoint для него ничего не делает.
+        execPragma(db, "SELECT count(*) FROM sqlite_master;");
+        scheduler.every(std::chrono::seconds(profile.checkpointIntervalSeconds),
+                        [this](std::chrono::system_clock::time_point) { checkpoint(); });
+    }
+
+    ~Checkpointer() {
+        scheduler.stop();
+        if (db != nullptr) {
+            checkpoint();
+            sqlite3_close(db);
+        }
+    }
+
+    Checkpointer(const Checkpointer &) = delete;
+    Checkpointer &operator=(const Checkpointer &) = delete;
+
+private:
+    void checkpoint() {
+        TRACE_SPAN("db.checkpoint");
+        int walFrames = 0;
+        int checkpointedFrames = 0;
+        int status = sqlite3_wal_checkpoint_v2(db, nullptr, SQLITE_CHECKPOINT_PASSIVE, &walFrames, &checkpointedFrames);
+        if (status != SQLITE_OK && status != SQLITE_BUSY) {
+            std::cerr << "Ошибка контрольной точки WAL: " << sqlite3_errmsg(db) << std::endl;
+        }
+    }
+
+    sqlite3 *db;
+    timerlib::Scheduler scheduler;
+};
@@ -0,0 +1,54 @@
+#ifndef APPENDABLESERIESDATA_H
+#define APPENDABLESERIESDATA_H
+
+#include <QVector>
+#include <QPointF>
+#include <QRectF>
+#include <qwt_series_data.h>
+
+// Точки графика, к которым можно дописывать новые отсчёты. В отличие от
+// QwtPointSeriesData границы не пересчитываются по всем точкам: append расширяет их
+// только на добавленные, поэтому обновление стоит пропорционально новым данным.
+class AppendableSeriesData : public QwtSeriesData<QPointF>
+{
+public:
+    size_t size() const override
+    {
+        return points.size();
+    }
+
+    QPointF sample(size_t i) const override
+    {
+        return points[(int)i];
+    }
+
+    QRectF boundingRect() const override
+    {
+        return bounds;
+    }
+
+    void append(const QVector<QPointF> &newPoints)
+    {
+        for (const QPointF &point : newPoints)
+        {
+            if (points.isEmpty())
+            {
+                bounds = QRectF(point, point);
+            }
+            else
+            {
+                bounds.setLeft(qMin(bounds.left(), point.x()));
+                bounds.setRight(qMax(bounds.right(), point.x()));
+                bounds.setTop(qMin(bounds.top(), point.y()));
+                bounds.setBottom(qMax(bounds.bottom(), point.y()));
+            }
+            points.append(point);
+        }
+    }
+
+private:
+    QVector<QPointF> points;
+    QRectF bounds = QRectF(0.0, 0.0, -1.0, -1.0);
+};
+
+#endif // APPENDABLESERIESDATA_H
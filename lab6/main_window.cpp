@@ -4,6 +4,7 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QUrlQuery>
 
 #include <QLabel>
 
@@ -13,6 +14,12 @@
 #include <qwt_text.h>
 #include <qwt_date_scale_engine.h>
 
+// Сервер lab5: /history с курсором since_id отдаёт только строки, появившиеся после
+// предыдущего запроса, поэтому загруженный период дополняется, а не скачивается заново.
+static const QString HISTORY_SERVER_URL = "http://localhost:8080";
+// Поколение загруженного периода, с которым был отправлен запрос /history.
+static const char *HISTORY_GENERATION_PROPERTY = "historyGeneration";
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
@@ -53,10 +60,35 @@ void MainWindow::onGetCurrentTemperature()
 void MainWindow::onTimerTimeout()
 {
     onGetCurrentTemperature();
+    onRefreshHistory();
+}
+
+void MainWindow::onRefreshHistory()
+{
+    if (temperatureSeries == nullptr || isHistoryRefreshPending || (historySinceId < 0 && historySinceTs.isEmpty()))
+    {
+        return;
+    }
+    QUrlQuery query;
+    if (historySinceId >= 0)
+    {
+        query.addQueryItem("since_id", QString::number(historySinceId));
+    }
+    else
+    {
+        query.addQueryItem("since_ts", historySinceTs);
+    }
+    query.addQueryItem("end_datetime", historyEndDate);
+    QUrl url(HISTORY_SERVER_URL + "/history");
+    url.setQuery(query);
+    isHistoryRefreshPending = true;
+    QNetworkReply *reply = networkManager.get(QNetworkRequest(url));
+    reply->setProperty(HISTORY_GENERATION_PROPERTY, historyGeneration);
 }
 
 void MainWindow::onGetTemperatureData(const QString &selectedDate)
 {
+    historyEndDate = selectedDate + " 23:59:59";
     QNetworkRequest request(QUrl("http://localhost:3000/getTemperatureData?selectedDate=" + selectedDate));
     networkManager.get(request);
 }
@@ -69,6 +101,7 @@ void MainWindow::on_btn_getTemperatureData_clicked()
 
 void MainWindow::onGetPeriodTemperatureData(const QString &startDate, const QString &endDate)
 {
+    historyEndDate = endDate;
     QNetworkRequest request(QUrl("http://localhost:3000/getPeriodTemperatureData?selectedStartDate=" + startDate + "&selectedEndDate=" + endDate));
     networkManager.get(request);
 }
@@ -102,9 +135,8 @@ void MainWindow::onNetworkReply(QNetworkReply *reply)
             }
             else if (jsonObject.contains("temperatureData") && jsonObject.contains("chartLabels") && jsonObject.contains("chartData"))
             {
-                temperatureCurve->setData(nullptr);
-
                 QVector<QPointF> dataPoints;
+                QDateTime lastDateTime;
                 QJsonArray temperatureData = jsonObject["temperatureData"].toArray();
                 for (int i = 0; i < temperatureData.size(); ++i) {
                     //qDebug() << temperatureData[i].toObject()["timestamp"].toString();
@@ -112,10 +144,20 @@ void MainWindow::onNetworkReply(QNetworkReply *reply)
                     QDateTime dateTime = QDateTime::fromString(obj["timestamp"].toString(), "yyyy/MM/dd HH:mm:ss");
                     double temperature = obj["temperature"].toDouble();
                     dataPoints.append(QPointF(dateTime.toMSecsSinceEpoch(), temperature));
+                    if (dateTime.isValid() && (!lastDateTime.isValid() || dateTime > lastDateTime)) {
+                        lastDateTime = dateTime;
+                    }
                 }
 
-                QwtPointSeriesData *seriesData = new QwtPointSeriesData(dataPoints);
-                temperatureCurve->setData(seriesData);
+                // setData удаляет прежние данные кривой.
+                temperatureSeries = new AppendableSeriesData();
+                temperatureSeries->append(dataPoints);
+                temperatureCurve->setData(temperatureSeries);
+                // Ответ на /history, отправленный для прежнего периода, будет отброшен.
+                historyGeneration++;
+                isHistoryRefreshPending = false;
+                historySinceId = -1;
+                historySinceTs = lastDateTime.isValid() ? lastDateTime.toString("yyyy-MM-dd HH:mm:ss") : QString();
 
                 QwtText xAxisTitle("Date/Time");
                 temperaturePlot->setAxisTitle(QwtPlot::xBottom, xAxisTitle);
@@ -125,12 +167,48 @@ void MainWindow::onNetworkReply(QNetworkReply *reply)
 
                 temperaturePlot->replot();
             }
+            else if (jsonObject.contains("rows") && jsonObject.contains("next_since_id"))
+            {
+                // Ответ /history с курсором: строки по возрастанию id, только новые.
+                if (reply->property(HISTORY_GENERATION_PROPERTY).toInt() != historyGeneration)
+                {
+                    reply->deleteLater();
+                    return;
+                }
+                isHistoryRefreshPending = false;
+                if (temperatureSeries == nullptr)
+                {
+                    reply->deleteLater();
+                    return;
+                }
+                QVector<QPointF> newPoints;
+                QJsonArray rows = jsonObject["rows"].toArray();
+                for (int i = 0; i < rows.size(); ++i) {
+                    QJsonObject obj = rows[i].toObject();
+                    QDateTime dateTime = QDateTime::fromString(obj["timestamp"].toString(), "yyyy-MM-dd HH:mm:ss");
+                    newPoints.append(QPointF(dateTime.toMSecsSinceEpoch(), obj["temperature"].toDouble()));
+                }
+                historySinceId = (qint64)jsonObject["next_since_id"].toDouble();
+                if (!newPoints.isEmpty())
+                {
+                    temperatureSeries->append(newPoints);
+                    temperaturePlot->replot();
+                }
+                if (jsonObject["has_more"].toBool())
+                {
+                    onRefreshHistory();
+                }
+            }
         }
 
         reply->deleteLater();
     }
     else
     {
+        if (reply->url().path() == "/history" && reply->property(HISTORY_GENERATION_PROPERTY).toInt() == historyGeneration)
+        {
+            isHistoryRefreshPending = false;
+        }
         qDebug() << "Network error:" << reply->errorString();
     }
 }
\ No newline at end of file
@@ -11,6 +11,8 @@
 #include <qwt_plot.h>
 #include <qwt_plot_curve.h>
 
+#include "appendable_series_data.h"
+
 QT_BEGIN_NAMESPACE
 namespace Ui {
 class MainWindow;
@@ -30,6 +32,7 @@ private slots:
     void onTimerTimeout();
     void onGetTemperatureData(const QString &selectedDate);
     void onGetPeriodTemperatureData(const QString &startDate, const QString &endDate);
+    void onRefreshHistory();
     void onNetworkReply(QNetworkReply *reply);
     void on_btn_getTemperatureData_clicked();
     void on_btn_getPeriodTemperatureData_clicked();
@@ -40,5 +43,16 @@ private:
     Ui::MainWindow *ui;
     QwtPlot *temperaturePlot;
     QwtPlotCurve *temperatureCurve;
+    // Принадлежит temperatureCurve; nullptr, пока период не загружен.
+    AppendableSeriesData *temperatureSeries = nullptr;
+    // Курсор инкрементального /history: пока id неизвестен (-1), запрос идёт по времени
+    // последней точки.
+    qint64 historySinceId = -1;
+    QString historySinceTs;
+    QString historyEndDate;
+    bool isHistoryRefreshPending = false;
+    // Растёт при каждой загрузке нового периода; ответы /history прежних поколений
+    // не дописываются в новую серию.
+    int historyGeneration = 0;
 };
 #endif // MAINWINDOW_H
\ No newline at end of file
@@ -16,6 +16,7 @@ SOURCES += \
     main_window.cpp
 
 HEADERS += \
+    appendable_series_data.h \
     main_window.h
 
 FORMS += \